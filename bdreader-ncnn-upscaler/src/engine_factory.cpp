@@ -14,3 +14,14 @@ std::unique_ptr<BaseEngine> make_engine(const Options& opts) {
     }
     return nullptr;
 }
+
+void model_files(const Options& opts, std::filesystem::path& param, std::filesystem::path& bin) {
+    if (opts.engine == Options::EngineType::RealESRGAN) {
+        const std::filesystem::path root = opts.model.empty() ? RealESRGANEngine::kDefaultModelRoot : opts.model;
+        NcnnUpscalerEngine::model_files(root, RealESRGANEngine::model_name(opts), RealESRGANEngine::kFallbackModel,
+                                        param, bin);
+    } else {
+        NcnnUpscalerEngine::model_files(opts.model, RealCUGANEngine::model_name(effective_noise_level(opts)),
+                                        RealCUGANEngine::kFallbackModel, param, bin);
+    }
+}
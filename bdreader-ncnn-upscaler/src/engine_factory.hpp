@@ -5,6 +5,11 @@
 #include "engines/realesrgan_engine.hpp"
 #include "options.hpp"
 
+#include <filesystem>
 #include <memory>
 
 std::unique_ptr<BaseEngine> make_engine(const Options& opts);
+
+/// The weight files make_engine(opts) loads (.param, then .bin), without
+/// loading them.
+void model_files(const Options& opts, std::filesystem::path& param, std::filesystem::path& bin);
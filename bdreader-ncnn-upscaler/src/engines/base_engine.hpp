@@ -1,8 +1,11 @@
 #pragma once
 
 #include "../options.hpp"
+#include "../utils/tile_executor.hpp"
 #include "../utils/tiling.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -11,6 +14,7 @@ struct ImageBuffer {
     int width = 0;
     int height = 0;
     int channels = 0;
+    std::string error;  // process_batch: why this item failed (empty on success)
 };
 
 class BaseEngine {
@@ -27,6 +31,21 @@ public:
     virtual bool process_rgb(const uint8_t* rgb_data, int width, int height,
         std::vector<uint8_t>& output_rgb, int& output_width, int& output_height) = 0;
 
+    /// process_rgb() over a region of a larger image: `height` rows of `width`
+    /// pixels, `row_stride` bytes apart (e.g. one tile of the decoded image).
+    /// The default copies the region out; engines override it to read in place.
+    virtual bool process_rgb_region(const uint8_t* rgb_data, int width, int height, size_t row_stride,
+        std::vector<uint8_t>& output_rgb, int& output_width, int& output_height) {
+        const size_t row_bytes = static_cast<size_t>(width) * 3;
+        std::vector<uint8_t> region(row_bytes * static_cast<size_t>(height));
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(region.data() + row_bytes * y, rgb_data + row_stride * y, row_bytes);
+        }
+        return process_rgb(region.data(), width, height, output_rgb, output_width, output_height);
+    }
+
+    /// One output per input, in order. A failed item has empty `data` and its
+    /// `error` set; the others are still processed.
     virtual bool process_batch(const std::vector<ImageBuffer>& inputs,
         std::vector<ImageBuffer>& outputs, const std::string& output_format) = 0;
     virtual void cleanup() = 0;
@@ -48,4 +67,33 @@ public:
 
     /// Get upscale factor (must be implemented by subclasses)
     virtual int get_scale_factor() const = 0;
+
+    /// Size of the loaded model files, as an estimate of the resident weights
+    /// (0 if unknown).
+    virtual size_t model_bytes() const { return 0; }
+
+    /// process_rgb() calls that may run at once from different threads. At 1
+    /// (the default) the engine is single-threaded: one caller at a time.
+    virtual size_t concurrency() const { return 1; }
+
+    /// Runs the tiles of this engine's images, shared by every caller. The
+    /// default runs them on the calling thread; engines with several
+    /// contexts own a pool of concurrency() workers.
+    virtual tiling::TileExecutor& tile_executor() {
+        static tiling::TileExecutor inline_executor(1);
+        return inline_executor;
+    }
+
+    /// Time spent in init(): loading the model, then the optional warm-up
+    /// inferences (`--warmup`).
+    struct InitTimings {
+        double load_ms = 0.0;
+        double warmup_ms = 0.0;
+    };
+    virtual InitTimings init_timings() const { return {}; }
+
+    /// Arithmetic outputs come from ("vulkan-fp16a", "cpu-fp32", ...): the same
+    /// model gives slightly different pixels on each. Changes if the engine
+    /// falls back to CPU; safe to call from any thread.
+    virtual std::string precision() const { return "cpu-fp32"; }
 };
@@ -0,0 +1,34 @@
+#include "driver_shader_cache.hpp"
+
+#include "../utils/logger.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace driver_shader_cache {
+
+bool configure(const fs::path& directory) {
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec || ::access(directory.c_str(), W_OK) != 0) {
+        logger::warn("Driver shader cache: cannot use " + directory.string() +
+                     (ec ? ": " + ec.message() : std::string()) + "; keeping the driver defaults");
+        return false;
+    }
+
+    // overwrite = 0: a cache location chosen in the environment wins.
+    const std::string mesa = (directory / "mesa").string();
+    const std::string nvidia = (directory / "nvidia").string();
+    ::setenv("MESA_SHADER_CACHE_DIR", mesa.c_str(), 0);
+    ::setenv("__GL_SHADER_DISK_CACHE", "1", 0);
+    ::setenv("__GL_SHADER_DISK_CACHE_PATH", nvidia.c_str(), 0);
+    ::setenv("__GL_SHADER_DISK_CACHE_SKIP_CLEANUP", "1", 0);
+    logger::info("Driver shader cache: " + directory.string());
+    return true;
+}
+
+} // namespace driver_shader_cache
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <filesystem>
+
+/// Persistent location for the Vulkan driver's own shader cache
+/// (`--shader-cache-dir`).
+///
+/// ncnn creates its pipelines without a VkPipelineCache handle and has no hook
+/// to pass one, so this process keeps no pipeline cache of its own: it only
+/// points the driver's on-disk shader cache (Mesa: RADV, ANV, lavapipe...;
+/// NVIDIA) at the directory. What the driver reuses from it, and when it
+/// discards an entry, is up to the driver.
+namespace driver_shader_cache {
+
+/// Point the driver caches at `directory` (created if needed) by setting their
+/// environment variables; those already set are left alone. Call once from
+/// main(), before any other thread starts (setenv is not thread-safe) and
+/// before the Vulkan instance is created (drivers read the variables then).
+/// False (driver defaults kept) if the directory is unusable.
+bool configure(const std::filesystem::path& directory);
+
+} // namespace driver_shader_cache
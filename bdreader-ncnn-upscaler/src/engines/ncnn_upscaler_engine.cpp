@@ -1,16 +1,27 @@
 #include "ncnn_upscaler_engine.hpp"
 
 #include "../utils/image_padding.hpp"
+#include "../utils/tile_executor.hpp"
 #include "../utils/tiling_processor.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <cstring>
+#include "cpu.h"
 #include "net.h"
 #if NCNN_VULKAN
 #include "gpu.h"
 #endif
 
+namespace {
+
+// ncnn threads per instance when --engine-instances is 0 (auto).
+constexpr int kAutoThreadsPerInstance = 4;
+
+} // namespace
+
 bool NcnnUpscalerEngine::init(const Options& opts) {
+    const auto init_start = std::chrono::steady_clock::now();
     current_options_ = opts;
     on_options_loaded();
 
@@ -64,11 +75,31 @@ bool NcnnUpscalerEngine::init(const Options& opts) {
     }
 
     if (!use_vulkan_) {
-        setup_cpu_allocators();
         apply_cpu_low_mem_profile();
+    } else {
+        vulkan_precision_ = net_.opt.use_fp16_arithmetic ? "vulkan-fp16a"
+                            : net_.opt.use_fp16_storage  ? "vulkan-fp16s"
+                                                         : "vulkan-fp32";
     }
+    setup_contexts();
 
-    return load_model();
+    if (!load_model()) {
+        return false;
+    }
+    const auto loaded = std::chrono::steady_clock::now();
+    init_timings_.load_ms = std::chrono::duration<double, std::milli>(loaded - init_start).count();
+
+    if (opts.warmup) {
+        // A failed warm-up only means the first request pays the cold costs.
+        if (!warm_up()) {
+            logger::warn(std::string(engine_name()) + " warm-up inference failed");
+        }
+        init_timings_.warmup_ms =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loaded).count();
+        logger::info(std::string(engine_name()) + " warm-up done in " +
+                     std::to_string(static_cast<int>(init_timings_.warmup_ms)) + " ms");
+    }
+    return true;
 }
 
 bool NcnnUpscalerEngine::load_model() {
@@ -78,22 +109,13 @@ bool NcnnUpscalerEngine::load_model() {
     }
 
     const std::string base = choose_model();
-    auto build_param = [&](const std::string& name) {
-        return model_root_.value() / (name + ".param");
-    };
-    auto build_bin = [&](const std::string& name) {
-        return model_root_.value() / (name + ".bin");
-    };
-
-    std::filesystem::path param = build_param(base);
-    std::filesystem::path bin = build_bin(base);
-
-    if (!std::filesystem::exists(param) || !std::filesystem::exists(bin)) {
-        const std::string fallback = fallback_model_name();
+    const std::string fallback = fallback_model_name();
+    std::filesystem::path param;
+    std::filesystem::path bin;
+    model_files(model_root_.value(), base, fallback, param, bin);
+    if (param.stem() != base) {
         logger::warn(std::string("Specified ") + engine_name() +
                      " model missing, falling back to " + fallback);
-        param = build_param(fallback);
-        bin = build_bin(fallback);
     }
 
     if (!std::filesystem::exists(param) || !std::filesystem::exists(bin)) {
@@ -105,21 +127,88 @@ bool NcnnUpscalerEngine::load_model() {
         logger::error(std::string("Failed to load ") + engine_name() + " param: " + param.string());
         return false;
     }
-    if (net_.load_model(bin.string().c_str()) != 0) {
+    const auto load_start = std::chrono::steady_clock::now();
+    const bool mapped = current_options_.model_load == "mmap" && load_mapped_weights(param, bin);
+    if (!mapped && net_.load_model(bin.string().c_str()) != 0) {
         logger::error(std::string("Failed to load ") + engine_name() + " bin: " + bin.string());
         return false;
     }
+    const double load_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+
+    std::error_code param_error;
+    std::error_code bin_error;
+    const auto param_size = std::filesystem::file_size(param, param_error);
+    const auto bin_size = std::filesystem::file_size(bin, bin_error);
+    model_bytes_ = (param_error || bin_error) ? 0 : static_cast<size_t>(param_size + bin_size);
+
+    logger::info(std::string("Loaded ") + engine_name() + " model: " + param.filename().string() +
+                 (mapped ? " (mmap, " : " (read, ") + std::to_string(static_cast<int>(load_ms)) + " ms)");
+    return true;
+}
+
+void NcnnUpscalerEngine::model_files(const std::filesystem::path& root, const std::string& base,
+    const std::string& fallback, std::filesystem::path& param, std::filesystem::path& bin) {
+    param = root / (base + ".param");
+    bin = root / (base + ".bin");
+    if (!std::filesystem::exists(param) || !std::filesystem::exists(bin)) {
+        param = root / (fallback + ".param");
+        bin = root / (fallback + ".bin");
+    }
+}
 
-    logger::info(std::string("Loaded ") + engine_name() + " model: " + param.filename().string());
+std::string NcnnUpscalerEngine::precision() const {
+    return use_vulkan_ ? vulkan_precision_ : "cpu-fp32";
+}
+
+bool NcnnUpscalerEngine::load_mapped_weights(const std::filesystem::path& param,
+    const std::filesystem::path& bin) {
+    std::string error;
+    auto file = MappedFile::open(bin.string(), error);
+    if (!file) {
+        logger::warn(std::string(engine_name()) + " cannot map " + bin.string() + " (" + error +
+                     "), reading it instead");
+        return false;
+    }
+    // ncnn references float32 weights in place (page-aligned, so 32-bit
+    // aligned as required). The mapping is kept until cleanup().
+    model_file_ = std::move(file);
+    if (net_.load_model(model_file_->data()) == 0) {
+        logger::warn(std::string(engine_name()) + " rejected mapped weights " + bin.string() + ", reading it instead");
+        // Layers loaded before the failure point into the mapping: drop them
+        // before unmapping, and start the file read from a fresh graph.
+        net_.clear();
+        model_file_.reset();
+        if (net_.load_param(param.string().c_str()) != 0) {
+            logger::error(std::string("Failed to reload ") + engine_name() + " param: " + param.string());
+        }
+        return false;
+    }
     return true;
 }
 
-bool NcnnUpscalerEngine::run_inference(const ncnn::Mat& input, ncnn::Mat& output) {
-    return run_inference(input, output, true);
+bool NcnnUpscalerEngine::warm_up() {
+    const tiling::TilingConfig config = get_tiling_config();
+    const int size = std::max(1, config.tile_size);
+    const std::vector<uint8_t> tile(static_cast<size_t>(size) * size * 3, 128);
+
+    // Contexts are leased by process_rgb(): the workers start together, so
+    // each one normally lands on its own context.
+    return tile_executor().run(concurrency(), [&](size_t) {
+        std::vector<uint8_t> output;
+        int output_width = 0;
+        int output_height = 0;
+        return process_rgb(tile.data(), size, size, output, output_width, output_height);
+    });
+}
+
+bool NcnnUpscalerEngine::run_inference(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output) {
+    return run_inference(context, input, output, true);
 }
 
-bool NcnnUpscalerEngine::run_inference(const ncnn::Mat& input, ncnn::Mat& output, bool allow_fallback) {
-    if (run_inference_impl(input, output)) {
+bool NcnnUpscalerEngine::run_inference(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output,
+    bool allow_fallback) {
+    if (run_inference_impl(context, input, output)) {
         return true;
     }
 
@@ -128,30 +217,41 @@ bool NcnnUpscalerEngine::run_inference(const ncnn::Mat& input, ncnn::Mat& output
 #if NCNN_VULKAN
         release_vulkan_allocators();
 #endif
+        // Safe in place: on Vulkan this is the only context.
         ensure_cpu_mode();
         use_vulkan_ = false;
-        setup_cpu_allocators();
         apply_cpu_low_mem_profile();
-        return run_inference_impl(input, output);
+        return run_inference_impl(context, input, output);
     }
 
     return false;
 }
 
-bool NcnnUpscalerEngine::process_image(const image_io::ImagePixels& decoded,
+bool NcnnUpscalerEngine::process_image(const input_staging::RgbView& decoded,
     image_io::ImagePixels& encoded) {
+    if (!decoded.data || decoded.width <= 0 || decoded.height <= 0) {
+        logger::error(std::string(engine_name()) + " process_image: empty input");
+        return false;
+    }
+
+    ContextLease lease(*this);
+    ExecutionContext& context = lease.context();
     ncnn::Mat in;
     ncnn::Mat result;
 
     try {
-        const image_io::ImagePixels padded_input = image_padding::pad_image(decoded);
-        in = ncnn::Mat::from_pixels(padded_input.pixels.data(), ncnn::Mat::PIXEL_RGB,
-            padded_input.width, padded_input.height);
-
-        const float norm_vals[3] = {1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f};
-        in.substract_mean_normalize(0, norm_vals);
+        // Padded, normalized [0, 1] planar input, staged in one pass straight
+        // from the source rows.
+        const int padding = image_padding::kDefaultUpscalerPadding;
+        in.create(image_padding::padded_extent(decoded.width, padding),
+                  image_padding::padded_extent(decoded.height, padding), 3);
+        if (in.empty()) {
+            throw std::runtime_error("input allocation failed");
+        }
+        input_staging::stage_planar(decoded, padding, in.w, in.h, 1.0f / 255.0f,
+                                    static_cast<float*>(in.data), in.cstep);
 
-        if (!run_inference(in, result)) {
+        if (!run_inference(context, in, result)) {
             logger::error(std::string(engine_name()) + " process_image: inference failed");
             throw std::runtime_error("Inference failed");
         }
@@ -205,20 +305,20 @@ bool NcnnUpscalerEngine::process_image(const image_io::ImagePixels& decoded,
 
         result.release();
         in.release();
-        clear_cpu_allocators();
+        clear_cpu_allocators(context);
         return true;
 
     } catch (const std::exception& e) {
         logger::error(std::string(engine_name()) + " process_image exception: " + e.what());
         if (result.data) result.release();
         if (in.data) in.release();
-        clear_cpu_allocators();
+        clear_cpu_allocators(context);
         return false;
     } catch (...) {
         logger::error(std::string(engine_name()) + " process_image unknown exception");
         if (result.data) result.release();
         if (in.data) in.release();
-        clear_cpu_allocators();
+        clear_cpu_allocators(context);
         return false;
     }
 }
@@ -239,7 +339,8 @@ bool NcnnUpscalerEngine::process_batch(const std::vector<ImageBuffer>& inputs,
         std::vector<uint8_t> compressed;
         if (!process_single(input.data.data(), input.data.size(), compressed, output_format)) {
             logger::warn(std::string(engine_name()) + " batch: inference failed");
-            outputs.push_back(result);
+            result.error = "inference failed";
+            outputs.push_back(std::move(result));
             continue;
         }
         result.data = std::move(compressed);
@@ -251,14 +352,14 @@ bool NcnnUpscalerEngine::process_batch(const std::vector<ImageBuffer>& inputs,
 
 bool NcnnUpscalerEngine::process_rgb(const uint8_t* rgb_data, int width, int height,
     std::vector<uint8_t>& output_rgb, int& output_width, int& output_height) {
-    image_io::ImagePixels input;
-    input.width = width;
-    input.height = height;
-    input.channels = 3;
-    input.pixels.assign(rgb_data, rgb_data + (width * height * 3));
+    return process_rgb_region(rgb_data, width, height, static_cast<size_t>(width) * 3,
+                              output_rgb, output_width, output_height);
+}
 
+bool NcnnUpscalerEngine::process_rgb_region(const uint8_t* rgb_data, int width, int height, size_t row_stride,
+    std::vector<uint8_t>& output_rgb, int& output_width, int& output_height) {
     image_io::ImagePixels output;
-    if (!process_image(input, output)) {
+    if (!process_image({rgb_data, width, height, row_stride}, output)) {
         logger::error(std::string(engine_name()) + " process_rgb: inference failed");
         return false;
     }
@@ -274,13 +375,26 @@ void NcnnUpscalerEngine::clear_allocators() {
     if (use_vulkan_) {
         if (blob_vkallocator_)    blob_vkallocator_->clear();
         if (staging_vkallocator_) staging_vkallocator_->clear();
-    } else {
-#endif
-        cpu_blob_allocator_.clear();
-        cpu_workspace_allocator_.clear();
-#if NCNN_VULKAN
+        return;
     }
 #endif
+    // Contexts busy on another thread keep their pools until their next clear.
+    std::lock_guard<std::mutex> lock(contexts_mutex_);
+    for (auto& context : contexts_) {
+        if (!context->busy) {
+            context->cpu_blob_allocator.clear();
+            context->cpu_workspace_allocator.clear();
+        }
+    }
+}
+
+size_t NcnnUpscalerEngine::concurrency() const {
+    std::lock_guard<std::mutex> lock(contexts_mutex_);
+    return std::max<size_t>(1, contexts_.size());
+}
+
+tiling::TileExecutor& NcnnUpscalerEngine::tile_executor() {
+    return tile_executor_ ? *tile_executor_ : BaseEngine::tile_executor();
 }
 
 void NcnnUpscalerEngine::cleanup() {
@@ -299,10 +413,11 @@ void NcnnUpscalerEngine::cleanup() {
 #endif
 
     net_.clear();
+    model_file_.reset();
 
     use_vulkan_ = false;
     model_root_.reset();
-    clear_cpu_allocators();
+    clear_allocators();
 
     logger::info(std::string(engine_name()) + " engine cleanup complete");
 }
@@ -366,16 +481,81 @@ void NcnnUpscalerEngine::apply_igpu_profile(int device_id) {
 #endif
 }
 
-void NcnnUpscalerEngine::setup_cpu_allocators() {
-    net_.opt.blob_allocator = &cpu_blob_allocator_;
-    net_.opt.workspace_allocator = &cpu_workspace_allocator_;
+void NcnnUpscalerEngine::setup_contexts() {
+    const int cores = std::max(1, ncnn::get_physical_big_cpu_count());
+    int requested = current_options_.engine_instances;
+    if (requested <= 0) {
+        // Auto: convolutions stop scaling after a few intra-op threads, while
+        // independent tiles and images scale with cores.
+        const int threads = current_options_.threads_per_instance > 0 ? current_options_.threads_per_instance
+                                                                       : std::min(cores, kAutoThreadsPerInstance);
+        requested = std::max(1, cores / threads);
+    }
+    const size_t count = use_vulkan_ ? 1 : static_cast<size_t>(requested);
+    if (use_vulkan_ && requested > 1 && current_options_.engine_instances > 0) {
+        logger::warn(std::string(engine_name()) + " runs a single engine instance on Vulkan (--engine-instances ignored)");
+    }
+
+    threads_per_context_ = current_options_.threads_per_instance;
+    if (threads_per_context_ <= 0 && count > 1) {
+        // Share the cores between the instances instead of oversubscribing them.
+        threads_per_context_ = std::max(1, cores / static_cast<int>(count));
+    }
+
+    std::lock_guard<std::mutex> lock(contexts_mutex_);
+    while (contexts_.size() < count) {
+        contexts_.push_back(std::make_unique<ExecutionContext>());
+    }
+    if (!tile_executor_ || tile_executor_->workers() != contexts_.size()) {
+        tile_executor_ = std::make_unique<tiling::TileExecutor>(contexts_.size());
+    }
+    logger::info(std::string(engine_name()) + " engine instances: " + std::to_string(contexts_.size()) +
+                 " x " + std::to_string(threads_per_context_ > 0 ? threads_per_context_ : net_.opt.num_threads) +
+                 " threads, input staging: " + input_staging::kernel_name());
+}
+
+ncnn::Extractor NcnnUpscalerEngine::create_extractor(ExecutionContext& context) const {
+    ncnn::Extractor ex = net_.create_extractor();
+    if (!use_vulkan_) {
+        ex.set_blob_allocator(&context.cpu_blob_allocator);
+        ex.set_workspace_allocator(&context.cpu_workspace_allocator);
+    }
+    if (threads_per_context_ > 0) {
+        ex.set_num_threads(threads_per_context_);
+    }
+    return ex;
 }
 
-void NcnnUpscalerEngine::clear_cpu_allocators() {
+void NcnnUpscalerEngine::clear_cpu_allocators(ExecutionContext& context) {
     if (!use_vulkan_) {
-        cpu_blob_allocator_.clear();
-        cpu_workspace_allocator_.clear();
+        context.cpu_blob_allocator.clear();
+        context.cpu_workspace_allocator.clear();
+    }
+}
+
+NcnnUpscalerEngine::ContextLease::ContextLease(NcnnUpscalerEngine& engine) : engine_(engine) {
+    std::unique_lock<std::mutex> lock(engine_.contexts_mutex_);
+    if (engine_.contexts_.empty()) {
+        engine_.contexts_.push_back(std::make_unique<ExecutionContext>());
+    }
+    engine_.context_freed_.wait(lock, [this]() {
+        for (auto& context : engine_.contexts_) {
+            if (!context->busy) {
+                context_ = context.get();
+                return true;
+            }
+        }
+        return false;
+    });
+    context_->busy = true;
+}
+
+NcnnUpscalerEngine::ContextLease::~ContextLease() {
+    {
+        std::lock_guard<std::mutex> lock(engine_.contexts_mutex_);
+        context_->busy = false;
     }
+    engine_.context_freed_.notify_one();
 }
 
 #if NCNN_VULKAN
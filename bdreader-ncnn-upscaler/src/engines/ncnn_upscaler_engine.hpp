@@ -2,21 +2,34 @@
 
 #include "base_engine.hpp"
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include "../options.hpp"
 #include "../utils/image_io.hpp"
+#include "../utils/input_staging.hpp"
 #include "../utils/logger.hpp"
+#include "../utils/mapped_file.hpp"
 #include "allocator.h"
 #include "net.h"
 
 /// Shared NCNN-backed upscaler engine. Implements the full pipeline
 /// (init, model load, preprocessing, inference dispatch, cropping, cleanup)
 /// so concrete engines only provide model selection and extractor wiring.
+///
+/// The loaded weights (`net_`) are shared by a pool of execution contexts
+/// (`--engine-instances`), each with its own CPU allocators and thread count
+/// (`--threads-per-instance`). process_rgb() is thread-safe: each call runs on
+/// a free context and waits for one when all are busy. On Vulkan the pool
+/// keeps a single context (one device queue, and the CPU fallback reconfigures
+/// `net_` in place).
 class NcnnUpscalerEngine : public BaseEngine {
 public:
     // Destructor is defaulted on purpose: cleanup() calls virtual hooks (engine_name()),
@@ -32,11 +45,44 @@ public:
         std::vector<ImageBuffer>& outputs, const std::string& output_format) override;
     bool process_rgb(const uint8_t* rgb_data, int width, int height,
         std::vector<uint8_t>& output_rgb, int& output_width, int& output_height) override;
+    bool process_rgb_region(const uint8_t* rgb_data, int width, int height, size_t row_stride,
+        std::vector<uint8_t>& output_rgb, int& output_width, int& output_height) override;
     void cleanup() override;
     void clear_allocators() override;
     tiling::TilingConfig get_tiling_config() const override;
+    size_t model_bytes() const override { return model_bytes_; }
+    size_t concurrency() const override;
+    tiling::TileExecutor& tile_executor() override;
+    InitTimings init_timings() const override { return init_timings_; }
+    std::string precision() const override;
+
+    /// The .param / .bin pair load_model() reads for model `base` under `root`:
+    /// `fallback`'s when either file of `base` is missing.
+    static void model_files(const std::filesystem::path& root, const std::string& base, const std::string& fallback,
+        std::filesystem::path& param, std::filesystem::path& bin);
 
 protected:
+    /// One inference slot over the shared weights.
+    struct ExecutionContext {
+        ncnn::UnlockedPoolAllocator cpu_blob_allocator;
+        ncnn::PoolAllocator cpu_workspace_allocator;
+        bool busy = false;
+    };
+
+    /// Holds a free context for the duration of one inference.
+    class ContextLease {
+    public:
+        explicit ContextLease(NcnnUpscalerEngine& engine);
+        ~ContextLease();
+        ContextLease(const ContextLease&) = delete;
+        ContextLease& operator=(const ContextLease&) = delete;
+        ExecutionContext& context() { return *context_; }
+
+    private:
+        NcnnUpscalerEngine& engine_;
+        ExecutionContext* context_ = nullptr;
+    };
+
     // ---- Hooks for concrete engines ----
 
     /// Short engine name used in log messages (e.g. "RealCUGAN").
@@ -51,24 +97,36 @@ protected:
     /// Fallback basename if the chosen one is missing on disk.
     virtual std::string fallback_model_name() const = 0;
 
-    /// Engine-specific NCNN extractor wiring. Return true on success.
-    virtual bool run_inference_impl(const ncnn::Mat& input, ncnn::Mat& output) = 0;
+    /// Engine-specific NCNN extractor wiring (extractors come from
+    /// create_extractor(context)). Return true on success.
+    virtual bool run_inference_impl(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output) = 0;
 
     /// Optional hook: adjust current_options_ right after init() copies opts in.
     virtual void on_options_loaded() {}
 
     // ---- Shared helpers used by both engines (not part of BaseEngine API) ----
 
-    bool process_image(const image_io::ImagePixels& decoded, image_io::ImagePixels& encoded);
-    bool run_inference(const ncnn::Mat& input, ncnn::Mat& output);
-    bool run_inference(const ncnn::Mat& input, ncnn::Mat& output, bool allow_fallback);
+    bool process_image(const input_staging::RgbView& decoded, image_io::ImagePixels& encoded);
+    bool run_inference(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output);
+    bool run_inference(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output, bool allow_fallback);
+    /// Extractor over the shared weights, using `context`'s allocators and threads.
+    ncnn::Extractor create_extractor(ExecutionContext& context) const;
 
     bool load_model();
+    /// Load `bin` from a copy-on-write file mapping (`--model-load mmap`).
+    /// False if the file cannot be mapped or ncnn rejects it; after a rejection
+    /// `net_` is cleared and `param` reloaded, ready for a plain file read.
+    bool load_mapped_weights(const std::filesystem::path& param, const std::filesystem::path& bin);
+    /// One full tile (the tile shape of get_tiling_config()) per context, run
+    /// at once, so the first request does not pay for first-inference costs.
+    bool warm_up();
     void ensure_cpu_mode();
     void apply_cpu_low_mem_profile();
     void apply_igpu_profile(int device_id);
-    void setup_cpu_allocators();
-    void clear_cpu_allocators();
+    /// Size the context pool (`--engine-instances` on CPU, one on Vulkan) and
+    /// the tile workers with it.
+    void setup_contexts();
+    void clear_cpu_allocators(ExecutionContext& context);
 #if NCNN_VULKAN
     void setup_vulkan_allocators(int device_id);
     void release_vulkan_allocators();
@@ -77,14 +135,22 @@ protected:
     // ---- Shared state ----
 
     Options current_options_{};
+    // Declared before net_ so the mapping outlives the weights that reference it.
+    std::unique_ptr<MappedFile> model_file_;
     ncnn::Net net_;
     std::optional<std::filesystem::path> model_root_;
-    bool use_vulkan_ = true;
+    std::atomic<bool> use_vulkan_{true};  // Cleared by the CPU fallback, read by precision()
+    std::string vulkan_precision_;        // precision() on Vulkan, set by init()
     bool cpu_low_mem_ = false;
     bool igpu_profile_ = false;
-
-    ncnn::UnlockedPoolAllocator cpu_blob_allocator_;
-    ncnn::PoolAllocator cpu_workspace_allocator_;
+    size_t model_bytes_ = 0;
+    InitTimings init_timings_{};
+
+    std::vector<std::unique_ptr<ExecutionContext>> contexts_;
+    mutable std::mutex contexts_mutex_;
+    std::condition_variable context_freed_;
+    int threads_per_context_ = 0;  // 0: net_.opt.num_threads
+    std::unique_ptr<tiling::TileExecutor> tile_executor_;  // One worker per context
 #if NCNN_VULKAN
     ncnn::VulkanDevice* vkdev_ = nullptr;
     ncnn::VkAllocator* blob_vkallocator_ = nullptr;
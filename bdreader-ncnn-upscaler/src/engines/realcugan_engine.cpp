@@ -3,45 +3,30 @@
 #include "../utils/logger.hpp"
 #include "net.h"
 
-#include <cctype>
 #include <string>
 
-namespace {
-int quality_to_noise(const std::string& quality) {
-    if (quality.empty()) {
-        return -1;
-    }
-    const char flag = static_cast<char>(std::toupper(quality.front()));
-    switch (flag) {
-        case 'F': return -1;
-        case 'E': return 0;
-        case 'Q': return 1;
-        case 'H': return 2;
-        default: return -1;
-    }
-}
-} // namespace
-
 void RealCUGANEngine::on_options_loaded() {
-    if (current_options_.noise_level < 0) {
-        current_options_.noise_level = quality_to_noise(current_options_.quality);
-    }
+    current_options_.noise_level = effective_noise_level(current_options_);
 }
 
-std::string RealCUGANEngine::choose_model() const {
-    switch (current_options_.noise_level) {
+std::string RealCUGANEngine::model_name(int noise_level) {
+    switch (noise_level) {
         case -1: return "up2x-no-denoise";
         case 0:  return "up2x-denoise1x";
         case 1:  return "up2x-denoise2x";
         case 2:  return "up2x-denoise3x";
-        default: return "up2x-conservative";
+        default: return kFallbackModel;
     }
 }
 
-bool RealCUGANEngine::run_inference_impl(const ncnn::Mat& input, ncnn::Mat& output) {
+std::string RealCUGANEngine::choose_model() const {
+    return model_name(current_options_.noise_level);
+}
+
+bool RealCUGANEngine::run_inference_impl(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output) {
     // Note: noise_level is baked into the model (up2x-denoise1x, up2x-denoise2x, etc.)
     // and is NOT a dynamic input parameter for these pre-compiled models.
-    ncnn::Extractor ex = net_.create_extractor();
+    ncnn::Extractor ex = create_extractor(context);
     ex.input("in0", input);
     const int ret = ex.extract("out0", output);
     if (ret != 0) {
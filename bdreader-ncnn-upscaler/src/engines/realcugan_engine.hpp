@@ -12,11 +12,15 @@ public:
 
     int get_scale_factor() const override;
 
+    /// Model basename for a RealCUGAN noise level (-1 to 2).
+    static std::string model_name(int noise_level);
+    static constexpr const char* kFallbackModel = "up2x-conservative";
+
 protected:
     const char* engine_name() const override { return "RealCUGAN"; }
     std::filesystem::path default_model_root() const override { return {}; }
     std::string choose_model() const override;
-    std::string fallback_model_name() const override { return "up2x-conservative"; }
-    bool run_inference_impl(const ncnn::Mat& input, ncnn::Mat& output) override;
+    std::string fallback_model_name() const override { return kFallbackModel; }
+    bool run_inference_impl(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output) override;
     void on_options_loaded() override;
 };
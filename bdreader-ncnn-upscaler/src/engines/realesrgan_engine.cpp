@@ -5,31 +5,37 @@
 
 #include <string>
 
-std::string RealESRGANEngine::choose_model() const {
-    if (!current_options_.model_name.empty()) {
-        logger::info("RealESRGAN using model_name: " + current_options_.model_name);
-        return current_options_.model_name;
+std::string RealESRGANEngine::model_name(const Options& opts) {
+    if (!opts.model_name.empty()) {
+        return opts.model_name;
     }
-
-    logger::info("RealESRGAN selecting model by scale: " + std::to_string(current_options_.scale));
-    switch (current_options_.scale) {
+    switch (opts.scale) {
         case 2: return "realesr-animevideov3-x2";
         case 3: return "realesr-animevideov3-x3";
         case 4: return "realesr-animevideov3-x4";
-        default:
-            logger::warn("RealESRGAN unexpected scale " + std::to_string(current_options_.scale) +
-                         ", defaulting to x2");
-            return "realesr-animevideov3-x2";
+        default: return kFallbackModel;
+    }
+}
+
+std::string RealESRGANEngine::choose_model() const {
+    if (!current_options_.model_name.empty()) {
+        logger::info("RealESRGAN using model_name: " + current_options_.model_name);
+    } else if (current_options_.scale >= 2 && current_options_.scale <= 4) {
+        logger::info("RealESRGAN selecting model by scale: " + std::to_string(current_options_.scale));
+    } else {
+        logger::warn("RealESRGAN unexpected scale " + std::to_string(current_options_.scale) +
+                     ", defaulting to x2");
     }
+    return model_name(current_options_);
 }
 
-bool RealESRGANEngine::run_inference_impl(const ncnn::Mat& input, ncnn::Mat& output) {
-    ncnn::Extractor ex = net_.create_extractor();
+bool RealESRGANEngine::run_inference_impl(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output) {
+    ncnn::Extractor ex = create_extractor(context);
 
     // Try "data" first (realesr-animevideov3 models); fall back to "in0" (realesr-general).
     int ret = ex.input("data", input);
     if (ret != 0) {
-        ex = net_.create_extractor();
+        ex = create_extractor(context);
         ret = ex.input("in0", input);
         if (ret != 0) {
             logger::error("RealESRGAN failed to find input blob (tried 'data' and 'in0')");
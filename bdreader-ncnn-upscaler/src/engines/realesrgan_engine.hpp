@@ -12,10 +12,15 @@ public:
 
     int get_scale_factor() const override;
 
+    /// Model basename for `opts`: --model-name if set, else by scale.
+    static std::string model_name(const Options& opts);
+    static constexpr const char* kDefaultModelRoot = "models/realesrgan";
+    static constexpr const char* kFallbackModel = "realesr-animevideov3-x2";
+
 protected:
     const char* engine_name() const override { return "RealESRGAN"; }
-    std::filesystem::path default_model_root() const override { return "models/realesrgan"; }
+    std::filesystem::path default_model_root() const override { return kDefaultModelRoot; }
     std::string choose_model() const override;
-    std::string fallback_model_name() const override { return "realesr-animevideov3-x2"; }
-    bool run_inference_impl(const ncnn::Mat& input, ncnn::Mat& output) override;
+    std::string fallback_model_name() const override { return kFallbackModel; }
+    bool run_inference_impl(ExecutionContext& context, const ncnn::Mat& input, ncnn::Mat& output) override;
 };
@@ -0,0 +1,155 @@
+// Ingest throughput benchmark for FdFrameReader.
+//
+// A writer thread pushes data through a pipe (as the Rust parent does on
+// stdin) and the main thread reads it back:
+//   - keep-alive: length-prefixed frames read into a FrameBufferPool, once
+//     through std::istream (the previous implementation) and once through
+//     FdFrameReader;
+//   - single-shot: one frame-sized payload read until EOF, repeated, with the
+//     previous 4 KB istream loop and with FdFrameReader::read_to_end().
+//
+// Usage: frame_reader_bench [frame_kb=2048] [total_mb=1024]
+
+#include "utils/fd_frame_reader.hpp"
+#include "utils/fd_io.hpp"
+#include "utils/frame_buffer_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Workload {
+    size_t frame_bytes = 0;
+    size_t frame_count = 0;  // Frames per stream
+    size_t streams = 1;      // Independent pipes (one per single-shot run)
+    bool length_prefix = true;
+};
+
+void write_stream(int fd, const Workload& workload) {
+    std::vector<uint8_t> frame((workload.length_prefix ? 4 : 0) + workload.frame_bytes, 0x5A);
+    if (workload.length_prefix) {
+        const uint32_t len = static_cast<uint32_t>(workload.frame_bytes);
+        frame[0] = len & 0xFF;
+        frame[1] = (len >> 8) & 0xFF;
+        frame[2] = (len >> 16) & 0xFF;
+        frame[3] = (len >> 24) & 0xFF;
+    }
+    for (size_t i = 0; i < workload.frame_count; ++i) {
+        if (!fd_io::write_all(fd, frame.data(), frame.size())) {
+            break;
+        }
+    }
+    ::close(fd);
+}
+
+/// Time `read_stream` over every stream of `workload`; it returns the bytes it consumed.
+void run_case(const char* name, const Workload& workload, const std::function<size_t(int)>& read_stream) {
+    size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t run = 0; run < workload.streams; ++run) {
+        int fds[2];
+        if (::pipe(fds) != 0) {
+            std::perror("pipe");
+            std::exit(1);
+        }
+        std::thread writer(write_stream, fds[1], workload);
+        bytes += read_stream(fds[0]);
+        writer.join();
+        ::close(fds[0]);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t expected =
+        workload.streams * workload.frame_count * ((workload.length_prefix ? 4 : 0) + workload.frame_bytes);
+    std::printf("  %-26s %9.1f MB/s  (%zu MB in %.3f s)%s\n",
+                name,
+                bytes / seconds / (1024.0 * 1024.0),
+                bytes >> 20,
+                seconds,
+                bytes == expected ? "" : "  [SHORT READ]");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t frame_kb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2048;
+    const size_t total_mb = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+    if (frame_kb == 0 || total_mb == 0) {
+        std::fprintf(stderr, "usage: %s [frame_kb] [total_mb]\n", argv[0]);
+        return 1;
+    }
+    const size_t frame_bytes = frame_kb * 1024;
+    const size_t frame_count = std::max<size_t>(1, (total_mb << 20) / frame_bytes);
+
+    Workload framed;
+    framed.frame_bytes = frame_bytes;
+    framed.frame_count = frame_count;
+    std::printf("keep-alive: %zu frames of %zu KB\n", frame_count, frame_kb);
+
+    run_case("std::istream", framed, [&](int fd) {
+        std::ifstream stream("/dev/fd/" + std::to_string(fd), std::ios::binary);
+        auto pool = FrameBufferPool::create(2, frame_bytes * 2);
+        size_t total = 0;
+        uint8_t len_bytes[4];
+        while (stream.read(reinterpret_cast<char*>(len_bytes), 4)) {
+            const uint32_t len = len_bytes[0] | (len_bytes[1] << 8) | (len_bytes[2] << 16) |
+                                 (static_cast<uint32_t>(len_bytes[3]) << 24);
+            auto frame = pool->acquire(len);
+            if (!stream.read(reinterpret_cast<char*>(frame->data()), len)) {
+                break;
+            }
+            total += 4 + len;
+        }
+        return total;
+    });
+
+    run_case("FdFrameReader", framed, [&](int fd) {
+        FdFrameReader reader(fd);
+        auto pool = FrameBufferPool::create(2, frame_bytes * 2);
+        uint32_t len = 0;
+        while (reader.read_u32(len)) {
+            auto frame = pool->acquire(len);
+            if (!reader.read_exact(frame->data(), frame->size())) {
+                break;
+            }
+        }
+        return static_cast<size_t>(reader.bytes_read());
+    });
+
+    Workload single;
+    single.frame_bytes = frame_bytes;
+    single.frame_count = 1;
+    single.streams = frame_count;
+    single.length_prefix = false;
+    std::printf("single-shot: %zu payloads of %zu KB read to EOF\n", frame_count, frame_kb);
+
+    run_case("std::istream 4 KB chunks", single, [&](int fd) {
+        std::ifstream stream("/dev/fd/" + std::to_string(fd), std::ios::binary);
+        std::vector<uint8_t> buffer;
+        std::array<char, 4096> chunk;
+        while (stream.read(chunk.data(), chunk.size())) {
+            buffer.insert(buffer.end(), chunk.begin(), chunk.end());
+        }
+        buffer.insert(buffer.end(), chunk.begin(), chunk.begin() + stream.gcount());
+        return buffer.size();
+    });
+
+    run_case("FdFrameReader::read_to_end", single, [&](int fd) {
+        FdFrameReader reader(fd);
+        std::vector<uint8_t> all;
+        reader.read_to_end(all);
+        return all.size();
+    });
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "utils/image_padding.hpp"
+#include "utils/input_staging.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr float kScale = 1.0f / 255.0f;
+constexpr int kMaxWidth = 33;
+// Guard floats after the last plane, checked for overruns.
+constexpr size_t kGuard = 64;
+
+/// Plain clamp-to-edge staging, written independently of input_staging.cpp.
+float reference(const input_staging::RgbView& src, int padding, int c, int x, int y) {
+    const int sx = std::clamp(x - padding, 0, src.width - 1);
+    const int sy = std::clamp(y - padding, 0, src.height - 1);
+    return static_cast<float>(src.data[static_cast<size_t>(sy) * src.stride + sx * 3 + c]) * kScale;
+}
+
+/// Stage `src` with `kernel` and compare every float (bit for bit) against
+/// reference(). Planes start NaN-filled so unwritten values also fail.
+bool check(const input_staging::Kernel& kernel, const input_staging::RgbView& src, int padding,
+           const std::string& label) {
+    const int out_width = image_padding::padded_extent(src.width, padding);
+    const int out_height = image_padding::padded_extent(src.height, padding);
+    const size_t plane = static_cast<size_t>(out_width) * out_height;
+    std::vector<float> planes(plane * 3 + kGuard, std::nanf(""));
+    input_staging::stage_planar(src, padding, out_width, out_height, kScale, planes.data(), plane, kernel.row);
+
+    for (int c = 0; c < 3; ++c) {
+        for (int y = 0; y < out_height; ++y) {
+            for (int x = 0; x < out_width; ++x) {
+                const float got = planes[c * plane + static_cast<size_t>(y) * out_width + x];
+                const float want = reference(src, padding, c, x, y);
+                if (std::memcmp(&got, &want, sizeof(float)) != 0) {
+                    std::cerr << kernel.name << " " << label << ": channel " << c << " at (" << x << ", " << y
+                              << ") is " << got << ", expected " << want << "\n";
+                    return false;
+                }
+            }
+        }
+    }
+    for (size_t i = plane * 3; i < planes.size(); ++i) {
+        if (!std::isnan(planes[i])) {
+            std::cerr << kernel.name << " " << label << ": wrote past the last plane\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const std::vector<input_staging::Kernel> kernels = input_staging::supported_kernels();
+    if (kernels.empty() || std::string(kernels.front().name) != "scalar") {
+        std::cerr << "Scalar kernel missing\n";
+        return 1;
+    }
+    const std::string selected = input_staging::kernel_name();
+    if (std::none_of(kernels.begin(), kernels.end(), [&](const auto& k) { return selected == k.name; })) {
+        std::cerr << "Selected kernel " << selected << " is not a supported kernel\n";
+        return 1;
+    }
+
+    // Source rows at every byte offset from an aligned block, with odd strides,
+    // so vector loads see every misalignment.
+    constexpr int kRows = 3;
+    constexpr size_t kStride = kMaxWidth * 3 + 5;
+    std::vector<uint8_t> source(kStride * kRows + 64);
+    for (size_t i = 0; i < source.size(); ++i) {
+        source[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+
+    for (const auto& kernel : kernels) {
+        for (size_t offset = 0; offset < 4; ++offset) {
+            for (int width = 1; width <= kMaxWidth; ++width) {
+                for (int height = 1; height <= kRows; ++height) {
+                    for (int padding : {0, 1, image_padding::kDefaultUpscalerPadding}) {
+                        input_staging::RgbView src;
+                        src.data = source.data() + offset;
+                        src.width = width;
+                        src.height = height;
+                        src.stride = kStride;
+                        const std::string label = std::to_string(width) + "x" + std::to_string(height) +
+                                                  " offset " + std::to_string(offset) + " padding " +
+                                                  std::to_string(padding);
+                        if (!check(kernel, src, padding, label)) {
+                            return 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::cout << "input_staging_test passed (";
+    for (size_t i = 0; i < kernels.size(); ++i) {
+        std::cout << (i ? ", " : "") << kernels[i].name;
+    }
+    std::cout << ")\n";
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include "modes/encoder_effort.hpp"
+#include "modes/job_frames.hpp"
+#include "modes/keep_alive_pipeline.hpp"
+#include "modes/request_scheduler.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace keep_alive;
+using namespace protocol_v2;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+std::shared_ptr<RequestJob> make_job(Priority priority, uint64_t cost, uint64_t sequence, Clock::time_point start) {
+    auto job = std::make_shared<RequestJob>();
+    job->request.options.priority = priority;
+    job->undispatched_cost = cost;
+    job->sequence = sequence;
+    job->start = start;
+    job->received = 1;
+    return job;
+}
+
+/// Fields of a frame read back from a pipe, as u32s and strings in order.
+class FrameReader {
+public:
+    explicit FrameReader(protocol_v2::FrameWriter frame) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return;
+        }
+        if (frame.write_to(fds[1])) {
+            close(fds[1]);
+            uint8_t chunk[4096];
+            ssize_t n = 0;
+            while ((n = read(fds[0], chunk, sizeof(chunk))) > 0) {
+                bytes_.insert(bytes_.end(), chunk, chunk + n);
+            }
+        } else {
+            close(fds[1]);
+        }
+        close(fds[0]);
+    }
+
+    bool ok() const { return ok_ && !bytes_.empty(); }
+    bool done() const { return offset_ == bytes_.size(); }
+
+    uint32_t u32() {
+        if (bytes_.size() - offset_ < 4) {
+            ok_ = false;
+            return 0;
+        }
+        uint32_t value = 0;
+        std::memcpy(&value, bytes_.data() + offset_, 4);
+        offset_ += 4;
+        return value;
+    }
+
+    std::string text() {
+        const uint32_t size = u32();
+        if (bytes_.size() - offset_ < size) {
+            ok_ = false;
+            return {};
+        }
+        std::string value(reinterpret_cast<const char*>(bytes_.data() + offset_), size);
+        offset_ += size;
+        return value;
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+    size_t offset_ = 0;
+    bool ok_ = true;
+};
+
+bool check_scheduler() {
+    const Clock::time_point now = Clock::now();
+    RequestScheduler scheduler(milliseconds(100));
+
+    // Class first, then the least work left, then arrival.
+    RequestScheduler::JobQueue jobs;
+    jobs.push_back(make_job(Priority::Normal, 10, 0, now));
+    jobs.push_back(make_job(Priority::Interactive, 1000, 1, now));
+    jobs.push_back(make_job(Priority::Interactive, 500, 2, now));
+    jobs.push_back(make_job(Priority::Interactive, 500, 3, now));
+    const std::vector<uint64_t> expected_order = {2, 3, 1, 0};
+    for (uint64_t expected : expected_order) {
+        auto it = scheduler.pick(jobs, now);
+        if ((*it)->sequence != expected) {
+            std::cerr << "Scheduler picked request " << (*it)->sequence << ", expected " << expected << "\n";
+            return false;
+        }
+        jobs.erase(it);
+    }
+
+    // A prefetch request received 250 ms ago has been promoted twice (one
+    // class per 100 ms): it competes with new interactive requests on cost.
+    jobs.push_back(make_job(Priority::Interactive, 1000, 0, now));
+    jobs.push_back(make_job(Priority::Prefetch, 10, 1, now - milliseconds(250)));
+    if (scheduler.effective_class(*jobs[1], now) != 0 ||
+        scheduler.effective_class(*jobs[1], now - milliseconds(100)) != 1 ||
+        scheduler.effective_class(*jobs[1], now - milliseconds(250)) != 2) {
+        std::cerr << "Prefetch request not promoted one class per aging period\n";
+        return false;
+    }
+    if ((*scheduler.pick(jobs, now))->sequence != 1) {
+        std::cerr << "Aged prefetch request not picked before a costlier interactive one\n";
+        return false;
+    }
+    if ((*scheduler.pick(jobs, now - milliseconds(150)))->sequence != 0) {
+        std::cerr << "Prefetch request picked before it aged to the interactive class\n";
+        return false;
+    }
+
+    // pick_ready() skips requests whose received images are all dispatched.
+    jobs[1]->next_dispatch = 1;
+    if ((*scheduler.pick_ready(jobs, now))->sequence != 0) {
+        std::cerr << "pick_ready() chose a request with nothing left to dispatch\n";
+        return false;
+    }
+    jobs[0]->received = 0;
+    if (scheduler.pick_ready(jobs, now) != jobs.end()) {
+        std::cerr << "pick_ready() chose a request with no received image\n";
+        return false;
+    }
+
+    // Images not received yet share the unreceived bytes; an image whose header
+    // cannot be read is estimated from its size.
+    const std::vector<uint8_t> unreadable(10, 0xFF);
+    RequestJob receiving;
+    receiving.request.images = {ImageView{}, ImageView{unreadable.data(), unreadable.size()}, ImageView{}};
+    receiving.unreceived_bytes = 1000;
+    RequestScheduler::estimate_costs(receiving);
+    if (receiving.image_costs != std::vector<uint64_t>{2000, 40, 2000} || receiving.undispatched_cost != 4040) {
+        std::cerr << "Unexpected cost estimates for a partially received request\n";
+        return false;
+    }
+    return true;
+}
+
+bool check_effort() {
+    using image_io::EncodeEffort;
+    std::atomic<uint8_t> level{static_cast<uint8_t>(EncodeEffort::Balanced)};
+    EncoderLoad idle;
+    idle.in_flight = 1;
+    idle.encoders = 2;
+    EncoderLoad busy = idle;
+    busy.waiting_jobs = 1;
+    EncoderLoad moderate = idle;
+    moderate.in_flight = 2;
+    moderate.encode_backlog = 1;
+
+    // Explicit levels, and Default resolving to the process default, ignore
+    // the load and leave Auto's level alone.
+    if (choose_effort(EncoderEffort::Fast, EncoderEffort::Best, false, idle, level) != EncodeEffort::Fast ||
+        choose_effort(EncoderEffort::Best, EncoderEffort::Fast, true, busy, level) != EncodeEffort::Best ||
+        choose_effort(EncoderEffort::Default, EncoderEffort::Best, false, busy, level) != EncodeEffort::Best ||
+        level != static_cast<uint8_t>(EncodeEffort::Balanced)) {
+        std::cerr << "Explicit encoder effort not honoured\n";
+        return false;
+    }
+
+    // Auto moves one level per image toward the load's target.
+    const struct {
+        const EncoderLoad& load;
+        bool near_deadline;
+        EncodeEffort expected;
+        const char* label;
+    } steps[] = {
+        {idle, false, EncodeEffort::Best, "idle pipeline"},
+        {idle, false, EncodeEffort::Best, "still idle"},
+        {busy, false, EncodeEffort::Balanced, "first image with requests waiting"},
+        {busy, false, EncodeEffort::Fast, "second image with requests waiting"},
+        {moderate, false, EncodeEffort::Balanced, "moderate load"},
+        {idle, true, EncodeEffort::Fast, "near the deadline"},
+        {moderate, false, EncodeEffort::Balanced, "moderate load after the deadline image"},
+    };
+    for (const auto& step : steps) {
+        const EncodeEffort effort = choose_effort(EncoderEffort::Auto, EncoderEffort::Balanced, step.near_deadline,
+                                                  step.load, level);
+        if (effort != step.expected) {
+            std::cerr << "Auto effort for " << step.label << " is " << image_io::encode_effort_name(effort)
+                      << ", expected " << image_io::encode_effort_name(step.expected) << "\n";
+            return false;
+        }
+    }
+    EncoderLoad backlog = idle;
+    backlog.encode_backlog = 2;
+    level = static_cast<uint8_t>(EncodeEffort::Balanced);
+    if (choose_effort(EncoderEffort::Default, EncoderEffort::Auto, false, backlog, level) != EncodeEffort::Fast) {
+        std::cerr << "Auto (process default) not fast with a full encoder backlog\n";
+        return false;
+    }
+
+    // Compressed results are cached per effort, raw ones are not.
+    const std::string fast = result_cache_key("hash", "prefix", true, EncodeEffort::Fast);
+    const std::string best = result_cache_key("hash", "prefix", true, EncodeEffort::Best);
+    if (fast != std::string("hash|prefix|") + image_io::encode_effort_name(EncodeEffort::Fast) || fast == best) {
+        std::cerr << "Compressed cache keys do not carry the effort: " << fast << ", " << best << "\n";
+        return false;
+    }
+    if (result_cache_key("hash", "prefix", false, EncodeEffort::Fast) != "hash|prefix" ||
+        result_cache_key("hash", "prefix", false, EncodeEffort::Best) != "hash|prefix") {
+        std::cerr << "Raw cache keys depend on the effort\n";
+        return false;
+    }
+    return true;
+}
+
+bool check_job_frames() {
+    RequestJob job;
+    job.request_id = 42;
+    job.outputs.emplace_back(std::vector<uint8_t>{1, 2, 3});
+    job.outputs.emplace_back();
+    job.outputs.emplace_back(std::vector<uint8_t>{4});
+    job.item_statuses = {ProtocolStatus::Ok, ProtocolStatus::EngineError, ProtocolStatus::Ok};
+    job.item_errors = {"", "decode failed", ""};
+
+    // [len][request_id][kind=Items][status][error][count]([item_status][item_error][out])*
+    FrameReader items(job_response_frame(job));
+    const uint32_t length = items.u32();
+    if (!items.ok() || length == 0 || items.u32() != 42 ||
+        items.u32() != static_cast<uint32_t>(StreamFrameKind::Items) ||
+        items.u32() != static_cast<uint32_t>(ProtocolStatus::Ok) || !items.text().empty() || items.u32() != 3) {
+        std::cerr << "Bad per-item response header\n";
+        return false;
+    }
+    const std::vector<std::string> outputs = {std::string("\x01\x02\x03"), std::string(), std::string("\x04")};
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        const uint32_t status = items.u32();
+        const std::string error = items.text();
+        const std::string output = items.text();
+        if (!items.ok() || status != static_cast<uint32_t>(job.item_statuses[i]) || error != job.item_errors[i] ||
+            output != outputs[i]) {
+            std::cerr << "Bad per-item response entry " << i << "\n";
+            return false;
+        }
+    }
+    if (!items.done()) {
+        std::cerr << "Trailing bytes after the per-item response\n";
+        return false;
+    }
+
+    // Without the option: [len][request_id][status][error][count]([out])*
+    job.item_statuses.clear();
+    job.item_errors.clear();
+    job.status = ProtocolStatus::EngineError;
+    job.error_message = "image 1 failed";
+    FrameReader plain(job_response_frame(job));
+    plain.u32();
+    if (plain.u32() != 42 || plain.u32() != static_cast<uint32_t>(ProtocolStatus::EngineError) ||
+        plain.text() != job.error_message || plain.u32() != 3) {
+        std::cerr << "Bad plain response header\n";
+        return false;
+    }
+    for (const std::string& output : outputs) {
+        if (plain.text() != output) {
+            std::cerr << "Bad plain response output\n";
+            return false;
+        }
+    }
+    if (!plain.ok() || !plain.done()) {
+        std::cerr << "Malformed plain response\n";
+        return false;
+    }
+
+    // Streamed: items are counted as they are framed, the end frame reports them.
+    RequestJob streamed;
+    streamed.request_id = 7;
+    streamed.stream = true;
+    StreamedItem item{0, ProtocolStatus::Ok, {}, image_io::EncodedImage(std::vector<uint8_t>{9, 9})};
+    StreamedItem failed{1, ProtocolStatus::EngineError, "bad image", {}};
+    FrameReader first(job_item_frame(streamed, item));
+    FrameReader second(job_item_frame(streamed, failed));
+    if (!first.ok() || !second.ok() || streamed.streamed_ok != 1 || streamed.streamed_bytes != 2) {
+        std::cerr << "Streamed items not counted\n";
+        return false;
+    }
+    FrameReader end(job_response_frame(streamed));
+    end.u32();
+    if (end.u32() != 7 || end.u32() != static_cast<uint32_t>(StreamFrameKind::End) || end.u32() != 1 ||
+        end.u32() != static_cast<uint32_t>(ProtocolStatus::Ok) || !end.text().empty() || end.u32() != 0 ||
+        !end.ok() || !end.done()) {
+        std::cerr << "Bad stream end frame\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    if (!check_scheduler() || !check_effort() || !check_job_frames()) {
+        return 1;
+    }
+    std::cout << "keep_alive_test passed\n";
+    return 0;
+}
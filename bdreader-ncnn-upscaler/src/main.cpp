@@ -1,10 +1,12 @@
 #include "engine_factory.hpp"
 #include "modes/file_mode.hpp"
+#include "modes/socket_mode.hpp"
 #include "modes/stdin_mode.hpp"
 #include "options.hpp"
 #include "utils/logger.hpp"
 
 #if NCNN_VULKAN
+#include "engines/driver_shader_cache.hpp"
 #include "gpu.h"
 #endif
 
@@ -16,6 +18,14 @@ int main(int argc, char** argv) {
 
     logger::set_level((opts.verbose || opts.profiling || opts.log_protocol) ? logger::Level::Info : logger::Level::Warn);
 
+#if NCNN_VULKAN
+    // Before any thread starts (model preloading runs engine inits in
+    // parallel) and before the Vulkan instance reads the environment.
+    if (!opts.shader_cache_dir.empty()) {
+        driver_shader_cache::configure(opts.shader_cache_dir);
+    }
+#endif
+
     int exit_code = 0;
     {
         auto engine = make_engine(opts);
@@ -31,6 +41,9 @@ int main(int argc, char** argv) {
             case Options::Mode::Stdin:
                 exit_code = run_stdin_mode(engine.get(), opts);
                 break;
+            case Options::Mode::Socket:
+                exit_code = run_socket_mode(engine.get(), opts);
+                break;
         }
         // Engine destructor runs here, releasing Vulkan/NCNN resources
         // BEFORE ncnn::destroy_gpu_instance() tears down the global Vulkan context.
@@ -0,0 +1,253 @@
+#include "model_registry.hpp"
+
+#include "engine_factory.hpp"
+#include "utils/logger.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// RealCUGAN model directory when the primary engine is RealESRGAN and
+// --alt-model is not given (same default as --model).
+constexpr const char* kDefaultRealCuganModel = "models/realcugan/models-se";
+
+/// "2", "x2" or "2x"; only the scales RealESRGANEngine has models for.
+bool parse_scale(const std::string& value, int& scale) {
+    std::string digits;
+    for (char c : value) {
+        if (std::isdigit(static_cast<unsigned char>(c))) {
+            digits.push_back(c);
+        } else if (c != 'x' && c != 'X') {
+            return false;
+        }
+    }
+    if (digits.size() != 1 || digits[0] < '2' || digits[0] > '4') {
+        return false;
+    }
+    scale = digits[0] - '0';
+    return true;
+}
+
+/// "name:size:mtime" of a weight file, or "name:missing".
+std::string file_identity(const std::filesystem::path& path) {
+    std::error_code size_error;
+    std::error_code time_error;
+    const auto size = std::filesystem::file_size(path, size_error);
+    const auto time = std::filesystem::last_write_time(path, time_error);
+    if (size_error || time_error) {
+        return path.filename().string() + ":missing";
+    }
+    return path.filename().string() + ":" + std::to_string(size) + ":" +
+           std::to_string(time.time_since_epoch().count());
+}
+
+} // namespace
+
+ModelRegistry::ModelRegistry(BaseEngine* primary, const Options& opts)
+    : opts_(opts),
+      primary_(primary),
+      primary_lease_(primary, [](BaseEngine*) {}),
+      primary_key_(variant_key(opts)),
+      budget_bytes_(static_cast<size_t>(opts.model_memory_mb) * 1024u * 1024u),
+      resident_bytes_(primary ? primary->model_bytes() : 0) {
+    weights_keys_.emplace(primary_key_, weights_identity(opts));
+}
+
+std::shared_ptr<BaseEngine> ModelRegistry::acquire(const protocol_v2::RequestPayload& request, std::string& error) {
+    const Options variant = variant_options(request);
+    const std::string key = variant_key(variant);
+    if (key == primary_key_) {
+        return primary_lease_;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+        lru_.splice(lru_.begin(), lru_, found->second);
+        return lru_.front().engine;
+    }
+    if (failed_.count(key) != 0) {
+        error = "model " + key + " is unavailable";
+        return nullptr;
+    }
+
+    logger::info("Model registry: loading " + key);
+    std::unique_ptr<BaseEngine> engine = make_engine(variant);
+    if (!engine) {
+        failed_.insert(key);
+        error = "model " + key + " failed to load";
+        logger::error("Model registry: " + error);
+        return nullptr;
+    }
+    const size_t bytes = engine->model_bytes();
+    lru_.push_front(Entry{key, std::move(engine), bytes});
+    index_[key] = lru_.begin();
+    resident_bytes_ += bytes;
+    evict_to_budget();
+    return lru_.front().engine;
+}
+
+void ModelRegistry::preload(const std::string& list) {
+    struct Load {
+        std::string key;
+        Options options;
+        std::unique_ptr<BaseEngine> engine;
+    };
+    std::vector<Load> loads;
+
+    std::istringstream entries(list);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        entry.erase(std::remove_if(entry.begin(), entry.end(), [](unsigned char c) { return std::isspace(c); }),
+                    entry.end());
+        if (entry.empty()) {
+            continue;
+        }
+        protocol_v2::RequestPayload request{};
+        request.engine = opts_.engine;
+        request.quality_or_scale = entry;
+        const size_t colon = entry.find(':');
+        if (colon != std::string::npos) {
+            std::string engine = entry.substr(0, colon);
+            std::transform(engine.begin(), engine.end(), engine.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (engine == "realcugan") {
+                request.engine = Options::EngineType::RealCUGAN;
+            } else if (engine == "realesrgan") {
+                request.engine = Options::EngineType::RealESRGAN;
+            } else {
+                logger::warn("Model registry: unknown engine in preload entry '" + entry + "'");
+                continue;
+            }
+            request.quality_or_scale = entry.substr(colon + 1);
+        }
+
+        Options variant = variant_options(request);
+        std::string key = variant_key(variant);
+        const bool queued = std::any_of(loads.begin(), loads.end(), [&](const Load& load) { return load.key == key; });
+        bool resident = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            resident = index_.count(key) != 0 || failed_.count(key) != 0;
+        }
+        if (key == primary_key_ || queued || resident) {
+            continue;
+        }
+        loads.push_back(Load{std::move(key), std::move(variant), nullptr});
+    }
+    if (loads.empty()) {
+        return;
+    }
+
+    // Each variant builds (and warms up) its own net: loading them side by side
+    // overlaps their file reads, pipeline creation and warm-up inferences.
+    logger::info("Model registry: preloading " + std::to_string(loads.size()) + " model(s)");
+    std::vector<std::thread> threads;
+    threads.reserve(loads.size());
+    for (auto& load : loads) {
+        threads.emplace_back([&load]() { load.engine = make_engine(load.options); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& load : loads) {
+        if (!load.engine) {
+            failed_.insert(load.key);
+            logger::error("Model registry: model " + load.key + " failed to load");
+            continue;
+        }
+        const size_t bytes = load.engine->model_bytes();
+        lru_.push_front(Entry{load.key, std::move(load.engine), bytes});
+        index_[load.key] = lru_.begin();
+        resident_bytes_ += bytes;
+    }
+    evict_to_budget();
+}
+
+std::vector<std::pair<std::string, BaseEngine::InitTimings>> ModelRegistry::init_timings() const {
+    std::vector<std::pair<std::string, BaseEngine::InitTimings>> timings;
+    if (primary_) {
+        timings.emplace_back(primary_key_, primary_->init_timings());
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : lru_) {
+        timings.emplace_back(entry.key, entry.engine->init_timings());
+    }
+    return timings;
+}
+
+std::string ModelRegistry::weights_key(const protocol_v2::RequestPayload& request) const {
+    const Options variant = variant_options(request);
+    std::string key = variant_key(variant);
+    std::lock_guard<std::mutex> lock(weights_mutex_);
+    auto found = weights_keys_.find(key);
+    if (found == weights_keys_.end()) {
+        found = weights_keys_.emplace(std::move(key), weights_identity(variant)).first;
+    }
+    return found->second;
+}
+
+int ModelRegistry::scale_factor(const protocol_v2::RequestPayload& request) const {
+    const Options variant = variant_options(request);
+    // RealCUGANEngine only ships its up2x models.
+    return variant.engine == Options::EngineType::RealESRGAN ? variant.scale : 2;
+}
+
+Options ModelRegistry::variant_options(const protocol_v2::RequestPayload& request) const {
+    Options variant = opts_;
+    if (request.engine != opts_.engine) {
+        variant.engine = request.engine;
+        variant.model = opts_.alt_model;
+        variant.model_name.clear();
+        if (variant.model.empty() && variant.engine == Options::EngineType::RealCUGAN) {
+            variant.model = kDefaultRealCuganModel;
+        }
+    }
+
+    if (variant.engine == Options::EngineType::RealCUGAN) {
+        int noise_level = -1;
+        if (quality_noise_level(request.quality_or_scale, noise_level)) {
+            variant.quality = request.quality_or_scale;
+            variant.noise_level = noise_level;
+        }
+    } else {
+        int scale = 0;
+        if (parse_scale(request.quality_or_scale, scale) && scale != variant.scale) {
+            variant.scale = scale;
+            variant.model_name.clear();
+        }
+    }
+    return variant;
+}
+
+std::string ModelRegistry::variant_key(const Options& options) {
+    if (options.engine == Options::EngineType::RealESRGAN) {
+        return "realesrgan:" + options.model + ":" +
+               (options.model_name.empty() ? "x" + std::to_string(options.scale) : options.model_name);
+    }
+    return "realcugan:" + options.model + ":noise" + std::to_string(effective_noise_level(options));
+}
+
+std::string ModelRegistry::weights_identity(const Options& options) {
+    std::filesystem::path param;
+    std::filesystem::path bin;
+    model_files(options, param, bin);
+    return variant_key(options) + "|" + file_identity(param) + "|" + file_identity(bin);
+}
+
+void ModelRegistry::evict_to_budget() {
+    while (resident_bytes_ > budget_bytes_ && lru_.size() > 1) {
+        Entry& victim = lru_.back();
+        logger::info("Model registry: evicting " + victim.key + " (" + std::to_string(victim.bytes) + " bytes)");
+        resident_bytes_ -= victim.bytes;
+        index_.erase(victim.key);
+        lru_.pop_back();
+    }
+}
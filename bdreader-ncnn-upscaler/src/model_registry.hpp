@@ -0,0 +1,107 @@
+#pragma once
+
+#include "engines/base_engine.hpp"
+#include "options.hpp"
+#include "protocol_v2.hpp"
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/// Engines for the model variants keep-alive requests ask for.
+///
+/// A request selects its engine (`RequestPayload::engine`) and variant
+/// (`quality_or_scale`: F/E/Q/H for RealCUGAN, the scale for RealESRGAN); each
+/// distinct model is loaded on demand with make_engine(), with the command line
+/// options for everything else (GPU, tiling, model directory). Loaded variants
+/// stay resident, least recently used first out, as long as their weights fit
+/// in `--model-memory-mb`. The engine built from the command line is borrowed,
+/// never evicted, and serves requests whose fields are empty or unrecognised.
+///
+/// Thread-safe: the pipeline's inference threads share it. acquire() hands out
+/// a shared reference, so an engine evicted while a thread still runs it is
+/// only destroyed once that thread lets go of it.
+class ModelRegistry {
+public:
+    ModelRegistry(BaseEngine* primary, const Options& opts);
+
+    ModelRegistry(const ModelRegistry&) = delete;
+    ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+    /// Engine for `request`, loading it if needed (other threads wait for the
+    /// load). nullptr (and `error`) if the model cannot be loaded; a failed
+    /// variant is not retried.
+    std::shared_ptr<BaseEngine> acquire(const protocol_v2::RequestPayload& request, std::string& error);
+
+    /// Load the variants of `list` (`--preload-models`: comma-separated
+    /// `[engine:]quality_or_scale`, the engine defaulting to `--engine`) all at
+    /// once, each on its own thread, and keep them resident as acquire() would.
+    /// Entries naming the primary model or one already loaded are skipped;
+    /// failures are logged and remembered like failed acquire() loads.
+    void preload(const std::string& list);
+
+    /// init() timings of the primary engine, then of each resident variant
+    /// (most recently used first), with their model keys.
+    std::vector<std::pair<std::string, BaseEngine::InitTimings>> init_timings() const;
+
+    BaseEngine* primary() const { return primary_; }
+
+    /// Identifies the model acquire() would run `request` with, without loading
+    /// it. Safe to call from any thread.
+    std::string model_key(const protocol_v2::RequestPayload& request) const {
+        return variant_key(variant_options(request));
+    }
+
+    /// model_key() plus the name, size and modification time of the weight
+    /// files, so cached results (on disk too) of other weights never match.
+    /// Read once per model (the primary's at construction): the weights a
+    /// loaded model keeps running with.
+    /// Safe to call from any thread; never waits for a model load.
+    std::string weights_key(const protocol_v2::RequestPayload& request) const;
+
+    /// Upscale factor `request` runs at. Safe to call from any thread.
+    int scale_factor(const protocol_v2::RequestPayload& request) const;
+
+    /// Variants loaded on demand and still resident (the primary engine excluded).
+    size_t loaded_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lru_.size();
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<BaseEngine> engine;
+        size_t bytes = 0;
+    };
+
+    /// Command line options with the request's engine / variant applied.
+    Options variant_options(const protocol_v2::RequestPayload& request) const;
+    /// Identifies the model file `options` loads.
+    static std::string variant_key(const Options& options);
+    /// weights_key() of `options`, read from the files.
+    static std::string weights_identity(const Options& options);
+    /// Drop least recently used variants (never the most recent one) until the
+    /// resident weights fit the budget.
+    void evict_to_budget();
+
+    const Options& opts_;
+    BaseEngine* primary_;
+    const std::shared_ptr<BaseEngine> primary_lease_;  // Non-owning
+    const std::string primary_key_;
+    const size_t budget_bytes_;
+    // Apart from mutex_, which is held during model loads.
+    mutable std::mutex weights_mutex_;
+    mutable std::unordered_map<std::string, std::string> weights_keys_;  // model_key() → weights_key()
+    mutable std::mutex mutex_;  // Guards everything below
+    size_t resident_bytes_ = 0;
+    std::list<Entry> lru_;  // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::unordered_set<std::string> failed_;
+};
@@ -0,0 +1,55 @@
+#include "encoder_effort.hpp"
+
+namespace keep_alive {
+
+image_io::EncodeEffort choose_effort(protocol_v2::EncoderEffort requested,
+                                     protocol_v2::EncoderEffort process_default,
+                                     bool near_deadline,
+                                     const EncoderLoad& load,
+                                     std::atomic<uint8_t>& auto_level) {
+    using protocol_v2::EncoderEffort;
+    if (requested == EncoderEffort::Default) {
+        requested = process_default;
+    }
+    switch (requested) {
+        case EncoderEffort::Fast:
+            return image_io::EncodeEffort::Fast;
+        case EncoderEffort::Balanced:
+            return image_io::EncodeEffort::Balanced;
+        case EncoderEffort::Best:
+            return image_io::EncodeEffort::Best;
+        default:
+            break;
+    }
+
+    if (near_deadline) {
+        return image_io::EncodeEffort::Fast;
+    }
+    auto target = image_io::EncodeEffort::Balanced;
+    if (load.waiting_jobs > 0 || load.encode_backlog >= load.encoders) {
+        target = image_io::EncodeEffort::Fast;
+    } else if (load.encode_backlog == 0 && load.in_flight <= 1) {
+        target = image_io::EncodeEffort::Best;
+    }
+
+    uint8_t current = auto_level.load(std::memory_order_relaxed);
+    const auto wanted = static_cast<uint8_t>(target);
+    if (wanted != current) {
+        current = static_cast<uint8_t>(wanted > current ? current + 1 : current - 1);
+        auto_level.store(current, std::memory_order_relaxed);
+    }
+    return static_cast<image_io::EncodeEffort>(current);
+}
+
+std::string result_cache_key(const std::string& content_hash,
+                             const std::string& cache_prefix,
+                             bool compressed,
+                             image_io::EncodeEffort effort) {
+    std::string key = content_hash + "|" + cache_prefix;
+    if (compressed) {
+        key += std::string("|") + image_io::encode_effort_name(effort);
+    }
+    return key;
+}
+
+} // namespace keep_alive
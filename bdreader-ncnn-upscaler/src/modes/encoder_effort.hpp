@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../protocol_v2.hpp"
+#include "../utils/image_io.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace keep_alive {
+
+/// Pipeline load an Auto request looks at when it picks its effort.
+struct EncoderLoad {
+    size_t waiting_jobs = 0;    // Requests waiting for a slot
+    size_t in_flight = 0;       // Requests admitted and not yet answered
+    size_t encode_backlog = 0;  // Images queued for the encoders
+    size_t encoders = 1;
+};
+
+/// Effort of one compressed image. `requested` is the request's own setting;
+/// EncoderEffort::Default takes `process_default` (--encoder-effort).
+///
+/// Auto encodes fast once the request is `near_deadline`. Otherwise it aims
+/// for Fast while requests wait for a slot or the encoders fall behind, Best
+/// when this is the only request and nothing is queued for the encoders, and
+/// Balanced in between; `auto_level` (the pipeline's current Auto level) moves
+/// one step toward that target per image, so a short burst does not swing the
+/// effort (and the process-wide PNG settings) back and forth.
+image_io::EncodeEffort choose_effort(protocol_v2::EncoderEffort requested,
+                                     protocol_v2::EncoderEffort process_default,
+                                     bool near_deadline,
+                                     const EncoderLoad& load,
+                                     std::atomic<uint8_t>& auto_level);
+
+/// Result cache key of one image: its content hash and the job's
+/// `cache_prefix`, then for compressed outputs the effort, since lossy WebP
+/// output differs between effort levels.
+std::string result_cache_key(const std::string& content_hash,
+                             const std::string& cache_prefix,
+                             bool compressed,
+                             image_io::EncodeEffort effort);
+
+} // namespace keep_alive
@@ -0,0 +1,203 @@
+#include "incremental_frame.hpp"
+
+#include "../utils/logger.hpp"
+#include "../utils/raw_pixels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace keep_alive {
+
+using namespace protocol_v2;
+
+IncrementalFrame::IncrementalFrame(uint32_t message_len,
+                                   std::chrono::steady_clock::time_point start,
+                                   size_t max_batch_items,
+                                   size_t max_payload_bytes,
+                                   RequestIntake& intake,
+                                   Pipeline& pipeline,
+                                   std::shared_ptr<FrameBufferPool> pool,
+                                   Submit submit)
+    : message_len_(message_len),
+      start_(start),
+      max_batch_items_(max_batch_items),
+      max_payload_bytes_(max_payload_bytes),
+      intake_(intake),
+      pipeline_(pipeline),
+      pool_(std::move(pool)),
+      submit_(std::move(submit)) {}
+
+IncrementalFrame::~IncrementalFrame() {
+    if (job_) {
+        pipeline_.abort_receiving(job_, ProtocolStatus::InvalidFrame,
+                                  "frame truncated after " + std::to_string(consumed_) + " of " +
+                                      std::to_string(message_len_) + " bytes");
+    }
+}
+
+size_t IncrementalFrame::wanted() const {
+    switch (phase_) {
+        case Phase::Header:
+            return sizeof(header_bytes_) - consumed_;
+        case Phase::Body:
+            return parser_->wanted();
+        case Phase::Discard:
+            return message_len_ - consumed_;
+        default:
+            return 0;
+    }
+}
+
+size_t IncrementalFrame::feed(const uint8_t* data, size_t size) {
+    const size_t taken = std::min(size, wanted());
+    switch (phase_) {
+        case Phase::Header:
+            std::memcpy(header_bytes_ + consumed_, data, taken);
+            consumed_ += taken;
+            if (consumed_ == sizeof(header_bytes_)) {
+                start_body();
+            }
+            break;
+        case Phase::Body:
+            parser_->feed(data, taken);
+            consumed_ += taken;
+            advance();
+            break;
+        case Phase::Discard:
+            consumed_ += taken;
+            break;
+        default:
+            break;
+    }
+    return taken;
+}
+
+uint8_t* IncrementalFrame::direct_buffer(size_t& size) {
+    FrameBuffer* target = phase_ == Phase::Image ? image_.get() : phase_ == Phase::Whole ? frame_.get() : nullptr;
+    if (!target) {
+        size = 0;
+        return nullptr;
+    }
+    size = target->size() - filled_;
+    return target->data() + filled_;
+}
+
+void IncrementalFrame::direct_read(size_t size) {
+    filled_ += size;
+    consumed_ += size;
+    if (phase_ == Phase::Image && filled_ == image_->size()) {
+        finish_image();
+    } else if (phase_ == Phase::Whole && filled_ == frame_->size()) {
+        submit_(intake_.build(std::move(frame_), start_));
+        frame_.reset();
+    }
+}
+
+void IncrementalFrame::start_body() {
+    std::string error;
+    const bool valid = parse_protocol_header(header_bytes_, sizeof(header_bytes_), header_, error);
+    const uint32_t base_type = header_.msg_type & kMessageTypeMask;
+    if (!valid || (base_type != static_cast<uint32_t>(ProtocolMessageType::Request) &&
+                   base_type != static_cast<uint32_t>(ProtocolMessageType::StreamRequest))) {
+        read_whole({});  // build() reports the bad header
+        return;
+    }
+    parser_ = std::make_unique<RequestBodyParser>(message_len_ - kProtocolHeaderSize,
+                                                  (header_.msg_type & kMessageFlagOptions) != 0,
+                                                  max_batch_items_, max_payload_bytes_);
+    phase_ = Phase::Body;
+    advance();
+}
+
+void IncrementalFrame::advance() {
+    using State = RequestBodyParser::State;
+    if (parser_->state() == State::Fields) {
+        return;
+    }
+
+    if (!begun_) {
+        // Just past the fields (or failed on them).
+        begun_ = true;
+        if (parser_->state() != State::Failed && parser_->options().transport == Transport::SharedMemory) {
+            read_whole(parser_->fields());
+            return;
+        }
+        auto job = intake_.begin(header_, *parser_, start_, message_len_);
+        if (job->has_request) {
+            job_ = job;
+        }
+        submit_(std::move(job));
+        if (!job_ || !job_->has_request) {
+            // Rejected on its fields, or at admission.
+            job_.reset();
+            discard();
+            return;
+        }
+    }
+
+    switch (parser_->state()) {
+        case State::ImageBytes:
+            image_ = pool_->acquire(parser_->image_size());
+            filled_ = 0;
+            phase_ = Phase::Image;
+            if (parser_->image_size() == 0) {
+                finish_image();
+            }
+            break;
+        case State::Failed:
+            pipeline_.abort_receiving(job_, parser_->status(), parser_->error());
+            job_.reset();
+            discard();
+            break;
+        case State::Done:
+            job_.reset();
+            break;
+        default:
+            break;  // Next length prefix, through feed()
+    }
+}
+
+void IncrementalFrame::finish_image() {
+    const uint32_t index = parser_->image_index();
+    const ImageView image{image_->data(), image_->size()};
+    std::string error;
+    if (job_->request.options.input == InputEncoding::RawPixels &&
+        !raw_pixels::validate(image.data, image.size, error)) {
+        pipeline_.abort_receiving(job_, ProtocolStatus::ValidationError, "image " + std::to_string(index) + ": " + error);
+        job_.reset();
+        image_.reset();
+        discard();
+        return;
+    }
+    job_->request.images[index] = image;
+    job_->image_storage[index] = std::move(image_);
+    pipeline_.image_received(job_, index);
+
+    phase_ = Phase::Body;
+    parser_->image_read();
+    advance();
+}
+
+void IncrementalFrame::read_whole(const std::vector<uint8_t>& fields) {
+    if (message_len_ > kMaxMessageBytes) {
+        logger::error("Protocol v2 frame too large: " + std::to_string(message_len_));
+        submit_(intake_.respond(0, ProtocolStatus::InvalidFrame, "frame exceeds max size", start_, message_len_));
+        discard();
+        return;
+    }
+    frame_ = pool_->acquire(message_len_);
+    std::memcpy(frame_->data(), header_bytes_, sizeof(header_bytes_));
+    if (!fields.empty()) {
+        std::memcpy(frame_->data() + sizeof(header_bytes_), fields.data(), fields.size());
+    }
+    filled_ = consumed_;
+    phase_ = Phase::Whole;
+}
+
+void IncrementalFrame::discard() {
+    phase_ = Phase::Discard;
+}
+
+} // namespace keep_alive
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "../protocol_v2.hpp"
+#include "../utils/frame_buffer_pool.hpp"
+#include "keep_alive_pipeline.hpp"
+#include "protocol_session.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace keep_alive {
+
+/// Frames up to this size are read whole; larger ones go through
+/// IncrementalFrame.
+constexpr uint32_t kIncrementalFrameBytes = 1u * 1024u * 1024u;
+
+/// A large protocol v2 frame received piece by piece.
+///
+/// A Request / StreamRequest is submitted as soon as its fields are parsed
+/// (RequestBodyParser), then each image is handed to the pipeline as soon as
+/// its own bytes are in: decoding image 0 overlaps with the transfer of the
+/// rest, and the frame is never resident as a whole, so its image bytes are
+/// bounded by `max_payload_bytes` (`--max-frame-mb`) rather than
+/// kMaxBatchPayloadBytes (each image still by kMaxImageSizeBytes). Other frames, and
+/// shared memory requests (their slots are all resolved up front), are read
+/// whole and built by RequestIntake as usual, up to kMaxMessageBytes; beyond
+/// that they are skipped and rejected.
+///
+/// Bytes come in through feed() (copied), or are read by the caller straight
+/// into direct_buffer() (image bytes, whole frames). The frame takes exactly
+/// `message_len` bytes, then complete() turns true. Destroying it earlier
+/// (client gone) aborts the request it submitted.
+///
+/// Not thread-safe; used by the thread reading the client.
+class IncrementalFrame {
+public:
+    /// Hands a job to the pipeline (front-end bookkeeping included).
+    using Submit = std::function<void(std::shared_ptr<RequestJob>)>;
+
+    IncrementalFrame(uint32_t message_len,
+                     std::chrono::steady_clock::time_point start,
+                     size_t max_batch_items,
+                     size_t max_payload_bytes,
+                     RequestIntake& intake,
+                     Pipeline& pipeline,
+                     std::shared_ptr<FrameBufferPool> pool,
+                     Submit submit);
+    ~IncrementalFrame();
+
+    IncrementalFrame(const IncrementalFrame&) = delete;
+    IncrementalFrame& operator=(const IncrementalFrame&) = delete;
+
+    /// True once all `message_len` bytes have been consumed.
+    bool complete() const { return consumed_ == message_len_; }
+
+    /// Bytes feed() takes next; 0 when they go to direct_buffer() instead.
+    size_t wanted() const;
+
+    /// Consume up to wanted() bytes of `data`; returns how many were taken.
+    size_t feed(const uint8_t* data, size_t size);
+
+    /// Where the next `size` bytes may be read in place, or nullptr when they
+    /// must go through feed().
+    uint8_t* direct_buffer(size_t& size);
+
+    /// `size` bytes (at most what direct_buffer() offered) were read into it.
+    void direct_read(size_t size);
+
+private:
+    enum class Phase {
+        Header,   // Collecting the 16-byte header
+        Body,     // Request fields / image length prefixes, through the parser
+        Image,    // Image bytes, into `image_`
+        Whole,    // Any other frame, into `frame_`
+        Discard,  // Rejected: skip the rest
+    };
+
+    /// Header complete: pick how the body is read.
+    void start_body();
+    /// Act on the parser's new state after it consumed something.
+    void advance();
+    /// Image `image_` is complete: hand it to the pipeline.
+    void finish_image();
+    /// Read the rest of the frame into a FrameBuffer, after what is already
+    /// consumed (header and `fields`), if it may be held whole.
+    void read_whole(const std::vector<uint8_t>& fields);
+    void discard();
+
+    const uint32_t message_len_;
+    const std::chrono::steady_clock::time_point start_;
+    const size_t max_batch_items_;
+    const size_t max_payload_bytes_;
+    RequestIntake& intake_;
+    Pipeline& pipeline_;
+    std::shared_ptr<FrameBufferPool> pool_;
+    Submit submit_;
+
+    Phase phase_ = Phase::Header;
+    size_t consumed_ = 0;
+    uint8_t header_bytes_[protocol_v2::kProtocolHeaderSize] = {};
+    protocol_v2::ProtocolHeader header_{};
+    std::unique_ptr<protocol_v2::RequestBodyParser> parser_;
+    bool begun_ = false;               // Fields handled (job submitted or frame rejected)
+    std::shared_ptr<RequestJob> job_;  // Submitted, images still to come
+    std::shared_ptr<FrameBuffer> image_;
+    std::shared_ptr<FrameBuffer> frame_;
+    size_t filled_ = 0;  // Bytes of image_ / frame_ read so far
+};
+
+} // namespace keep_alive
@@ -0,0 +1,34 @@
+#include "job_frames.hpp"
+
+#include <memory>
+#include <utility>
+
+namespace keep_alive {
+
+using namespace protocol_v2;
+
+protocol_v2::FrameWriter job_response_frame(const RequestJob& job) {
+    if (job.stream) {
+        return stream_end_frame(job.request_id, job.streamed_ok, job.status, job.error_message);
+    }
+    if (!job.item_statuses.empty()) {
+        return item_response_frame(job.request_id, job.status, job.error_message, job.outputs, job.item_statuses,
+                                   job.item_errors);
+    }
+    return response_frame(job.request_id, job.status, job.error_message, job.outputs);
+}
+
+protocol_v2::FrameWriter job_item_frame(RequestJob& job, StreamedItem& item) {
+    protocol_v2::FrameWriter frame =
+        stream_item_frame(job.request_id, item.index, item.status, item.error_message, item.output);
+    if (item.status == ProtocolStatus::Ok) {
+        ++job.streamed_ok;
+        job.streamed_bytes += item.output.size();
+    }
+    // Moving an EncodedImage keeps its bytes where the frame references them.
+    frame.hold(std::make_shared<image_io::EncodedImage>(std::move(item.output)));
+    item.output = {};
+    return frame;
+}
+
+} // namespace keep_alive
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "../protocol_writer.hpp"
+#include "keep_alive_pipeline.hpp"
+
+namespace keep_alive {
+
+/// Final frame of `job`: the response, or the end frame of a streamed
+/// request. It references the job's outputs in place.
+protocol_v2::FrameWriter job_response_frame(const RequestJob& job);
+
+/// Frame of one streamed item of `job`; counts the item in the job and moves
+/// its output into the frame.
+protocol_v2::FrameWriter job_item_frame(RequestJob& job, StreamedItem& item);
+
+} // namespace keep_alive
@@ -0,0 +1,953 @@
+#include "keep_alive_pipeline.hpp"
+
+#include "../utils/content_hash.hpp"
+#include "../utils/logger.hpp"
+#include "../utils/raw_pixels.hpp"
+#include "../utils/tiling_processor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <utility>
+
+namespace keep_alive {
+
+using protocol_v2::ProtocolStatus;
+
+namespace {
+
+constexpr uint32_t kNoFailure = std::numeric_limits<uint32_t>::max();
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point since) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+}
+
+/// One inference thread per image the engine can run at once.
+size_t inference_threads(const ModelRegistry* models) {
+    return models && models->primary() ? std::max<size_t>(1, models->primary()->concurrency()) : 1;
+}
+
+/// Atlas size limit: the region a tiled image hands the engine at once (see
+/// MemoryBudget), without crossing the tiling threshold.
+int atlas_side(const ModelRegistry* models) {
+    if (!models || !models->primary()) {
+        return 0;
+    }
+    const tiling::TilingConfig config = models->primary()->get_tiling_config();
+    const int padded_tile = config.tile_size + 2 * config.overlap;
+    if (!config.enable_tiling) {
+        return padded_tile;
+    }
+    return std::min({padded_tile, config.threshold_width, config.threshold_height});
+}
+
+/// Settings of the engines that change outputs without being part of the
+/// request: tile seams depend on the tile size and overlap, pixels on the
+/// precision the model runs at (the primary's; see finish_inference()).
+std::string engine_namespace(const ModelRegistry* models) {
+    if (!models || !models->primary()) {
+        return {};
+    }
+    const tiling::TilingConfig config = models->primary()->get_tiling_config();
+    return "|tile" + std::to_string(config.tile_size) + "|overlap" + std::to_string(config.overlap) + "|" +
+           models->primary()->precision();
+}
+
+} // namespace
+
+Pipeline::Pipeline(ModelRegistry* models,
+                   std::string output_format,
+                   const PipelineConfig& config,
+                   CompletionHandler on_complete,
+                   ItemHandler on_item)
+    : models_(models),
+      output_format_(std::move(output_format)),
+      on_complete_(std::move(on_complete)),
+      on_item_(std::move(on_item)),
+      decode_queue_(std::max<size_t>(1, config.queue_capacity)),
+      inference_queue_(std::max<size_t>(1, config.queue_capacity)),
+      encode_queue_(std::max<size_t>(1, config.queue_capacity)),
+      done_queue_(std::max<size_t>(1, config.queue_capacity)),
+      max_in_flight_(std::max<size_t>(1, config.max_in_flight)),
+      read_ahead_(config.read_ahead),
+      out_of_order_(config.out_of_order),
+      scheduler_(config.priority_aging),
+      dispatch_window_(std::max<size_t>(1, config.decode_threads) + inference_threads(models)),
+      memory_(config.memory_budget,
+              models && models->primary() ? models->primary()->get_tiling_config() : tiling::TilingConfig{},
+              inference_threads(models)),
+      cache_(config.cache),
+      cache_namespace_(config.cache_namespace + engine_namespace(models)),
+      precision_(models && models->primary() ? models->primary()->precision() : std::string()),
+      default_effort_(config.encoder_effort),
+      encoders_(std::max<size_t>(1, config.encode_threads)),
+      atlas_window_(config.atlas_window),
+      atlas_max_image_(config.atlas_max_image),
+      atlas_side_(atlas_side(models)) {
+    const size_t decoders = std::max<size_t>(1, config.decode_threads);
+    const size_t inferers = inference_threads(models);
+    live_decoders_.store(decoders);
+    live_inferers_.store(inferers);
+    live_encoders_.store(encoders_);
+
+    threads_.reserve(decoders + inferers + encoders_ + 2);
+    threads_.emplace_back(&Pipeline::writer_worker, this);
+    for (size_t i = 0; i < encoders_; ++i) {
+        threads_.emplace_back(&Pipeline::encode_worker, this);
+    }
+    for (size_t i = 0; i < inferers; ++i) {
+        threads_.emplace_back(&Pipeline::inference_worker, this);
+    }
+    for (size_t i = 0; i < decoders; ++i) {
+        threads_.emplace_back(&Pipeline::decode_worker, this);
+    }
+    threads_.emplace_back(&Pipeline::dispatch_worker, this);
+
+    logger::info("Keep-alive pipeline started (decoders=" + std::to_string(decoders) +
+                 ", inference_threads=" + std::to_string(inferers) +
+                 ", encoders=" + std::to_string(encoders_) +
+                 ", queue_capacity=" + std::to_string(decode_queue_.capacity()) +
+                 ", max_in_flight=" + std::to_string(max_in_flight_) +
+                 ", read_ahead=" + std::to_string(read_ahead_) +
+                 ", memory_budget_mb=" + std::to_string(memory_.budget() >> 20) +
+                 (out_of_order_ ? ", out_of_order" : ", in_order") +
+                 (cache_.enabled() ? ", result_cache" : "") +
+                 (atlas_window_.count() > 0 ? ", atlas_window_ms=" + std::to_string(atlas_window_.count()) : "") + ")");
+}
+
+Pipeline::~Pipeline() {
+    shutdown();
+}
+
+void Pipeline::submit(std::shared_ptr<RequestJob> job) {
+    job->sequence = next_sequence_++;
+
+    const uint32_t count = job->has_request ? static_cast<uint32_t>(job->request.images.size()) : 0;
+    if (count == 0) {
+        // Rejected frame or ack: nothing to compute, only keep its slot in the
+        // response order. It never waits for a slot.
+        job->has_request = false;
+        done_queue_.push(DoneEntry{std::move(job), false, {}});
+        return;
+    }
+
+    job->outputs.clear();
+    job->item_statuses.clear();
+    job->item_errors.clear();
+    if (!job->stream) {
+        job->outputs.resize(count);
+        if (job->request.options.item_status) {
+            job->item_statuses.assign(count, ProtocolStatus::Ok);
+            job->item_errors.assign(count, std::string());
+        }
+    }
+    job->next_dispatch = 0;
+    RequestScheduler::estimate_costs(*job);
+    if (cache_.enabled()) {
+        job->cache_prefix = models_->weights_key(job->request) +
+                            "|in" + std::to_string(static_cast<uint32_t>(job->request.options.input)) +
+                            "|out" + std::to_string(static_cast<uint32_t>(job->request.options.output)) +
+                            "|" + output_format_ + cache_namespace_;
+    }
+    job->memory_estimate = memory_.estimate(*job, models_->scale_factor(job->request));
+    if (!memory_.admissible(job->memory_estimate)) {
+        job->status = ProtocolStatus::ResourceLimit;
+        job->error_message = "request needs ~" + std::to_string(job->memory_estimate >> 20) +
+                             " MiB of working memory, over the " + std::to_string(memory_.budget() >> 20) +
+                             " MiB memory budget";
+        logger::warn("Pipeline: request_id=" + std::to_string(job->request_id) + " rejected: " + job->error_message);
+        job->has_request = false;
+        job->outputs.clear();
+        job->item_statuses.clear();
+        job->item_errors.clear();
+        job->request.images.clear();
+        job->request.storage.reset();
+        job->image_storage.clear();
+        done_queue_.push(DoneEntry{std::move(job), false, {}});
+        return;
+    }
+    job->received = job->receiving ? 0 : count;
+    job->remaining.store(count, std::memory_order_relaxed);
+    job->pending_decode.store(count, std::memory_order_relaxed);
+    job->pending_inference.store(count, std::memory_order_relaxed);
+    {
+        std::unique_lock<std::mutex> lock(dispatch_mutex_);
+        intake_cv_.wait(lock, [this]() { return read_ahead_ == 0 || waiting_jobs_.size() < read_ahead_; });
+        waiting_jobs_.push_back(std::move(job));
+    }
+    dispatch_cv_.notify_one();
+}
+
+void Pipeline::image_received(const std::shared_ptr<RequestJob>& job, uint32_t index) {
+    // Not dispatched before `received` covers it, so its estimate is still in
+    // undispatched_cost.
+    const uint64_t cost = RequestScheduler::image_cost(job->request.options, job->request.images[index]);
+    {
+        std::lock_guard<std::mutex> lock(dispatch_mutex_);
+        job->undispatched_cost = job->undispatched_cost - job->image_costs[index] + cost;
+        job->image_costs[index] = cost;
+        job->received = index + 1;
+    }
+    dispatch_cv_.notify_one();
+}
+
+void Pipeline::abort_receiving(const std::shared_ptr<RequestJob>& job,
+                               ProtocolStatus status,
+                               const std::string& message) {
+    logger::error("Pipeline: request_id=" + std::to_string(job->request_id) + " " + message);
+    {
+        std::lock_guard<std::mutex> lock(job->failure_mutex);
+        job->abort_status = status;
+        job->abort_message = message;
+    }
+    job->failed.store(true, std::memory_order_release);
+    // The missing images go through the stages like the others, as empty
+    // views: the job is failed, so every stage skips them.
+    {
+        std::lock_guard<std::mutex> lock(dispatch_mutex_);
+        job->received = job->request.batch_count;
+    }
+    dispatch_cv_.notify_one();
+}
+
+size_t Pipeline::in_flight() const {
+    std::lock_guard<std::mutex> lock(dispatch_mutex_);
+    return in_flight_;
+}
+
+PipelineSnapshot Pipeline::snapshot() const {
+    PipelineSnapshot snapshot;
+    {
+        std::lock_guard<std::mutex> lock(dispatch_mutex_);
+        snapshot.waiting_requests = waiting_jobs_.size();
+        snapshot.in_flight_requests = in_flight_;
+        snapshot.memory_budget = memory_.budget();
+        snapshot.memory_reserved = memory_.reserved();
+    }
+    snapshot.decode_queue = decode_queue_.size();
+    snapshot.inference_queue = inference_queue_.size();
+    snapshot.encode_queue = encode_queue_.size();
+    snapshot.done_queue = done_queue_.size();
+    snapshot.result_cache_bytes = cache_.memory_bytes();
+    snapshot.atlas_runs = atlas_runs_.load(std::memory_order_relaxed);
+    snapshot.atlas_images = atlas_images_.load(std::memory_order_relaxed);
+    snapshot.decode = decode_latency_.snapshot();
+    snapshot.inference = inference_latency_.snapshot();
+    snapshot.encode = encode_latency_.snapshot();
+    return snapshot;
+}
+
+void Pipeline::shutdown() {
+    if (stopped_) {
+        return;
+    }
+    stopped_ = true;
+
+    // Closing intake cascades: the dispatcher closes the decode queue once every
+    // image is handed out, and each stage closes its output queue once its last
+    // worker has drained its input.
+    {
+        std::lock_guard<std::mutex> lock(dispatch_mutex_);
+        intake_closed_ = true;
+    }
+    dispatch_cv_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+}
+
+void Pipeline::dispatch_worker() {
+    while (true) {
+        DecodeItem item;
+        {
+            std::unique_lock<std::mutex> lock(dispatch_mutex_);
+            // Next waiting job to admit, or end() when none may be admitted now.
+            const auto admissible_next = [this]() {
+                if (waiting_jobs_.empty() || in_flight_ >= max_in_flight_) {
+                    return waiting_jobs_.end();
+                }
+                auto next = scheduler_.pick(waiting_jobs_, std::chrono::steady_clock::now());
+                return in_flight_ == 0 || memory_.fits((*next)->memory_estimate) ? next : waiting_jobs_.end();
+            };
+            const auto can_admit = [&]() { return admissible_next() != waiting_jobs_.end(); };
+            const auto can_dispatch = [this]() {
+                return dispatched_ahead_ < dispatch_window_ &&
+                       (!retry_items_.empty() ||
+                        scheduler_.pick_ready(dispatch_jobs_, std::chrono::steady_clock::now()) != dispatch_jobs_.end());
+            };
+            // Admitted jobs may still send images back through retry_items_.
+            const auto drained = [this]() {
+                return intake_closed_ && waiting_jobs_.empty() && dispatch_jobs_.empty() && in_flight_ == 0;
+            };
+            dispatch_cv_.wait(lock, [&]() { return can_dispatch() || can_admit() || drained(); });
+            bool admitted = false;
+            for (auto next = admissible_next(); next != waiting_jobs_.end(); next = admissible_next()) {
+                memory_.reserve((*next)->memory_estimate);
+                dispatch_jobs_.push_back(std::move(*next));
+                waiting_jobs_.erase(next);
+                ++in_flight_;
+                admitted = true;
+            }
+            if (admitted) {
+                intake_cv_.notify_one();
+            }
+            if (!can_dispatch()) {
+                if (drained()) {
+                    break;
+                }
+                continue;
+            }
+            ++dispatched_ahead_;
+            if (!retry_items_.empty()) {
+                item = std::move(retry_items_.front());
+                retry_items_.pop_front();
+            } else {
+                auto next = scheduler_.pick_ready(dispatch_jobs_, std::chrono::steady_clock::now());
+                RequestJob& job = **next;
+                item.job = *next;
+                item.index = job.next_dispatch++;
+                job.undispatched_cost -= job.image_costs[item.index];
+                if (job.next_dispatch == job.request.batch_count) {
+                    dispatch_jobs_.erase(next);
+                }
+            }
+        }
+        decode_queue_.push(std::move(item));
+    }
+
+    decode_queue_.close();
+}
+
+void Pipeline::decode_worker() {
+    DecodeItem item;
+    while (decode_queue_.pop(item)) {
+        const auto& job = item.job;
+        if (should_skip(*job)) {
+            release_dispatch_slot();
+            finish_decode(job);
+            job->pending_inference.fetch_sub(1, std::memory_order_acq_rel);
+            finish_item(job);
+            continue;
+        }
+
+        // Lossy WebP output differs between effort levels, so the effort is
+        // fixed here and keys the cached result.
+        const bool compressed = job->request.options.output == protocol_v2::OutputEncoding::Compressed;
+        const image_io::EncodeEffort effort = compressed ? encode_effort(*job) : image_io::EncodeEffort::Balanced;
+        std::string cache_key;
+        if (cache_.enabled()) {
+            const protocol_v2::ImageView image = job->request.images[item.index];
+            cache_key = result_cache_key(content_hash::hash128(image.data, image.size).hex(), job->cache_prefix,
+                                         compressed, effort);
+            if (claim_result(item, cache_key)) {
+                continue;
+            }
+        }
+
+        PixelItem decoded{job, item.index, {}, std::move(cache_key), effort};
+        bool ok = false;
+        const auto decode_start = std::chrono::steady_clock::now();
+        try {
+            // Decode straight from the view into the request's frame buffer.
+            const protocol_v2::ImageView image = job->request.images[item.index];
+            if (job->request.options.input == protocol_v2::InputEncoding::RawPixels) {
+                std::string error;
+                ok = raw_pixels::decode(image.data, image.size, decoded.pixels, error);
+                if (!ok) {
+                    logger::error("Pipeline raw pixel decode: " + error);
+                }
+            } else {
+                ok = image_io::decode_image(image.data, image.size, decoded.pixels);
+            }
+        } catch (const std::exception& e) {
+            logger::error("Pipeline decode exception: " + std::string(e.what()));
+        }
+        decode_latency_.record(elapsed_ns(decode_start));
+        if (!job->image_storage.empty()) {
+            job->image_storage[item.index].reset();
+        }
+        finish_decode(job);
+
+        if (!ok) {
+            release_dispatch_slot();
+            job->pending_inference.fetch_sub(1, std::memory_order_acq_rel);
+            abandon_flight(decoded.cache_key, "decode failed");
+            fail_item(job, item.index, "decode failed");
+            continue;
+        }
+        inference_queue_.push(std::move(decoded));
+    }
+
+    if (live_decoders_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        inference_queue_.close();
+    }
+}
+
+void Pipeline::inference_worker() {
+    PixelItem item;
+    bool have = inference_queue_.pop(item);
+    while (have) {
+        release_dispatch_slot();
+        std::vector<PixelItem> group;
+        std::vector<atlas::Placement> placements;
+        int atlas_width = 0;
+        int atlas_height = 0;
+        group.push_back(std::move(item));
+        // A popped image that cannot join the atlas is processed next.
+        have = gather_atlas(group, placements, atlas_width, atlas_height, item);
+        if (group.size() > 1) {
+            infer_atlas(group, placements, atlas_width, atlas_height);
+        } else {
+            infer_image(group.front());
+        }
+        if (!have) {
+            have = inference_queue_.pop(item);
+        }
+    }
+
+    if (live_inferers_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        encode_queue_.close();
+    }
+}
+
+void Pipeline::infer_image(PixelItem& item) {
+    const auto& job = item.job;
+    bool ok = false;
+    bool skip = should_skip(*job);
+    std::shared_ptr<BaseEngine> engine;
+    std::string failure = "inference failed";
+    if (!skip) {
+        engine = models_->acquire(job->request, failure);
+    }
+    if (engine) {
+        const auto inference_start = std::chrono::steady_clock::now();
+        try {
+            image_io::ImagePixels upscaled;
+            ok = tiling::upscale_pixels(engine.get(), item.pixels, upscaled, &job->cancel);
+            // Replacing the decoded source frees it before the item waits for an encoder.
+            item.pixels = std::move(upscaled);
+        } catch (const std::exception& e) {
+            logger::error("Pipeline inference exception: " + std::string(e.what()));
+        }
+        inference_latency_.record(elapsed_ns(inference_start));
+        // Stopped between tiles: not an engine failure.
+        skip = !ok && should_skip(*job);
+    }
+    finish_inference(item, engine.get(), ok, skip, failure);
+}
+
+bool Pipeline::atlas_candidate(const PixelItem& item) const {
+    const image_io::ImagePixels& pixels = item.pixels;
+    return pixels.width <= atlas_max_image_ && pixels.height <= atlas_max_image_ &&
+           pixels.width + 2 * atlas::kGutter <= atlas_side_ && pixels.height + 2 * atlas::kGutter <= atlas_side_ &&
+           !should_skip(*item.job);
+}
+
+bool Pipeline::images_upstream() const {
+    std::lock_guard<std::mutex> lock(dispatch_mutex_);
+    return dispatched_ahead_ > 0 || !dispatch_jobs_.empty() || !retry_items_.empty();
+}
+
+bool Pipeline::gather_atlas(std::vector<PixelItem>& group,
+                            std::vector<atlas::Placement>& placements,
+                            int& width,
+                            int& height,
+                            PixelItem& next) {
+    if (atlas_window_.count() <= 0 || !atlas_candidate(group.front())) {
+        return false;
+    }
+    atlas::Packer packer(atlas_side_);
+    atlas::Placement placement;
+    packer.add(group.front().pixels.width, group.front().pixels.height, placement);
+    placements.push_back(placement);
+
+    const std::string model = models_->model_key(group.front().job->request);
+    const auto deadline = std::chrono::steady_clock::now() + atlas_window_;
+    bool carried = false;
+    // Only wait while more images may come: a lone image is not held back.
+    while ((images_upstream() || !inference_queue_.is_empty()) && inference_queue_.pop_until(next, deadline)) {
+        if (!atlas_candidate(next) || models_->model_key(next.job->request) != model ||
+            !packer.add(next.pixels.width, next.pixels.height, placement)) {
+            carried = true;
+            break;
+        }
+        release_dispatch_slot();
+        group.push_back(std::move(next));
+        placements.push_back(placement);
+    }
+    width = packer.width();
+    height = packer.height();
+    return carried;
+}
+
+void Pipeline::infer_atlas(std::vector<PixelItem>& group,
+                           const std::vector<atlas::Placement>& placements,
+                           int width,
+                           int height) {
+    std::string failure = "inference failed";
+    const std::shared_ptr<BaseEngine> engine = models_->acquire(group.front().job->request, failure);
+    if (!engine) {
+        for (auto& item : group) {
+            finish_inference(item, nullptr, false, should_skip(*item.job), failure);
+        }
+        return;
+    }
+
+    const auto inference_start = std::chrono::steady_clock::now();
+    bool ok = false;
+    image_io::ImagePixels upscaled;
+    try {
+        std::vector<const image_io::ImagePixels*> images;
+        images.reserve(group.size());
+        for (const auto& item : group) {
+            images.push_back(&item.pixels);
+        }
+        image_io::ImagePixels sheet;
+        atlas::compose(images, placements, width, height, sheet);
+        ok = engine->process_rgb(sheet.pixels.data(), sheet.width, sheet.height,
+                                 upscaled.pixels, upscaled.width, upscaled.height);
+        upscaled.channels = 3;
+    } catch (const std::exception& e) {
+        logger::error("Pipeline atlas exception: " + std::string(e.what()));
+    }
+    if (!ok) {
+        // Not the images' fault: give each one its own chance.
+        logger::warn("Pipeline: atlas of " + std::to_string(group.size()) + " images failed, processing them one by one");
+        for (auto& item : group) {
+            infer_image(item);
+        }
+        return;
+    }
+    const uint64_t per_image_ns = elapsed_ns(inference_start) / group.size();
+    atlas_runs_.fetch_add(1, std::memory_order_relaxed);
+    atlas_images_.fetch_add(group.size(), std::memory_order_relaxed);
+    logger::info("Pipeline: atlas of " + std::to_string(group.size()) + " images (" + std::to_string(width) + "x" +
+                 std::to_string(height) + ")");
+
+    const int scale = engine->get_scale_factor();
+    for (size_t i = 0; i < group.size(); ++i) {
+        PixelItem& item = group[i];
+        inference_latency_.record(per_image_ns);
+        image_io::ImagePixels output;
+        const bool sliced = atlas::slice(upscaled, placements[i], scale, output);
+        item.pixels = std::move(output);
+        finish_inference(item, engine.get(), sliced, !sliced && should_skip(*item.job), failure);
+    }
+}
+
+void Pipeline::finish_inference(PixelItem& item, BaseEngine* engine, bool ok, bool skip, const std::string& failure) {
+    auto job = item.job;
+    // Clear allocator free-pools once a request has no more images to infer, to
+    // prevent GPU memory fragmentation from accumulating across requests.
+    if (job->pending_inference.fetch_sub(1, std::memory_order_acq_rel) == 1 && engine) {
+        engine->clear_allocators();
+    }
+
+    if (ok && engine && !item.cache_key.empty() && engine->precision() != precision_) {
+        // Ran at another precision than the key says (CPU fallback, or a
+        // variant without the GPU): computed, but neither cached nor shared.
+        abandon_flight(item.cache_key, {});
+        item.cache_key.clear();
+    }
+    if (ok) {
+        encode_queue_.push(std::move(item));
+    } else if (skip) {
+        abandon_flight(item.cache_key, {});
+        finish_item(job);
+    } else {
+        abandon_flight(item.cache_key, failure);
+        fail_item(job, item.index, failure);
+    }
+}
+
+void Pipeline::encode_worker() {
+    PixelItem item;
+    while (encode_queue_.pop(item)) {
+        const auto& job = item.job;
+        if (should_skip(*job)) {
+            abandon_flight(item.cache_key, {});
+            finish_item(job);
+            continue;
+        }
+
+        bool ok = false;
+        image_io::EncodedImage output;
+        const auto encode_start = std::chrono::steady_clock::now();
+        try {
+            switch (job->request.options.output) {
+                case protocol_v2::OutputEncoding::Compressed: {
+                    ok = image_io::encode_image(item.pixels, output_format_, output, item.effort);
+                    const auto slot = static_cast<size_t>(item.effort);
+                    job->encoded[slot].fetch_add(1, std::memory_order_relaxed);
+                    job->encoded_bytes[slot].fetch_add(output.size(), std::memory_order_relaxed);
+                    job->encode_ns[slot].fetch_add(elapsed_ns(encode_start), std::memory_order_relaxed);
+                    break;
+                }
+                case protocol_v2::OutputEncoding::RawPixels:
+                    ok = raw_pixels::encode(item.pixels, raw_pixels::Compression::None, output);
+                    break;
+                case protocol_v2::OutputEncoding::RawPixelsLz4:
+                    ok = raw_pixels::encode(item.pixels, raw_pixels::Compression::Lz4, output);
+                    break;
+            }
+        } catch (const std::exception& e) {
+            logger::error("Pipeline encode exception: " + std::string(e.what()));
+        }
+        encode_latency_.record(elapsed_ns(encode_start));
+        item.pixels = {};
+
+        if (!ok) {
+            abandon_flight(item.cache_key, "encode failed");
+            fail_item(job, item.index, "encode failed");
+            continue;
+        }
+        if (!item.cache_key.empty()) {
+            auto result = std::make_shared<const std::vector<uint8_t>>(output.data(), output.data() + output.size());
+            complete_flight(item.cache_key, result);
+        }
+        deliver_output(job, item.index, std::move(output));
+    }
+
+    if (live_encoders_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        done_queue_.close();
+    }
+}
+
+void Pipeline::writer_worker() {
+    auto deliver = [this](RequestJob& job) {
+        if (job.stats) {
+            job.pipeline_snapshot = std::make_shared<const PipelineSnapshot>(snapshot());
+        }
+        try {
+            on_complete_(job);
+        } catch (const std::exception& e) {
+            logger::error("Pipeline writer exception: " + std::string(e.what()));
+        }
+        if (job.has_request) {
+            {
+                std::lock_guard<std::mutex> lock(dispatch_mutex_);
+                --in_flight_;
+                memory_.release(job.memory_estimate);
+            }
+            dispatch_cv_.notify_one();
+        }
+    };
+
+    // In frame-order mode, jobs that complete early (e.g. a failed decode or a
+    // small request overtaking a batch) are parked until every earlier frame
+    // has been answered.
+    std::map<uint64_t, std::shared_ptr<RequestJob>> ready;
+    uint64_t next = 0;
+
+    DoneEntry entry;
+    while (done_queue_.pop(entry)) {
+        if (entry.has_item) {
+            // Streamed items carry their own request_id/index: no ordering needed.
+            if (on_item_) {
+                try {
+                    on_item_(*entry.job, entry.item);
+                } catch (const std::exception& e) {
+                    logger::error("Pipeline writer exception: " + std::string(e.what()));
+                }
+            }
+            entry = {};
+            continue;
+        }
+
+        std::shared_ptr<RequestJob> job = std::move(entry.job);
+        if (out_of_order_) {
+            deliver(*job);
+            job.reset();
+            continue;
+        }
+
+        const uint64_t sequence = job->sequence;
+        ready.emplace(sequence, std::move(job));
+        for (auto it = ready.begin(); it != ready.end() && it->first == next; it = ready.erase(it)) {
+            deliver(*it->second);
+            ++next;
+        }
+    }
+}
+
+bool Pipeline::copy_to_region(const shm::Region& region, image_io::EncodedImage& output, std::string& reason) {
+    if (output.size() > region.length) {
+        reason = "output of " + std::to_string(output.size()) + " bytes exceeds the " +
+                 std::to_string(region.length) + "-byte shared memory region";
+        return false;
+    }
+    std::memcpy(region.data(), output.data(), output.size());
+
+    std::vector<uint8_t> descriptor(protocol_v2::kShmOutputDescriptorSize);
+    protocol_v2::encode_u32_le(descriptor.data(), region.buffer_id);
+    protocol_v2::encode_u64_le(descriptor.data() + 4, region.offset);
+    protocol_v2::encode_u64_le(descriptor.data() + 12, output.size());
+    output = image_io::EncodedImage(std::move(descriptor));
+    return true;
+}
+
+void Pipeline::release_dispatch_slot() {
+    {
+        std::lock_guard<std::mutex> lock(dispatch_mutex_);
+        --dispatched_ahead_;
+    }
+    dispatch_cv_.notify_one();
+}
+
+void Pipeline::deliver_output(const std::shared_ptr<RequestJob>& job, uint32_t index, image_io::EncodedImage output) {
+    if (!job->output_regions.empty()) {
+        std::string reason;
+        if (!copy_to_region(job->output_regions[index], output, reason)) {
+            fail_item(job, index, reason);
+            return;
+        }
+    }
+    if (job->stream) {
+        DoneEntry entry{job, true, {}};
+        entry.item.index = index;
+        entry.item.output = std::move(output);
+        done_queue_.push(std::move(entry));
+    } else {
+        job->outputs[index] = std::move(output);
+    }
+    finish_item(job);
+}
+
+void Pipeline::bypass_stages(const std::shared_ptr<RequestJob>& job) {
+    finish_decode(job);
+    job->pending_inference.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool Pipeline::claim_result(const DecodeItem& item, const std::string& key) {
+    // Joining or leading is decided under the lock; the cache lookup happens
+    // after, as the leader. A leader stores its result before ending its flight,
+    // so an image that finds no flight either finds the result or computes it.
+    bool leader = false;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex_);
+        auto flight = flights_.try_emplace(key);
+        leader = flight.second;
+        if (!leader) {
+            flight.first->second.push_back(item);
+        }
+    }
+    if (!leader) {
+        release_dispatch_slot();
+        return true;
+    }
+
+    ResultCache::Payload cached = cache_.get(key);
+    if (!cached) {
+        item.job->cache_misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    release_dispatch_slot();
+    complete_flight(key, cached);
+    bypass_stages(item.job);
+    item.job->cache_hits.fetch_add(1, std::memory_order_relaxed);
+    deliver_output(item.job, item.index, image_io::EncodedImage(std::vector<uint8_t>(*cached)));
+    return true;
+}
+
+void Pipeline::complete_flight(const std::string& key, const ResultCache::Payload& result) {
+    cache_.put(key, result);
+    std::vector<DecodeItem> parked;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex_);
+        auto flight = flights_.find(key);
+        if (flight == flights_.end()) {
+            return;
+        }
+        parked = std::move(flight->second);
+        flights_.erase(flight);
+    }
+    for (auto& waiter : parked) {
+        bypass_stages(waiter.job);
+        if (should_skip(*waiter.job)) {
+            finish_item(waiter.job);
+            continue;
+        }
+        waiter.job->cache_shared.fetch_add(1, std::memory_order_relaxed);
+        deliver_output(waiter.job, waiter.index, image_io::EncodedImage(std::vector<uint8_t>(*result)));
+    }
+}
+
+void Pipeline::abandon_flight(const std::string& key, const std::string& reason) {
+    if (key.empty()) {
+        return;
+    }
+    std::vector<DecodeItem> parked;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex_);
+        auto flight = flights_.find(key);
+        if (flight == flights_.end()) {
+            return;
+        }
+        parked = std::move(flight->second);
+        flights_.erase(flight);
+    }
+    if (parked.empty()) {
+        return;
+    }
+    if (!reason.empty()) {
+        for (auto& waiter : parked) {
+            bypass_stages(waiter.job);
+            fail_item(waiter.job, waiter.index, reason);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(dispatch_mutex_);
+        for (auto& waiter : parked) {
+            retry_items_.push_back(std::move(waiter));
+        }
+    }
+    dispatch_cv_.notify_one();
+}
+
+bool Pipeline::should_skip(RequestJob& job) {
+    if (job.failed.load(std::memory_order_acquire)) {
+        return true;
+    }
+    if (!job.cancel.stop_requested()) {
+        return false;
+    }
+    job.failed.store(true, std::memory_order_release);
+    return true;
+}
+
+image_io::EncodeEffort Pipeline::encode_effort(const RequestJob& job) {
+    // Auto: a request in its last quarter before the deadline encodes fast,
+    // whatever the load.
+    const bool near_deadline =
+        job.cancel.has_deadline() &&
+        job.cancel.time_left() < std::chrono::milliseconds(job.request.options.deadline_ms) / 4;
+    EncoderLoad load;
+    load.encoders = encoders_;
+    load.encode_backlog = encode_queue_.size();
+    {
+        std::lock_guard<std::mutex> lock(dispatch_mutex_);
+        load.waiting_jobs = waiting_jobs_.size();
+        load.in_flight = in_flight_;
+    }
+    return choose_effort(job.request.options.effort, default_effort_, near_deadline, load, auto_effort_);
+}
+
+void Pipeline::finish_decode(const std::shared_ptr<RequestJob>& job) {
+    if (job->pending_decode.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        // Every decoder is done with the views; recycle the frame buffer now rather
+        // than holding it until the response is written.
+        job->request.images.clear();
+        job->request.storage.reset();
+        job->image_storage.clear();
+    }
+}
+
+void Pipeline::fail_item(const std::shared_ptr<RequestJob>& job, uint32_t index, const std::string& reason) {
+    logger::error("Pipeline: " + reason + " for request_id=" + std::to_string(job->request_id) +
+                  " image index=" + std::to_string(index));
+
+    {
+        std::lock_guard<std::mutex> lock(job->failure_mutex);
+        if (index < job->failed_index.load(std::memory_order_relaxed)) {
+            job->failed_index.store(index, std::memory_order_relaxed);
+            job->failure_reason = reason;
+        }
+        if (!job->item_statuses.empty()) {
+            job->item_statuses[index] = ProtocolStatus::EngineError;
+            job->item_errors[index] = reason;
+        }
+    }
+    if (!job->request.options.item_status) {
+        job->failed.store(true, std::memory_order_release);
+    }
+
+    if (job->stream) {
+        DoneEntry entry{job, true, {}};
+        entry.item.index = index;
+        entry.item.status = ProtocolStatus::EngineError;
+        entry.item.error_message = reason;
+        done_queue_.push(std::move(entry));
+    }
+    finish_item(job);
+}
+
+void Pipeline::finish_item(const std::shared_ptr<RequestJob>& job) {
+    if (job->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    // Without per-item status, any image failure also sets `failed`.
+    const bool image_failed = job->failed_index.load(std::memory_order_relaxed) != kNoFailure;
+    if (image_failed || job->failed.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> abort_lock(job->failure_mutex);
+        if (job->abort_status != ProtocolStatus::Ok) {
+            // The frame itself was bad: that is the answer, whatever else failed.
+            job->status = job->abort_status;
+            job->error_message = job->abort_message;
+            job->outputs.clear();
+            job->item_statuses.clear();
+            job->item_errors.clear();
+            abort_lock.unlock();
+            done_queue_.push(DoneEntry{job, false, {}});
+            return;
+        }
+        abort_lock.unlock();
+        // A recorded image failure wins over a stop that came after it.
+        switch (image_failed ? CancelToken::Reason::None : job->cancel.stop_reason()) {
+            case CancelToken::Reason::Cancelled:
+                job->status = ProtocolStatus::Cancelled;
+                job->error_message = "request cancelled";
+                break;
+            case CancelToken::Reason::DeadlineExpired:
+                job->status = ProtocolStatus::Timeout;
+                job->error_message = "deadline exceeded";
+                break;
+            case CancelToken::Reason::None: {
+                const uint32_t index = job->failed_index.load(std::memory_order_relaxed);
+                job->status = ProtocolStatus::EngineError;
+                std::lock_guard<std::mutex> lock(job->failure_mutex);
+                job->error_message =
+                    "engine processing failed at index " + std::to_string(index) + ": " + job->failure_reason;
+                break;
+            }
+        }
+        if (job->item_statuses.empty()) {
+            job->outputs.clear();
+        } else {
+            settle_skipped_items(*job);
+        }
+    }
+    done_queue_.push(DoneEntry{job, false, {}});
+}
+
+void Pipeline::settle_skipped_items(RequestJob& job) {
+    ProtocolStatus status = ProtocolStatus::EngineError;
+    std::string message = "image skipped";
+    switch (job.cancel.stop_reason()) {
+        case CancelToken::Reason::Cancelled:
+            status = ProtocolStatus::Cancelled;
+            message = "request cancelled";
+            break;
+        case CancelToken::Reason::DeadlineExpired:
+            status = ProtocolStatus::Timeout;
+            message = "deadline exceeded";
+            break;
+        case CancelToken::Reason::None:
+            break;
+    }
+    std::lock_guard<std::mutex> lock(job.failure_mutex);
+    for (size_t i = 0; i < job.item_statuses.size(); ++i) {
+        if (job.item_statuses[i] == ProtocolStatus::Ok && job.outputs[i].empty()) {
+            job.item_statuses[i] = status;
+            job.item_errors[i] = message;
+        }
+    }
+}
+
+} // namespace keep_alive
@@ -0,0 +1,406 @@
+#pragma once
+
+#include "../model_registry.hpp"
+#include "../protocol_v2.hpp"
+#include "../utils/atlas.hpp"
+#include "../utils/blocking_queue.hpp"
+#include "../utils/cancel_token.hpp"
+#include "../utils/image_io.hpp"
+#include "../utils/latency_histogram.hpp"
+#include "../utils/result_cache.hpp"
+#include "../utils/shm_buffers.hpp"
+#include "encoder_effort.hpp"
+#include "memory_budget.hpp"
+#include "request_scheduler.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace keep_alive {
+
+/// Stage sizing for the keep-alive pipeline (see Options::decode_threads & co).
+struct PipelineConfig {
+    size_t decode_threads = 2;
+    size_t encode_threads = 2;
+    size_t queue_capacity = 4;  // Max images waiting in front of each stage
+    size_t max_in_flight = 4;   // Max requests being processed (not yet answered)
+    size_t read_ahead = 1;      // Requests that may wait for a slot before submit() blocks; 0 = never blocks
+    bool out_of_order = false;  // Write responses as they complete instead of in frame order
+    std::chrono::milliseconds priority_aging{2000};  // Queue wait that promotes a request one priority class
+    uint64_t memory_budget = 0;   // Bytes of estimated working set admitted at once (MemoryBudget); 0 = no limit
+    ResultCacheConfig cache;      // Result cache tiers (disabled by default)
+    std::string cache_namespace;  // Mixed into cache keys: settings outside the request and the engines that change outputs
+    /// Effort of requests that leave it to the process (EncoderEffort::Default).
+    protocol_v2::EncoderEffort encoder_effort = protocol_v2::EncoderEffort::Balanced;
+    /// How long inference waits for more small images to pack into one atlas
+    /// with the image in hand (0 = no atlas packing).
+    std::chrono::milliseconds atlas_window{0};
+    int atlas_max_image = 256;  // Largest width / height of an image packed into an atlas
+};
+
+/// Live pipeline state, for Stats frames.
+struct PipelineSnapshot {
+    size_t waiting_requests = 0;  // Submitted, waiting for an in-flight slot
+    size_t in_flight_requests = 0;
+    // Images waiting in front of each stage, and answers waiting for the writer.
+    size_t decode_queue = 0;
+    size_t inference_queue = 0;
+    size_t encode_queue = 0;
+    size_t done_queue = 0;
+    size_t result_cache_bytes = 0;  // In-memory result cache tier
+    uint64_t memory_budget = 0;     // MemoryBudget limit (0 = none)
+    uint64_t memory_reserved = 0;   // Estimated working set of admitted requests
+    uint64_t atlas_runs = 0;        // Engine calls that upscaled an atlas
+    uint64_t atlas_images = 0;      // Images upscaled as part of an atlas
+    // Per-image time spent in each stage.
+    LatencyHistogram::Snapshot decode;
+    LatencyHistogram::Snapshot inference;
+    LatencyHistogram::Snapshot encode;
+};
+
+/// One protocol frame travelling through the pipeline.
+///
+/// The frame reader fills the request fields and submits it. Frames rejected
+/// before any work (bad header, bad payload) are submitted with a non-Ok status
+/// and no request; they still go through the writer so responses keep the
+/// original frame order. Large frames may be submitted as soon as their fields
+/// are parsed, with `receiving` set: their images follow through
+/// Pipeline::image_received().
+struct RequestJob {
+    uint32_t request_id = 0;
+    protocol_v2::ProtocolStatus status = protocol_v2::ProtocolStatus::Ok;
+    std::string error_message;
+    bool has_request = false;
+    bool stream = false;  // StreamRequest: items are handed out one by one, `outputs` stays empty
+    bool stats = false;   // Stats frame: the writer takes `pipeline_snapshot` right before answering
+    std::shared_ptr<const PipelineSnapshot> pipeline_snapshot;
+    protocol_v2::RequestPayload request{};
+    std::vector<image_io::EncodedImage> outputs;  // One slot per input image, filled by encoders
+    /// Per-item response (ItemStatus option, not streamed): status and error of
+    /// each image, set as images fail; empty for every other job.
+    std::vector<protocol_v2::ProtocolStatus> item_statuses;
+    std::vector<std::string> item_errors;
+    /// Transport::SharedMemory: where each output goes. Encoders copy the output
+    /// there and replace it with a kShmOutputDescriptorSize descriptor.
+    std::vector<shm::Region> output_regions;
+    size_t bytes_in = 0;
+    uint32_t streamed_ok = 0;  // Stream items written with status Ok (writer thread only)
+    size_t streamed_bytes = 0;  // Output bytes of those items (writer thread only)
+    std::chrono::steady_clock::time_point start{};
+    /// Cancel message or deadline option; checked between images and tiles.
+    CancelToken cancel;
+    /// Front-end state the handlers need to answer the job (socket mode: the
+    /// client connection). Never touched by the pipeline.
+    std::shared_ptr<void> context;
+    /// Submitted before its images were read: `request.images` has one empty
+    /// slot per image, filled (with `image_storage`) as each one arrives.
+    bool receiving = false;
+    uint64_t unreceived_bytes = 0;  // Body bytes still to come when submitted `receiving`, for estimates
+    /// Per-image buffers of a `receiving` job (request.storage stays unset);
+    /// each is dropped once its image is decoded.
+    std::vector<std::shared_ptr<const void>> image_storage;
+
+    // ---- Pipeline bookkeeping (owned by Pipeline) ----
+    uint64_t sequence = 0;
+    uint32_t next_dispatch = 0;                  // Next image index to hand to the decoders
+    uint32_t received = 0;                       // Images whose bytes are in (all unless `receiving`)
+    std::vector<uint64_t> image_costs;           // Estimated pixels per image (RequestScheduler)
+    uint64_t undispatched_cost = 0;              // Sum of image_costs from next_dispatch on
+    std::string cache_prefix;                    // Result cache key suffix: model and encodings
+    uint64_t memory_estimate = 0;                // Reserved in the MemoryBudget while admitted
+    std::atomic<uint32_t> remaining{0};          // Images not yet finished (any stage)
+    std::atomic<uint32_t> pending_decode{0};     // Images not yet past the decode stage
+    std::atomic<uint32_t> pending_inference{0};  // Images not yet past the inference stage
+    std::atomic<bool> failed{false};
+    std::atomic<uint32_t> failed_index{std::numeric_limits<uint32_t>::max()};
+    std::mutex failure_mutex;    // Guards the failure and abort fields below, and item_statuses / item_errors
+    std::string failure_reason;  // Why image `failed_index` failed
+    protocol_v2::ProtocolStatus abort_status = protocol_v2::ProtocolStatus::Ok;  // Pipeline::abort_receiving()
+    std::string abort_message;
+    // Result cache outcomes per image, for --profiling.
+    std::atomic<uint32_t> cache_hits{0};    // Served from the cache
+    std::atomic<uint32_t> cache_shared{0};  // Served by an identical image computed concurrently
+    std::atomic<uint32_t> cache_misses{0};  // Computed
+    // Compressed outputs per image_io::EncodeEffort, for --profiling and Stats.
+    std::array<std::atomic<uint32_t>, image_io::kEncodeEffortCount> encoded{};
+    std::array<std::atomic<uint64_t>, image_io::kEncodeEffortCount> encoded_bytes{};
+    std::array<std::atomic<uint64_t>, image_io::kEncodeEffortCount> encode_ns{};
+};
+
+/// One image of a streaming request, delivered as soon as it is encoded (or
+/// has failed), independently of the request's completion.
+struct StreamedItem {
+    uint32_t index = 0;
+    protocol_v2::ProtocolStatus status = protocol_v2::ProtocolStatus::Ok;
+    std::string error_message;
+    image_io::EncodedImage output;
+};
+
+/// Three-stage decode → infer → encode pipeline for the keep-alive protocol.
+///
+///   submit() ─▶ dispatcher ─▶ [decode queue] ─▶ N decoders ─▶ [inference queue]
+///          ─▶ K inference threads ─▶ [encode queue] ─▶ M encoders ─▶ [done queue] ─▶ writer
+///
+/// Only the inference threads touch the engine: one per image the engine can
+/// run at once (BaseEngine::concurrency(), `--engine-instances`), so engines
+/// that report 1 keep their single-threaded contract. Each thread takes the
+/// next image from the inference queue, which spreads images over the free
+/// engine instances, while codec work for neighbouring images overlaps with
+/// inference. Every stage queue is a BoundedBlockingQueue.
+///
+/// Intake is decoupled from the stages: up to `max_in_flight` requests are
+/// processed at once, as long as their estimated working sets fit the
+/// MemoryBudget, and `read_ahead` more may wait for a slot; only then does
+/// submit() block (never with `read_ahead` 0: the caller bounds its own intake). Requests that could never fit are answered with
+/// ResourceLimit right away. Frames without work (rejections, acks) never wait, so the
+/// reader still sees a Cancel sent behind a waiting request. Both admission
+/// and the dispatcher, which feeds the decode queue one image at a time, ask
+/// the RequestScheduler which request goes next: interactive before prefetch,
+/// then the least work left, so a single-image request is not stuck behind
+/// every image of a large batch. The dispatcher only runs `decode_threads` plus
+/// one per inference thread images ahead of inference, so that choice is made as late as possible
+/// instead of being frozen in the stage queues. The writer either restores
+/// frame order or, with `out_of_order`, answers each request as soon as it is
+/// done (clients correlate by request_id).
+///
+/// Streaming jobs (`RequestJob::stream`) hand each encoded image to the writer
+/// right away instead of collecting them in `outputs`; the job itself still
+/// completes once all its images are done, after all of its items.
+///
+/// A job may be submitted while its frame is still arriving (`receiving`):
+/// the dispatcher only hands out images already reported by image_received(),
+/// and abort_receiving() fails the rest if the frame never completes.
+///
+/// Once a job's CancelToken stops, its remaining images are skipped at the
+/// next stage boundary (or tile) and it completes with Cancelled / Timeout.
+/// A failed image fails its whole request the same way, unless the request
+/// asked for per-item status: its other images then still complete, and the
+/// response keeps every output with a status per image.
+///
+/// With a ResultCache configured, decoders first hash each image together with
+/// the request's model and encodings. A cached result skips all three stages.
+/// Otherwise the first image with that key leads a "flight" and is computed;
+/// identical images arriving meanwhile, from any request, park on the flight
+/// instead of being computed again, and receive its result. If the leader
+/// fails, they fail with it; if it is skipped (cancelled), they go back to the
+/// dispatcher and one of them leads a new flight.
+///
+/// With an `atlas_window`, small images (up to `atlas_max_image` a side) of
+/// the same model are not upscaled one by one: an inference thread waits up
+/// to the window for more of them, from any request, packs them into one atlas
+/// no larger than a padded tile, upscales it in a single engine call and
+/// slices the result back into per-image outputs. It never waits when no other
+/// image is on its way.
+///
+/// Compressed outputs are encoded with the request's EncoderEffort. In Auto,
+/// encoders step down to Fast while requests wait for a slot or the encode
+/// queue holds an image per encoder, and up to Best when a single request is
+/// in flight with nothing queued; a request close to its deadline is encoded
+/// Fast regardless.
+class Pipeline {
+public:
+    /// Called on the writer thread, once per job: in submission order, or in
+    /// completion order when `out_of_order` is set.
+    using CompletionHandler = std::function<void(RequestJob&)>;
+    /// Called on the writer thread for each item of a streaming job, as soon as
+    /// it is available (never held back for ordering), before the job's
+    /// CompletionHandler call.
+    using ItemHandler = std::function<void(RequestJob&, StreamedItem&)>;
+
+    /// `models` supplies the engine for each request; only the inference
+    /// threads use it.
+    Pipeline(ModelRegistry* models,
+             std::string output_format,
+             const PipelineConfig& config,
+             CompletionHandler on_complete,
+             ItemHandler on_item = {});
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    /// Queue a job. Must be called from a single (reader) thread. Blocks a job
+    /// with a request while `read_ahead` (unless 0) earlier ones are waiting
+    /// for a slot.
+    void submit(std::shared_ptr<RequestJob> job);
+
+    /// Image `index` of a `receiving` job is in `job->request.images` (images
+    /// arrive in order): it may be dispatched. Reader thread only.
+    void image_received(const std::shared_ptr<RequestJob>& job, uint32_t index);
+
+    /// The rest of a `receiving` job's frame will not arrive (malformed body,
+    /// client gone): images not received are dropped, and the job is answered
+    /// with `status` once those in the pipeline are done. Reader thread only.
+    void abort_receiving(const std::shared_ptr<RequestJob>& job,
+                         protocol_v2::ProtocolStatus status,
+                         const std::string& message);
+
+    /// Requests being processed (admitted, not yet answered).
+    size_t in_flight() const;
+
+    /// Queue depths and stage latencies right now. Thread-safe.
+    PipelineSnapshot snapshot() const;
+
+    /// Drain everything already submitted, then stop and join all stages.
+    /// Idempotent; also invoked by the destructor.
+    void shutdown();
+
+private:
+    struct DecodeItem {
+        std::shared_ptr<RequestJob> job;
+        uint32_t index = 0;
+    };
+
+    struct PixelItem {
+        std::shared_ptr<RequestJob> job;
+        uint32_t index = 0;
+        image_io::ImagePixels pixels;
+        std::string cache_key;  // Set when this image leads a result cache flight
+        image_io::EncodeEffort effort = image_io::EncodeEffort::Balanced;  // Compressed outputs
+    };
+
+    /// Writer input: a finished job, or one item of a streaming job.
+    struct DoneEntry {
+        std::shared_ptr<RequestJob> job;
+        bool has_item = false;
+        StreamedItem item;
+    };
+
+    void dispatch_worker();
+    void decode_worker();
+    void inference_worker();
+    void encode_worker();
+    void writer_worker();
+
+    /// Upscale one image (tiled if it is large) and hand it on.
+    void infer_image(PixelItem& item);
+    /// `group` holds one popped image: if it may start an atlas, add the small
+    /// images of the same model arriving within the atlas window. True when an
+    /// image was popped into `next` that cannot join; it is the caller's next one.
+    bool gather_atlas(std::vector<PixelItem>& group,
+                      std::vector<atlas::Placement>& placements,
+                      int& width,
+                      int& height,
+                      PixelItem& next);
+    /// Upscale `group` as one `width` × `height` atlas and slice the result;
+    /// falls back to infer_image() for each image if the engine call fails.
+    void infer_atlas(std::vector<PixelItem>& group,
+                     const std::vector<atlas::Placement>& placements,
+                     int width,
+                     int height);
+    /// Small enough for an atlas, and its request still running.
+    bool atlas_candidate(const PixelItem& item) const;
+    /// Images dispatched but not yet picked up by inference, or still to dispatch.
+    bool images_upstream() const;
+    /// Account for `item` leaving the inference stage: on to the encoders when
+    /// `ok`, otherwise skipped or failed with `failure`.
+    void finish_inference(PixelItem& item, BaseEngine* engine, bool ok, bool skip, const std::string& failure);
+
+    /// True when `job` must not process more images: an earlier image failed,
+    /// or its CancelToken stopped (then the job is marked failed too).
+    static bool should_skip(RequestJob& job);
+    /// Encoder effort for the next image of `job`, resolving Default / Auto.
+    /// Picked when the image is decoded, as it is part of its cache key.
+    image_io::EncodeEffort encode_effort(const RequestJob& job);
+    /// An image left the dispatch window (reached inference or was dropped
+    /// before it).
+    void release_dispatch_slot();
+    /// Account for one image leaving the decode stage; drops the request's frame
+    /// buffer once no decoder needs it any more.
+    void finish_decode(const std::shared_ptr<RequestJob>& job);
+    /// Mark image `index` of `job` as failed (lowest index wins) and finish it.
+    void fail_item(const std::shared_ptr<RequestJob>& job, uint32_t index, const std::string& reason);
+    /// Copy an encoded output into its shared memory region and replace it with
+    /// the descriptor sent back to the client.
+    static bool copy_to_region(const shm::Region& region, image_io::EncodedImage& output, std::string& reason);
+    /// Account for one image leaving the pipeline; hands the job to the writer
+    /// once its last image is done.
+    void finish_item(const std::shared_ptr<RequestJob>& job);
+    /// Per-item job that stopped: give the images it skipped (no output, no
+    /// failure) the stop's status.
+    static void settle_skipped_items(RequestJob& job);
+    /// Store a successful output (shared memory copy, stream item or
+    /// `outputs` slot) and finish the image.
+    void deliver_output(const std::shared_ptr<RequestJob>& job, uint32_t index, image_io::EncodedImage output);
+    /// Account for an image that will not go through inference and encoding.
+    void bypass_stages(const std::shared_ptr<RequestJob>& job);
+
+    /// Look `key` up for `item`: true if the image is taken care of (cache hit,
+    /// or parked on a flight), false if the caller must compute it and then
+    /// settle the flight it now leads.
+    bool claim_result(const DecodeItem& item, const std::string& key);
+    /// Leader succeeded: cache `result` and hand it to the parked images.
+    void complete_flight(const std::string& key, const ResultCache::Payload& result);
+    /// Leader did not produce a result: parked images fail with `reason`, or
+    /// are dispatched again when it is empty (the leader was skipped).
+    void abandon_flight(const std::string& key, const std::string& reason);
+
+    ModelRegistry* models_;
+    std::string output_format_;
+    CompletionHandler on_complete_;
+    ItemHandler on_item_;
+
+    BoundedBlockingQueue<DecodeItem> decode_queue_;
+    BoundedBlockingQueue<PixelItem> inference_queue_;
+    BoundedBlockingQueue<PixelItem> encode_queue_;
+    BoundedBlockingQueue<DoneEntry> done_queue_;
+
+    const size_t max_in_flight_;
+    const size_t read_ahead_;
+    const bool out_of_order_;
+    const RequestScheduler scheduler_;
+    const size_t dispatch_window_;  // Max images dispatched but not yet picked up by inference
+
+    // Admission and dispatch state.
+    mutable std::mutex dispatch_mutex_;
+    std::condition_variable dispatch_cv_;  // Dispatcher: job to dispatch or admit, or intake closed
+    std::condition_variable intake_cv_;    // submit(): a waiting job was admitted
+    std::deque<std::shared_ptr<RequestJob>> waiting_jobs_;   // Submitted, waiting for a slot
+    std::deque<std::shared_ptr<RequestJob>> dispatch_jobs_;  // Admitted, images not all dispatched
+    size_t in_flight_ = 0;                                   // Admitted, not yet answered
+    size_t dispatched_ahead_ = 0;                            // Dispatched, not yet at inference
+    MemoryBudget memory_;
+    bool intake_closed_ = false;
+    std::deque<DecodeItem> retry_items_;  // Parked on an abandoned flight; dispatched first
+
+    LatencyHistogram decode_latency_;
+    LatencyHistogram inference_latency_;
+    LatencyHistogram encode_latency_;
+
+    ResultCache cache_;
+    const std::string cache_namespace_;
+    const std::string precision_;  // Engine precision cache keys stand for
+    std::mutex flights_mutex_;
+    std::unordered_map<std::string, std::vector<DecodeItem>> flights_;  // Key → images parked on its leader
+
+    const protocol_v2::EncoderEffort default_effort_;
+    const size_t encoders_;
+    std::atomic<uint8_t> auto_effort_{static_cast<uint8_t>(image_io::EncodeEffort::Balanced)};  // Auto's current level
+
+    const std::chrono::milliseconds atlas_window_;
+    const int atlas_max_image_;
+    const int atlas_side_;  // Atlas size limit: a padded tile, within the tiling threshold
+    std::atomic<uint64_t> atlas_runs_{0};
+    std::atomic<uint64_t> atlas_images_{0};
+
+    std::atomic<size_t> live_decoders_{0};
+    std::atomic<size_t> live_inferers_{0};
+    std::atomic<size_t> live_encoders_{0};
+    std::vector<std::thread> threads_;
+    uint64_t next_sequence_ = 0;
+    bool stopped_ = false;
+};
+
+} // namespace keep_alive
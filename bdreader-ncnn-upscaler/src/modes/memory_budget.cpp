@@ -0,0 +1,59 @@
+#include "memory_budget.hpp"
+
+#include "keep_alive_pipeline.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <unistd.h>
+
+namespace keep_alive {
+
+namespace {
+
+constexpr uint64_t kRgbBytes = 3;
+constexpr uint64_t kFloatRgbBytes = 3 * sizeof(float);
+// Compressed outputs (WebP/PNG/JPEG) are assumed to take at most this fraction
+// of the raw upscaled pixels.
+constexpr uint64_t kCompressionRatio = 4;
+
+} // namespace
+
+MemoryBudget::MemoryBudget(uint64_t budget_bytes, const tiling::TilingConfig& tiling, size_t engine_concurrency)
+    : budget_(budget_bytes), tiling_(tiling), engine_concurrency_(std::max<size_t>(1, engine_concurrency)) {}
+
+uint64_t MemoryBudget::default_budget() {
+    const long pages = ::sysconf(_SC_PHYS_PAGES);
+    const long page_size = ::sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(pages) * static_cast<uint64_t>(page_size) / 2;
+}
+
+uint64_t MemoryBudget::estimate(const RequestJob& job, int scale) const {
+    const uint64_t area = static_cast<uint64_t>(std::max(1, scale)) * static_cast<uint64_t>(std::max(1, scale));
+    const bool raw_output = job.request.options.output != protocol_v2::OutputEncoding::Compressed;
+
+    // Largest region the engine sees at once: a padded tile, or a whole image
+    // below the tiling threshold.
+    const uint64_t padded_tile = static_cast<uint64_t>(tiling_.tile_size + 2 * tiling_.overlap);
+    const uint64_t engine_limit =
+        !tiling_.enable_tiling
+            ? std::numeric_limits<uint64_t>::max()
+            : std::max(padded_tile * padded_tile,
+                       static_cast<uint64_t>(tiling_.threshold_width) * static_cast<uint64_t>(tiling_.threshold_height));
+
+    uint64_t held = 0;
+    uint64_t engine_pixels = 0;
+    bool tiled = false;
+    for (uint64_t pixels : job.image_costs) {
+        const uint64_t upscaled = pixels * area * kRgbBytes;
+        held += pixels * kRgbBytes + upscaled + (raw_output ? upscaled : upscaled / kCompressionRatio);
+        engine_pixels = std::max(engine_pixels, std::min(pixels, engine_limit));
+        tiled = tiled || pixels > engine_limit;
+    }
+    const uint64_t engine = engine_pixels * (kRgbBytes + kFloatRgbBytes) * (1 + area) * (tiled ? engine_concurrency_ : 1);
+    return held + engine;
+}
+
+} // namespace keep_alive
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../utils/tiling.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace keep_alive {
+
+struct RequestJob;
+
+/// Memory admission for the keep-alive pipeline.
+///
+/// Every request gets an estimate of its peak working set, from the pixel
+/// counts RequestScheduler::estimate_costs probed in the image headers, its
+/// upscale factor and the engine's tiling config:
+///   - per image, held until the image is answered: decoded RGB, upscaled RGB
+///     and the encoded output;
+///   - plus, once per request, the engine's host buffers for the largest tile
+///     (or untiled image): RGB copies and float ncnn mats, in and out; times
+///     the engine's concurrency when that image is tiled, since its tiles
+///     then run on every inference context at once.
+/// Network activations are not counted: they live in VRAM on GPU.
+///
+/// Requests whose estimate alone exceeds the budget are rejected; others are
+/// admitted while the estimates of admitted requests fit, and otherwise wait.
+/// A request is always admitted when nothing else is in flight.
+///
+/// Not thread-safe: the pipeline calls it under its dispatch mutex.
+class MemoryBudget {
+public:
+    /// `budget_bytes` == 0: no limit. `engine_concurrency`: tiles of one
+    /// image the engine runs at once (BaseEngine::concurrency()).
+    MemoryBudget(uint64_t budget_bytes, const tiling::TilingConfig& tiling, size_t engine_concurrency = 1);
+
+    /// Half of the physical memory, or 0 if unknown.
+    static uint64_t default_budget();
+
+    /// Peak working set of `job` (image_costs filled) at `scale`.
+    uint64_t estimate(const RequestJob& job, int scale) const;
+
+    uint64_t budget() const { return budget_; }
+    uint64_t reserved() const { return reserved_; }
+
+    /// False when `bytes` can never be admitted.
+    bool admissible(uint64_t bytes) const { return budget_ == 0 || bytes <= budget_; }
+    /// True when `bytes` fits next to what is reserved now.
+    bool fits(uint64_t bytes) const { return budget_ == 0 || reserved_ + bytes <= budget_; }
+
+    void reserve(uint64_t bytes) { reserved_ += bytes; }
+    void release(uint64_t bytes) { reserved_ -= bytes; }
+
+private:
+    const uint64_t budget_;
+    const tiling::TilingConfig tiling_;
+    const uint64_t engine_concurrency_;
+    uint64_t reserved_ = 0;
+};
+
+} // namespace keep_alive
@@ -0,0 +1,662 @@
+#include "protocol_session.hpp"
+
+#include "../protocol_writer.hpp"
+#include "../utils/logger.hpp"
+#include "../utils/process_clock.hpp"
+#include "../utils/raw_pixels.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace keep_alive {
+
+using namespace protocol_v2;
+
+namespace {
+
+// Sweep expired RequestIntake::requests_ entries once the map grows past this.
+constexpr size_t kRequestSweepThreshold = 64;
+
+const char* engine_name(Options::EngineType engine) {
+    return engine == Options::EngineType::RealESRGAN ? "RealESRGAN" : "RealCUGAN";
+}
+
+/// Stats keys of ProtocolStatus values, indexed by status.
+constexpr const char* kStatusNames[] = {
+    "ok", "invalid_frame", "validation_error", "engine_error", "resource_limit", "timeout", "cancelled",
+};
+
+/// Current and peak resident set size of the process, from /proc (0 if unavailable).
+void resident_memory(uint64_t& rss_bytes, uint64_t& peak_rss_bytes) {
+    rss_bytes = 0;
+    peak_rss_bytes = 0;
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        uint64_t* target = nullptr;
+        if (line.rfind("VmRSS:", 0) == 0) {
+            target = &rss_bytes;
+        } else if (line.rfind("VmHWM:", 0) == 0) {
+            target = &peak_rss_bytes;
+        }
+        if (target) {
+            std::istringstream fields(line.substr(6));
+            uint64_t kib = 0;
+            fields >> kib;
+            *target = kib * 1024u;
+        }
+    }
+}
+
+/// `value` as a JSON string literal.
+void write_json_string(std::ostringstream& out, const std::string& value) {
+    out << '"';
+    for (const char c : value) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec
+                << std::setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+/// `"name":{"count":..,"p50_ms":..,"p90_ms":..,"p99_ms":..,"max_ms":..}`
+void write_histogram(std::ostringstream& out, const char* name, const LatencyHistogram::Snapshot& histogram) {
+    out << '"' << name << "\":{\"count\":" << histogram.count
+        << ",\"p50_ms\":" << histogram.percentile(0.50) / 1e6
+        << ",\"p90_ms\":" << histogram.percentile(0.90) / 1e6
+        << ",\"p99_ms\":" << histogram.percentile(0.99) / 1e6
+        << ",\"max_ms\":" << histogram.max_ns / 1e6 << '}';
+}
+
+bool output_supported(const RequestOptions& options, std::string& error) {
+    if (options.output == OutputEncoding::RawPixelsLz4 && !raw_pixels::lz4_available()) {
+        error = "LZ4 raw pixel output not supported by this build";
+        return false;
+    }
+    return true;
+}
+
+/// Check raw pixel blob headers up front so malformed blobs are validation
+/// errors instead of pipeline failures.
+bool validate_raw_pixels(const RequestPayload& request, std::string& error) {
+    if (!output_supported(request.options, error)) {
+        return false;
+    }
+    if (request.options.input != InputEncoding::RawPixels) {
+        return true;
+    }
+    for (size_t i = 0; i < request.images.size(); ++i) {
+        if (!raw_pixels::validate(request.images[i].data, request.images[i].size, error)) {
+            error = "image " + std::to_string(i) + ": " + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Transport::SharedMemory: point the request's image views at the client's
+/// buffers and collect the output regions. The mappings are kept alive through
+/// RequestPayload::storage and the regions.
+bool resolve_shared_memory(const shm::BufferRegistry& registry,
+                           RequestPayload& request,
+                           std::vector<shm::Region>& output_regions,
+                           std::string& error) {
+    auto inputs = std::make_shared<std::vector<std::shared_ptr<shm::MappedBuffer>>>();
+    output_regions.clear();
+    output_regions.reserve(request.images.size());
+    for (size_t i = 0; i < request.images.size(); ++i) {
+        ShmImageSlot slot;
+        shm::Region input;
+        shm::Region output;
+        if (!parse_shm_slot(request.images[i], slot, error) ||
+            !registry.resolve(slot.in_buffer, slot.in_offset, slot.in_length, input, error) ||
+            !registry.resolve(slot.out_buffer, slot.out_offset, slot.out_capacity, output, error)) {
+            error = "image " + std::to_string(i) + ": " + error;
+            return false;
+        }
+        if (slot.in_length == 0 || slot.in_length > kMaxImageSizeBytes) {
+            error = "image " + std::to_string(i) + ": shared memory input length must be 1.." +
+                    std::to_string(kMaxImageSizeBytes) + " bytes";
+            return false;
+        }
+        request.images[i] = ImageView{input.data(), static_cast<size_t>(input.length)};
+        inputs->push_back(std::move(input.buffer));
+        output_regions.push_back(std::move(output));
+    }
+    request.storage = std::move(inputs);
+    return true;
+}
+
+} // namespace
+
+RequestIntake::RequestIntake(const Options& opts, FdSource fds)
+    : opts_(opts), fds_(std::move(fds)) {}
+
+std::shared_ptr<RequestJob> RequestIntake::respond(uint32_t request_id,
+                                                   ProtocolStatus status,
+                                                   const std::string& message,
+                                                   const std::chrono::steady_clock::time_point& start,
+                                                   size_t bytes_in,
+                                                   bool stream) const {
+    auto job = std::make_shared<RequestJob>();
+    job->request_id = request_id;
+    job->stream = stream;
+    job->status = status;
+    job->error_message = message;
+    job->start = start;
+    job->bytes_in = bytes_in;
+    return job;
+}
+
+std::shared_ptr<RequestJob> RequestIntake::build(std::shared_ptr<FrameBuffer> frame,
+                                                 const std::chrono::steady_clock::time_point& start) {
+    const size_t message_len = frame->size();
+
+    ProtocolHeader header;
+    std::string error;
+    if (!parse_protocol_header(frame->data(), frame->size(), header, error)) {
+        logger::error("Protocol header validation failed: " + error);
+        if (!options_flag_misplaced(header)) {
+            return respond(header.request_id, ProtocolStatus::ValidationError, error, start, message_len);
+        }
+        // Drop the fd a RegisterBuffer frame came with, as handle_buffer_message() would.
+        if ((header.msg_type & kMessageTypeMask) == static_cast<uint32_t>(ProtocolMessageType::RegisterBuffer) &&
+            fds_) {
+            const int fd = fds_();
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        return respond(header.request_id, ProtocolStatus::InvalidFrame, error, start, message_len);
+    }
+
+    const uint32_t base_type = header.msg_type & kMessageTypeMask;
+    if (base_type == static_cast<uint32_t>(ProtocolMessageType::RegisterBuffer) ||
+        base_type == static_cast<uint32_t>(ProtocolMessageType::ReleaseBuffer)) {
+        handle_buffer_message(base_type, *frame, error);
+        if (!error.empty()) {
+            logger::error("Protocol v2 request_id=" + std::to_string(header.request_id) + " " + error);
+        }
+        return respond(header.request_id,
+                       error.empty() ? ProtocolStatus::Ok : ProtocolStatus::ValidationError,
+                       error,
+                       start,
+                       message_len);
+    }
+    if (base_type == static_cast<uint32_t>(ProtocolMessageType::Stats)) {
+        if (frame->size() != kProtocolHeaderSize) {
+            return respond(header.request_id, ProtocolStatus::ValidationError, "stats body must be empty", start,
+                           message_len);
+        }
+        auto job = respond(header.request_id, ProtocolStatus::Ok, {}, start, message_len);
+        job->stats = true;
+        return job;
+    }
+    if (base_type == static_cast<uint32_t>(ProtocolMessageType::Cancel)) {
+        handle_cancel(*frame, error);
+        if (!error.empty()) {
+            logger::warn("Protocol v2 request_id=" + std::to_string(header.request_id) + " " + error);
+        }
+        return respond(header.request_id,
+                       error.empty() ? ProtocolStatus::Ok : ProtocolStatus::ValidationError,
+                       error,
+                       start,
+                       message_len);
+    }
+
+    // Anything left is a Request or StreamRequest.
+    const bool stream = base_type == static_cast<uint32_t>(ProtocolMessageType::StreamRequest);
+
+    size_t body_size = frame->size() - kProtocolHeaderSize;
+    const uint8_t* body_ptr = frame->data() + kProtocolHeaderSize;
+
+    RequestOptions options;
+    if ((header.msg_type & kMessageFlagOptions) != 0) {
+        size_t options_size = 0;
+        if (!parse_request_options(body_ptr, body_size, options, options_size, error)) {
+            logger::error("Protocol v2 request_id=" + std::to_string(header.request_id) +
+                          " options parse failed: " + error);
+            return respond(header.request_id, ProtocolStatus::ValidationError, error, start, message_len, stream);
+        }
+        body_ptr += options_size;
+        body_size -= options_size;
+    }
+
+    if (body_size == 0) {
+        logger::warn("Protocol v2 request_id=" + std::to_string(header.request_id) + " has empty body");
+        return respond(header.request_id, ProtocolStatus::ValidationError, "request body empty", start, message_len,
+                       stream);
+    }
+
+    auto job = std::make_shared<RequestJob>();
+    job->request_id = header.request_id;
+    job->stream = stream;
+    job->start = start;
+    job->bytes_in = message_len;
+
+    RequestPayload& request = job->request;
+    ProtocolStatus payload_status = ProtocolStatus::ValidationError;
+    if (!parse_request_payload(body_ptr, body_size, opts_.max_batch_items, request, error, payload_status)) {
+        logger::error("Protocol v2 request_id=" + std::to_string(header.request_id) +
+                      " payload parse failed: " + error);
+        return respond(header.request_id, payload_status, error, start, message_len, stream);
+    }
+    request.options = options;
+    if (options.deadline_ms != 0) {
+        job->cancel.set_deadline(start + std::chrono::milliseconds(options.deadline_ms));
+    }
+
+    if (options.transport == Transport::SharedMemory &&
+        !resolve_shared_memory(shared_buffers_, request, job->output_regions, error)) {
+        logger::error("Protocol v2 request_id=" + std::to_string(header.request_id) + " " + error);
+        return respond(header.request_id, ProtocolStatus::ValidationError, error, start, message_len, stream);
+    }
+
+    if (!validate_raw_pixels(request, error)) {
+        logger::error("Protocol v2 request_id=" + std::to_string(header.request_id) + " " + error);
+        return respond(header.request_id, ProtocolStatus::ValidationError, error, start, message_len, stream);
+    }
+
+    if (!request.storage) {
+        request.storage = std::move(frame);  // Images are views into the frame
+    }
+    track(job);
+    return job;
+}
+
+std::shared_ptr<RequestJob> RequestIntake::begin(const ProtocolHeader& header,
+                                                 const RequestBodyParser& parser,
+                                                 const std::chrono::steady_clock::time_point& start,
+                                                 size_t message_len) {
+    const bool stream = (header.msg_type & kMessageTypeMask) == static_cast<uint32_t>(ProtocolMessageType::StreamRequest);
+    if (parser.state() == RequestBodyParser::State::Failed) {
+        logger::error("Protocol v2 request_id=" + std::to_string(header.request_id) +
+                      " payload parse failed: " + parser.error());
+        return respond(header.request_id, parser.status(), parser.error(), start, message_len, stream);
+    }
+    std::string error;
+    if (!output_supported(parser.options(), error)) {
+        logger::error("Protocol v2 request_id=" + std::to_string(header.request_id) + " " + error);
+        return respond(header.request_id, ProtocolStatus::ValidationError, error, start, message_len, stream);
+    }
+
+    auto job = std::make_shared<RequestJob>();
+    job->request_id = header.request_id;
+    job->stream = stream;
+    job->start = start;
+    job->bytes_in = message_len;
+    job->request = parser.request();
+    job->request.options = parser.options();
+    job->request.images.resize(job->request.batch_count);
+    job->image_storage.resize(job->request.batch_count);
+    job->receiving = true;
+    job->unreceived_bytes = parser.remaining();
+    if (parser.options().deadline_ms != 0) {
+        job->cancel.set_deadline(start + std::chrono::milliseconds(parser.options().deadline_ms));
+    }
+    track(job);
+    return job;
+}
+
+void RequestIntake::track(const std::shared_ptr<RequestJob>& job) {
+    const RequestPayload& request = job->request;
+    logger::info("Protocol v2 request_id=" + std::to_string(job->request_id) +
+                 " engine=" + engine_name(request.engine) +
+                 " quality_or_scale='" + request.quality_or_scale +
+                 "' gpu_id=" + std::to_string(request.gpu_id) +
+                 " batch_count=" + std::to_string(request.batch_count));
+
+    // Engine and model variant are honoured by the ModelRegistry, but every
+    // engine lives on the GPU chosen at startup. Warn (don't fail) if the caller
+    // asks for another one.
+    if (opts_.gpu_id != "auto") {
+        try {
+            const int configured_gpu = std::stoi(opts_.gpu_id);
+            if (request.gpu_id != configured_gpu) {
+                logger::warn("Request gpu_id=" + std::to_string(request.gpu_id) +
+                             " differs from configured gpu_id=" + std::to_string(configured_gpu) +
+                             "; processing on the configured GPU");
+            }
+        } catch (...) {
+            // opts.gpu_id is not a parseable int; leave as-is.
+        }
+    }
+
+    job->has_request = true;
+
+    if (requests_.size() >= kRequestSweepThreshold) {
+        for (auto it = requests_.begin(); it != requests_.end();) {
+            it = it->second.expired() ? requests_.erase(it) : std::next(it);
+        }
+    }
+    requests_[job->request_id] = job;
+}
+
+void RequestIntake::handle_cancel(const FrameBuffer& frame, std::string& error) {
+    if (frame.size() != kProtocolHeaderSize + 4) {
+        error = "cancel body must be [target_request_id:u32]";
+        return;
+    }
+    const uint32_t target = decode_u32_le(frame.data() + kProtocolHeaderSize);
+    auto it = requests_.find(target);
+    std::shared_ptr<RequestJob> job = it != requests_.end() ? it->second.lock() : nullptr;
+    if (!job || job->remaining.load(std::memory_order_acquire) == 0) {
+        error = "request " + std::to_string(target) + " is not in flight";
+        return;
+    }
+    job->cancel.cancel();
+    logger::info("Protocol v2 request_id=" + std::to_string(target) + " cancelled");
+}
+
+void RequestIntake::handle_buffer_message(uint32_t msg_type, const FrameBuffer& frame, std::string& error) {
+    const bool is_register = msg_type == static_cast<uint32_t>(ProtocolMessageType::RegisterBuffer);
+    // Always consume the fd sent with a RegisterBuffer frame, even if the frame
+    // is invalid, so it cannot be paired with a later registration.
+    const int fd = (is_register && fds_) ? fds_() : -1;
+
+    if (frame.size() != kProtocolHeaderSize + 4) {
+        error = "buffer message body must be [buffer_id:u32]";
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return;
+    }
+    const uint32_t buffer_id = decode_u32_le(frame.data() + kProtocolHeaderSize);
+
+    if (!is_register) {
+        if (!shared_buffers_.remove(buffer_id)) {
+            error = "unknown shared buffer " + std::to_string(buffer_id);
+        }
+        return;
+    }
+    if (fd < 0) {
+        error = fds_ ? "no file descriptor received with RegisterBuffer"
+                     : "RegisterBuffer needs stdin to be a Unix socket (SCM_RIGHTS)";
+        return;
+    }
+    auto buffer = shm::MappedBuffer::map(fd, error);
+    if (!buffer) {
+        return;
+    }
+    logger::info("Registered shared buffer " + std::to_string(buffer_id) + " (" +
+                 std::to_string(buffer->size()) + " bytes)");
+    shared_buffers_.add(buffer_id, std::move(buffer));
+}
+
+ProtocolMetrics::ProtocolMetrics(const Options& opts)
+    : log_protocol_(opts.log_protocol),
+      profiling_(opts.profiling),
+      cache_enabled_(opts.cache_memory_mb > 0 || !opts.cache_dir.empty()),
+      started_(std::chrono::steady_clock::now()) {}
+
+void ProtocolMetrics::record(const RequestJob& job) {
+    size_t bytes_out = job.streamed_bytes;
+    for (const auto& output : job.outputs) {
+        bytes_out += output.size();
+    }
+    size_t result_count = job.stream ? job.streamed_ok : job.outputs.size();
+    if (!job.item_statuses.empty()) {
+        result_count = static_cast<size_t>(
+            std::count(job.item_statuses.begin(), job.item_statuses.end(), ProtocolStatus::Ok));
+    } else if (job.status == ProtocolStatus::EngineError && !job.stream) {
+        // Report how many images succeeded before the first failure.
+        result_count = job.failed_index.load(std::memory_order_relaxed);
+    }
+
+    const auto elapsed_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - job.start).count();
+    total_ns_.fetch_add(elapsed_ns, std::memory_order_relaxed);
+    bytes_in_.fetch_add(job.bytes_in, std::memory_order_relaxed);
+    bytes_out_.fetch_add(bytes_out, std::memory_order_relaxed);
+    // Acks and Stats answers say nothing about request latency.
+    const auto status_index = static_cast<size_t>(job.status);
+    if ((job.has_request || job.status != ProtocolStatus::Ok) && status_index < latency_by_status_.size()) {
+        latency_by_status_[status_index].record(static_cast<uint64_t>(elapsed_ns));
+    }
+    if (job.status == ProtocolStatus::Ok) {
+        processed_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+    const uint32_t cache_hits = job.cache_hits.load(std::memory_order_relaxed);
+    const uint32_t cache_shared = job.cache_shared.load(std::memory_order_relaxed);
+    const uint32_t cache_misses = job.cache_misses.load(std::memory_order_relaxed);
+    cache_hits_.fetch_add(cache_hits, std::memory_order_relaxed);
+    cache_shared_.fetch_add(cache_shared, std::memory_order_relaxed);
+    cache_misses_.fetch_add(cache_misses, std::memory_order_relaxed);
+    for (size_t i = 0; i < image_io::kEncodeEffortCount; ++i) {
+        encoded_[i].fetch_add(job.encoded[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        encoded_bytes_[i].fetch_add(job.encoded_bytes[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        encode_ns_[i].fetch_add(job.encode_ns[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    double unset = -1.0;
+    if (job.has_request && first_response_ms_.compare_exchange_strong(unset, process_clock::elapsed_ms()) &&
+        profiling_) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2)
+            << "Profiling time_to_first_response_ms=" << first_response_ms_.load(std::memory_order_relaxed)
+            << " ready_ms=" << ready_ms();
+        logger::info(oss.str());
+    }
+
+    if (log_protocol_) {
+        std::ostringstream oss;
+        oss << "Protocol v2 response request_id=" << job.request_id
+            << " status=" << static_cast<uint32_t>(job.status)
+            << " elapsed_ms=" << std::fixed << std::setprecision(2) << (elapsed_ns / 1e6)
+            << " results=" << result_count;
+        if (!job.error_message.empty()) {
+            oss << " error='" << job.error_message << "'";
+        }
+        logger::info(oss.str());
+    }
+
+    if (profiling_) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2);
+        oss << "Profiling request_id=" << job.request_id
+            << " status=" << static_cast<uint32_t>(job.status);
+        if (job.has_request) {
+            oss << " engine=" << engine_name(job.request.engine)
+                << " quality_or_scale='" << job.request.quality_or_scale << "'"
+                << " gpu_id=" << job.request.gpu_id
+                << " batch_count=" << job.request.batch_count;
+        }
+        oss << " results=" << result_count
+            << " bytes_in=" << job.bytes_in
+            << " bytes_out=" << bytes_out
+            << " elapsed_ms=" << (elapsed_ns / 1e6);
+        if (cache_enabled_ && job.has_request) {
+            oss << " cache_hits=" << cache_hits
+                << " cache_coalesced=" << cache_shared
+                << " cache_misses=" << cache_misses;
+        }
+        // Per encoder effort: images/output bytes/encode time.
+        for (size_t i = 0; i < image_io::kEncodeEffortCount; ++i) {
+            const uint32_t encoded = job.encoded[i].load(std::memory_order_relaxed);
+            if (encoded > 0) {
+                oss << " encode_" << image_io::encode_effort_name(static_cast<image_io::EncodeEffort>(i)) << '='
+                    << encoded << '/' << job.encoded_bytes[i].load(std::memory_order_relaxed) << "B/"
+                    << job.encode_ns[i].load(std::memory_order_relaxed) / 1e6 << "ms";
+            }
+        }
+        if (!job.error_message.empty()) {
+            oss << " error_len=" << job.error_message.size() << " error='" << job.error_message << "'";
+        }
+        logger::info(oss.str());
+    }
+}
+
+void ProtocolMetrics::fill_stats(RequestJob& job) const {
+    if (!job.stats) {
+        return;
+    }
+    uint64_t rss_bytes = 0;
+    uint64_t peak_rss_bytes = 0;
+    resident_memory(rss_bytes, peak_rss_bytes);
+    const auto uptime = std::chrono::steady_clock::now() - started_;
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"uptime_ms\":" << std::chrono::duration_cast<std::chrono::milliseconds>(uptime).count()
+        << ",\"startup\":{\"ready_ms\":" << ready_ms()
+        << ",\"first_response_ms\":" << first_response_ms_.load(std::memory_order_relaxed) << '}'
+        << ",\"frames\":{\"processed\":" << processed_.load(std::memory_order_relaxed)
+        << ",\"errors\":" << errors_.load(std::memory_order_relaxed)
+        << ",\"bytes_in\":" << bytes_in_.load(std::memory_order_relaxed)
+        << ",\"bytes_out\":" << bytes_out_.load(std::memory_order_relaxed) << '}';
+
+    out << ",\"latency_by_status\":{";
+    for (size_t i = 0; i < latency_by_status_.size(); ++i) {
+        if (i > 0) {
+            out << ',';
+        }
+        write_histogram(out, kStatusNames[i], latency_by_status_[i].snapshot());
+    }
+    out << '}';
+
+    if (const PipelineSnapshot* pipeline = job.pipeline_snapshot.get()) {
+        out << ",\"latency_by_stage\":{";
+        write_histogram(out, "decode", pipeline->decode);
+        out << ',';
+        write_histogram(out, "inference", pipeline->inference);
+        out << ',';
+        write_histogram(out, "encode", pipeline->encode);
+        out << "},\"queues\":{\"waiting_requests\":" << pipeline->waiting_requests
+            << ",\"in_flight_requests\":" << pipeline->in_flight_requests
+            << ",\"decode\":" << pipeline->decode_queue
+            << ",\"inference\":" << pipeline->inference_queue
+            << ",\"encode\":" << pipeline->encode_queue
+            << ",\"done\":" << pipeline->done_queue << '}'
+            << ",\"atlas\":{\"runs\":" << pipeline->atlas_runs << ",\"images\":" << pipeline->atlas_images << '}';
+    }
+
+    out << ",\"cache\":{\"hits\":" << cache_hits_.load(std::memory_order_relaxed)
+        << ",\"coalesced\":" << cache_shared_.load(std::memory_order_relaxed)
+        << ",\"misses\":" << cache_misses_.load(std::memory_order_relaxed)
+        << ",\"memory_bytes\":" << (job.pipeline_snapshot ? job.pipeline_snapshot->result_cache_bytes : 0) << '}';
+
+    out << ",\"encoder\":{";
+    for (size_t i = 0; i < image_io::kEncodeEffortCount; ++i) {
+        out << (i > 0 ? "," : "") << '"' << image_io::encode_effort_name(static_cast<image_io::EncodeEffort>(i))
+            << "\":{\"images\":" << encoded_[i].load(std::memory_order_relaxed)
+            << ",\"bytes\":" << encoded_bytes_[i].load(std::memory_order_relaxed)
+            << ",\"encode_ms\":" << encode_ns_[i].load(std::memory_order_relaxed) / 1e6 << '}';
+    }
+    out << '}'
+        << ",\"memory\":{\"rss_bytes\":" << rss_bytes << ",\"peak_rss_bytes\":" << peak_rss_bytes
+        << ",\"budget_bytes\":" << (job.pipeline_snapshot ? job.pipeline_snapshot->memory_budget : 0)
+        << ",\"reserved_bytes\":" << (job.pipeline_snapshot ? job.pipeline_snapshot->memory_reserved : 0) << "}}";
+
+    const std::string text = out.str();
+    job.outputs.clear();
+    job.outputs.emplace_back(std::vector<uint8_t>(text.begin(), text.end()));
+}
+
+void ProtocolMetrics::log_summary() const {
+    const uint32_t processed = processed_.load(std::memory_order_relaxed);
+    const uint32_t errors = errors_.load(std::memory_order_relaxed);
+    const uint64_t total_ns = total_ns_.load(std::memory_order_relaxed);
+    if (!processed && !errors) {
+        return;
+    }
+    const double avg_ms = processed ? (total_ns / double(processed)) / 1e6 : 0.0;
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(2);
+    summary << "Protocol v2 summary: processed=" << processed
+            << ", errors=" << errors
+            << ", avg_latency_ms=" << avg_ms;
+    const LatencyHistogram::Snapshot ok_latency = latency_by_status_[0].snapshot();
+    if (ok_latency.count > 0) {
+        summary << ", p50_ms=" << ok_latency.percentile(0.50) / 1e6
+                << ", p99_ms=" << ok_latency.percentile(0.99) / 1e6
+                << ", max_ms=" << ok_latency.max_ns / 1e6;
+    }
+    if (cache_enabled_) {
+        summary << ", cache_hits=" << cache_hits_.load(std::memory_order_relaxed)
+                << ", cache_coalesced=" << cache_shared_.load(std::memory_order_relaxed)
+                << ", cache_misses=" << cache_misses_.load(std::memory_order_relaxed);
+    }
+    logger::info(summary.str());
+}
+
+void ProtocolMetrics::mark_ready() {
+    ready_ms_.store(process_clock::elapsed_ms(), std::memory_order_relaxed);
+}
+
+std::string startup_report(const ModelRegistry& models, double ready_ms) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"ready_ms\":" << ready_ms << ",\"models\":[";
+    bool first = true;
+    for (const auto& [key, timings] : models.init_timings()) {
+        out << (first ? "" : ",") << "{\"key\":";
+        write_json_string(out, key);
+        out << ",\"load_ms\":" << timings.load_ms << ",\"warmup_ms\":" << timings.warmup_ms << '}';
+        first = false;
+    }
+    out << "]}";
+    return out.str();
+}
+
+bool write_job_response(int fd, const RequestJob& job) {
+    const bool written = job_response_frame(job).write_to(fd);
+    if (!written) {
+        logger::error("Failed to write protocol v2 response for request_id=" + std::to_string(job.request_id));
+    }
+    return written;
+}
+
+bool write_job_item(int fd, RequestJob& job, StreamedItem& item) {
+    const uint32_t index = item.index;
+    const bool written = job_item_frame(job, item).write_to(fd);
+    if (!written) {
+        logger::error("Failed to write protocol v2 stream item for request_id=" +
+                      std::to_string(job.request_id) + " index=" + std::to_string(index));
+    }
+    return written;
+}
+
+PipelineConfig pipeline_config_from(const Options& opts) {
+    PipelineConfig config;
+    config.decode_threads = static_cast<size_t>(opts.decode_threads);
+    config.encode_threads = static_cast<size_t>(opts.encode_threads);
+    config.queue_capacity = static_cast<size_t>(opts.queue_capacity);
+    config.max_in_flight = static_cast<size_t>(opts.max_in_flight);
+    config.out_of_order = opts.out_of_order;
+    config.priority_aging = std::chrono::milliseconds(opts.priority_aging_ms);
+    config.cache.memory_bytes = static_cast<size_t>(opts.cache_memory_mb) * 1024u * 1024u;
+    config.cache.directory = opts.cache_dir;
+    config.cache.disk_bytes = static_cast<size_t>(opts.cache_disk_mb) * 1024u * 1024u;
+    config.memory_budget = opts.memory_budget_mb > 0 ? static_cast<uint64_t>(opts.memory_budget_mb) * 1024u * 1024u
+                                                     : MemoryBudget::default_budget();
+    if (opts.encoder_effort == "auto") {
+        config.encoder_effort = protocol_v2::EncoderEffort::Auto;
+    } else if (opts.encoder_effort == "fast") {
+        config.encoder_effort = protocol_v2::EncoderEffort::Fast;
+    } else if (opts.encoder_effort == "best") {
+        config.encoder_effort = protocol_v2::EncoderEffort::Best;
+    }
+    config.atlas_window = std::chrono::milliseconds(opts.atlas_window_ms);
+    config.atlas_max_image = opts.atlas_max_image;
+    // Atlas neighbours make outputs depend on packing (the pipeline adds the
+    // engine's tiling and precision).
+    if (opts.atlas_window_ms > 0) {
+        config.cache_namespace = "|atlas" + std::to_string(opts.atlas_max_image);
+    }
+    return config;
+}
+
+} // namespace keep_alive
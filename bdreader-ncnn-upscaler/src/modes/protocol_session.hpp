@@ -0,0 +1,150 @@
+#pragma once
+
+#include "../model_registry.hpp"
+#include "../options.hpp"
+#include "../protocol_v2.hpp"
+#include "../protocol_writer.hpp"
+#include "../utils/frame_buffer_pool.hpp"
+#include "../utils/latency_histogram.hpp"
+#include "../utils/shm_buffers.hpp"
+#include "job_frames.hpp"
+#include "keep_alive_pipeline.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace keep_alive {
+
+/// Largest protocol v2 frame read whole (length prefix value). Requests above
+/// kIncrementalFrameBytes are read image by image instead (IncrementalFrame)
+/// and are not bound by it.
+constexpr uint32_t kMaxMessageBytes = 64u * 1024u * 1024u;
+
+/// Turns protocol v2 frames from one client into pipeline jobs.
+///
+/// Shared by the stdin and socket front-ends: they only differ in how frames
+/// are read and where responses go. One instance per client, since it owns
+/// the shared memory buffers that client registered.
+///
+/// Every frame yields a job to submit, so responses keep frame order: a
+/// request, or a response-only job (rejections, buffer registration and
+/// cancel acks, Stats answers) carrying a status and no request. A Cancel
+/// takes effect as soon as it is parsed, before its ack is submitted; a Stats
+/// snapshot is taken when it is answered.
+class RequestIntake {
+public:
+    /// Returns the oldest file descriptor received with the client's frames
+    /// (caller owns it), or -1.
+    using FdSource = std::function<int()>;
+
+    /// `fds` is empty when the transport cannot carry file descriptors
+    /// (stdin is not a Unix socket).
+    RequestIntake(const Options& opts, FdSource fds);
+
+    /// Job answering a frame without looking at its body.
+    std::shared_ptr<RequestJob> respond(uint32_t request_id,
+                                        protocol_v2::ProtocolStatus status,
+                                        const std::string& message,
+                                        const std::chrono::steady_clock::time_point& start,
+                                        size_t bytes_in,
+                                        bool stream = false) const;
+
+    /// Parse a complete frame (header included, length prefix excluded).
+    /// Requests keep `frame` alive as their image storage.
+    std::shared_ptr<RequestJob> build(std::shared_ptr<FrameBuffer> frame,
+                                      const std::chrono::steady_clock::time_point& start);
+
+    /// Job for a Request / StreamRequest read piece by piece, once `parser` is
+    /// past its fields: a `receiving` job whose images the reader fills in, or
+    /// a response-only job if the fields were rejected.
+    std::shared_ptr<RequestJob> begin(const protocol_v2::ProtocolHeader& header,
+                                      const protocol_v2::RequestBodyParser& parser,
+                                      const std::chrono::steady_clock::time_point& start,
+                                      size_t message_len);
+
+private:
+    /// Log an accepted request and keep track of it for Cancel.
+    void track(const std::shared_ptr<RequestJob>& job);
+
+    /// RegisterBuffer / ReleaseBuffer; leaves `error` empty on success.
+    void handle_buffer_message(uint32_t msg_type, const FrameBuffer& frame, std::string& error);
+    /// Cancel; leaves `error` empty on success.
+    void handle_cancel(const FrameBuffer& frame, std::string& error);
+
+    const Options& opts_;
+    FdSource fds_;
+    shm::BufferRegistry shared_buffers_;
+    /// Requests handed out by build(), by request_id, for Cancel. Entries
+    /// expire with their job; stale ones are swept as new requests come in.
+    std::unordered_map<uint32_t, std::weak_ptr<RequestJob>> requests_;
+};
+
+/// Request counters plus the --log-protocol / --profiling response lines, and
+/// the snapshot answering Stats frames. record() may be called from any thread.
+class ProtocolMetrics {
+public:
+    explicit ProtocolMetrics(const Options& opts);
+
+    /// Account for a job whose final frame has just been written.
+    void record(const RequestJob& job);
+
+    /// Stats frame (`job.stats`): set its single output to the JSON snapshot of
+    /// these counters and `job.pipeline_snapshot`. No-op for other jobs.
+    void fill_stats(RequestJob& job) const;
+
+    /// Log the "Protocol v2 summary" line (nothing if no frame was answered).
+    void log_summary() const;
+
+    /// The worker is ready to serve (models loaded and warmed up); reported as
+    /// `startup.ready_ms` in Stats, next to `first_response_ms`.
+    void mark_ready();
+    /// Milliseconds from process start to mark_ready(), -1 before it.
+    double ready_ms() const { return ready_ms_.load(std::memory_order_relaxed); }
+
+    uint32_t processed() const { return processed_.load(std::memory_order_relaxed); }
+
+private:
+    const bool log_protocol_;
+    const bool profiling_;
+    const bool cache_enabled_;
+    std::atomic<uint32_t> processed_{0};
+    std::atomic<uint32_t> errors_{0};
+    std::atomic<uint64_t> total_ns_{0};
+    std::atomic<uint64_t> bytes_in_{0};
+    std::atomic<uint64_t> bytes_out_{0};
+    const std::chrono::steady_clock::time_point started_;
+    /// Since process start (process_clock); -1 until set.
+    std::atomic<double> ready_ms_{-1.0};
+    std::atomic<double> first_response_ms_{-1.0};
+    /// End-to-end latency of requests and rejected frames, by ProtocolStatus.
+    std::array<LatencyHistogram, 7> latency_by_status_;
+    std::atomic<uint64_t> cache_hits_{0};
+    std::atomic<uint64_t> cache_shared_{0};
+    std::atomic<uint64_t> cache_misses_{0};
+    /// Compressed outputs per image_io::EncodeEffort: count, bytes, encode time.
+    std::array<std::atomic<uint64_t>, image_io::kEncodeEffortCount> encoded_{};
+    std::array<std::atomic<uint64_t>, image_io::kEncodeEffortCount> encoded_bytes_{};
+    std::array<std::atomic<uint64_t>, image_io::kEncodeEffortCount> encode_ns_{};
+};
+
+/// JSON report of the readiness frame: `{"ready_ms":..,"models":[{"key":..,
+/// "load_ms":..,"warmup_ms":..}]}` (ProtocolMetrics::ready_ms()).
+std::string startup_report(const ModelRegistry& models, double ready_ms);
+
+/// Write the final frame of `job` to `fd` (job_response_frame()).
+bool write_job_response(int fd, const RequestJob& job);
+
+/// Write one streamed item of `job` to `fd` (job_item_frame()).
+bool write_job_item(int fd, RequestJob& job, StreamedItem& item);
+
+/// PipelineConfig from the keep-alive command line options.
+PipelineConfig pipeline_config_from(const Options& opts);
+
+} // namespace keep_alive
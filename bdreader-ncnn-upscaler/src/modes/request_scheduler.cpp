@@ -0,0 +1,88 @@
+#include "request_scheduler.hpp"
+
+#include "keep_alive_pipeline.hpp"
+#include "../utils/image_io.hpp"
+#include "../utils/raw_pixels.hpp"
+
+#include <algorithm>
+#include <tuple>
+
+namespace keep_alive {
+
+namespace {
+
+// Pixels assumed per compressed byte when an image header cannot be probed
+// (JPEG scans and PNG pages usually land between 2 and 10).
+constexpr uint64_t kPixelsPerCompressedByte = 4;
+
+} // namespace
+
+RequestScheduler::RequestScheduler(std::chrono::milliseconds aging)
+    : aging_(std::max(aging, std::chrono::milliseconds(1))) {}
+
+uint64_t RequestScheduler::image_cost(const protocol_v2::RequestOptions& options, const protocol_v2::ImageView& image) {
+    int width = 0;
+    int height = 0;
+    const bool known = options.input == protocol_v2::InputEncoding::RawPixels
+                           ? raw_pixels::dimensions(image.data, image.size, width, height)
+                           : image_io::probe_dimensions(image.data, image.size, width, height);
+    if (known && width > 0 && height > 0) {
+        return static_cast<uint64_t>(width) * static_cast<uint64_t>(height);
+    }
+    return std::max<uint64_t>(1, static_cast<uint64_t>(image.size) * kPixelsPerCompressedByte);
+}
+
+void RequestScheduler::estimate_costs(RequestJob& job) {
+    const auto& images = job.request.images;
+    const auto missing = static_cast<uint64_t>(
+        std::count_if(images.begin(), images.end(), [](const protocol_v2::ImageView& image) { return !image.data; }));
+    job.image_costs.resize(images.size());
+    job.undispatched_cost = 0;
+    for (size_t i = 0; i < images.size(); ++i) {
+        job.image_costs[i] = images[i].data ? image_cost(job.request.options, images[i])
+                                            : std::max<uint64_t>(1, job.unreceived_bytes / missing * kPixelsPerCompressedByte);
+        job.undispatched_cost += job.image_costs[i];
+    }
+}
+
+uint32_t RequestScheduler::effective_class(const RequestJob& job, std::chrono::steady_clock::time_point now) const {
+    const uint32_t base = static_cast<uint32_t>(job.request.options.priority);
+    if (base == 0 || now <= job.start) {
+        return base;
+    }
+    const auto promotions = static_cast<uint64_t>((now - job.start) / aging_);
+    return promotions >= base ? 0 : base - static_cast<uint32_t>(promotions);
+}
+
+RequestScheduler::JobQueue::iterator RequestScheduler::pick(JobQueue& jobs,
+                                                            std::chrono::steady_clock::time_point now) const {
+    return best(jobs, now, false);
+}
+
+RequestScheduler::JobQueue::iterator RequestScheduler::pick_ready(JobQueue& jobs,
+                                                                  std::chrono::steady_clock::time_point now) const {
+    return best(jobs, now, true);
+}
+
+RequestScheduler::JobQueue::iterator RequestScheduler::best(JobQueue& jobs,
+                                                            std::chrono::steady_clock::time_point now,
+                                                            bool ready_only) const {
+    const auto key = [&](const std::shared_ptr<RequestJob>& job) {
+        return std::make_tuple(effective_class(*job, now), job->undispatched_cost, job->sequence);
+    };
+    auto chosen = jobs.end();
+    std::tuple<uint32_t, uint64_t, uint64_t> chosen_key{};
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        if (ready_only && (*it)->next_dispatch >= (*it)->received) {
+            continue;
+        }
+        auto candidate = key(*it);
+        if (chosen == jobs.end() || candidate < chosen_key) {
+            chosen = it;
+            chosen_key = candidate;
+        }
+    }
+    return chosen;
+}
+
+} // namespace keep_alive
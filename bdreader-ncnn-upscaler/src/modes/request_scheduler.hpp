@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../protocol_v2.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace keep_alive {
+
+struct RequestJob;
+
+/// Decides which queued request the pipeline serves next, both when admitting
+/// waiting requests and when handing the next image to the decoders.
+///
+/// Order: priority class (protocol_v2::Priority) first, then the least
+/// estimated work left (shortest job first), then arrival. Work is estimated
+/// in pixels from header-only probes of the input images. To prevent
+/// starvation, a request is promoted one class for every `aging` it has waited
+/// since it was received, so prefetch work eventually runs even under a steady
+/// stream of interactive requests.
+///
+/// Not thread-safe: the pipeline calls it under its dispatch mutex.
+class RequestScheduler {
+public:
+    using JobQueue = std::deque<std::shared_ptr<RequestJob>>;
+
+    explicit RequestScheduler(std::chrono::milliseconds aging);
+
+    /// Fill `job.image_costs` and `job.undispatched_cost`. Reads only image
+    /// headers; unreadable ones are estimated from their compressed size, and
+    /// images not received yet share `job.unreceived_bytes` evenly.
+    static void estimate_costs(RequestJob& job);
+
+    /// Estimated pixels of one image.
+    static uint64_t image_cost(const protocol_v2::RequestOptions& options, const protocol_v2::ImageView& image);
+
+    /// Best job of `jobs` (must not be empty) at `now`.
+    JobQueue::iterator pick(JobQueue& jobs, std::chrono::steady_clock::time_point now) const;
+
+    /// Best job of `jobs` with a received image left to dispatch, or end().
+    JobQueue::iterator pick_ready(JobQueue& jobs, std::chrono::steady_clock::time_point now) const;
+
+    /// Priority class of `job` after aging (0 = most urgent).
+    uint32_t effective_class(const RequestJob& job, std::chrono::steady_clock::time_point now) const;
+
+private:
+    JobQueue::iterator best(JobQueue& jobs, std::chrono::steady_clock::time_point now, bool ready_only) const;
+
+    const std::chrono::milliseconds aging_;
+};
+
+} // namespace keep_alive
@@ -0,0 +1,900 @@
+#include "socket_mode.hpp"
+
+#include "../protocol_v2.hpp"
+#include "../protocol_writer.hpp"
+#include "../utils/fd_io.hpp"
+#include "../utils/frame_buffer_pool.hpp"
+#include "../utils/logger.hpp"
+#include "incremental_frame.hpp"
+#include "keep_alive_pipeline.hpp"
+#include "protocol_session.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using keep_alive::RequestJob;
+using protocol_v2::ProtocolStatus;
+
+// Bytes read per recv() when no frame payload is pending; frames spanning
+// more are received straight into their FrameBuffer.
+constexpr size_t kStagingSize = 64u * 1024u;
+
+// Unanswered frames a client may have beyond its --max-in-flight requests
+// (acks and rejections queued behind a slow request) before it is paused.
+constexpr size_t kMaxPendingReplies = 32;
+
+// Unwritten response bytes above which a client is paused too, until it reads
+// enough of its answers.
+constexpr size_t kOutboxPauseBytes = 16u * 1024u * 1024u;
+
+// A client is disconnected once its unwritten responses exceed this, or when
+// they made no progress for kWriteStallTimeout: memory is not held forever
+// for a client that stopped reading.
+constexpr size_t kMaxOutboxBytes = 256u * 1024u * 1024u;
+constexpr auto kWriteStallTimeout = std::chrono::seconds(30);
+
+// epoll_wait() timeout while some client has unwritten responses, so stalls
+// are noticed without any other event.
+constexpr int kStallCheckMs = 1000;
+
+// epoll tags for the non-client fds; client connections use their id (>= kFirstClientId).
+constexpr uint64_t kListenTag = 0;
+constexpr uint64_t kWakeTag = 1;
+constexpr uint64_t kSignalTag = 2;
+constexpr uint64_t kFirstClientId = 3;
+
+std::string errno_text() {
+    return std::strerror(errno);
+}
+
+/// One accepted client.
+///
+/// Owned by the event loop until its answers are written (and while it is
+/// readable), and by its jobs through RequestJob::context, so the fd stays
+/// open, and its number unused, while answers are still due. The event loop
+/// alone reads, parses and writes the socket, which is never waited on: the
+/// pipeline writer thread only queues answer frames in `outbox`, and the loop
+/// writes what the socket accepts, polling EPOLLOUT for the rest.
+class Connection {
+public:
+    Connection(int fd, uint64_t id, const Options& opts)
+        : fd(fd),
+          id(id),
+          intake(opts, [this]() { return take_received_fd(); }),
+          frame_pool(FrameBufferPool::create(static_cast<size_t>(opts.max_in_flight) + 2, keep_alive::kMaxMessageBytes)),
+          staging(new uint8_t[kStagingSize]) {}
+
+    ~Connection() {
+        for (int received : received_fds) {
+            ::close(received);
+        }
+        ::close(fd);
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    int take_received_fd() {
+        if (received_fds.empty()) {
+            return -1;
+        }
+        const int received = received_fds.front();
+        received_fds.pop_front();
+        return received;
+    }
+
+    const int fd;
+    const uint64_t id;
+
+    // ---- Event loop thread ----
+    keep_alive::RequestIntake intake;
+    std::shared_ptr<FrameBufferPool> frame_pool;
+    std::deque<int> received_fds;
+    std::unique_ptr<uint8_t[]> staging;
+    size_t staging_begin = 0;
+    size_t staging_end = 0;
+    uint8_t length_bytes[4] = {};
+    size_t length_filled = 0;
+    std::shared_ptr<FrameBuffer> frame;  // Frame being received
+    size_t frame_filled = 0;
+    std::unique_ptr<keep_alive::IncrementalFrame> incremental;  // Large frame being received
+    std::chrono::steady_clock::time_point frame_start{};
+    size_t discard_left = 0;  // Bytes of a rejected frame still to skip
+    uint32_t epoll_events = 0;  // Registered interest (0 = not in epoll)
+    bool reading = true;        // Cleared once closed for reading; answers may still be due
+    bool held = false;          // Paused with frames still staged: not polled for input
+
+    // ---- Shared with the writer thread ----
+    struct Pending {
+        std::shared_ptr<RequestJob> job;
+        bool done = false;
+        bool counted = false;  // Counted in `requests`
+    };
+    std::mutex mutex;
+    std::deque<Pending> pending;  // Submitted, not yet answered, in frame order
+    size_t requests = 0;          // Entries of `pending` that carry work
+    size_t answering = 0;         // Taken from `pending`, frame not yet in `outbox`
+    bool paused = false;          // Reading stopped until an answer frees a slot
+    std::deque<protocol_v2::FrameWriter> outbox;  // Frames not fully written, oldest first
+    size_t outbox_bytes = 0;                      // Their unwritten bytes
+    std::chrono::steady_clock::time_point last_write{};  // Last progress of a non-empty outbox
+    bool flush_queued = false;  // In SocketServer::flush_queue_
+    bool dropped = false;       // Disconnected: further answers are discarded
+    std::string drop_reason;    // Why, when the writer thread decided it
+};
+
+class SocketServer {
+public:
+    SocketServer(BaseEngine* engine, const Options& opts)
+        : opts_(opts),
+          max_in_flight_per_client_(static_cast<size_t>(opts.max_in_flight)),
+          metrics_(opts),
+          models_(engine, opts),
+          pipeline_(&models_,
+                    opts.output_format,
+                    pipeline_config(opts),
+                    [this](RequestJob& job) { complete(job); },
+                    [this](RequestJob& job, keep_alive::StreamedItem& item) {
+                        auto connection = std::static_pointer_cast<Connection>(job.context);
+                        queue_frame(connection, keep_alive::job_item_frame(job, item), false);
+                    }) {}
+
+    ~SocketServer() {
+        // Answer whatever is still in flight, then drop the clients.
+        pipeline_.shutdown();
+        finish_writes();
+        connections_.clear();
+        closing_.clear();
+        for (int fd : {epoll_fd_, wake_fd_, signal_fd_, listen_fd_}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        if (bound_) {
+            ::unlink(opts_.socket_path.c_str());
+        }
+        metrics_.log_summary();
+    }
+
+    bool start(const sigset_t& stop_signals);
+    void run();
+
+private:
+    static keep_alive::PipelineConfig pipeline_config(const Options& opts) {
+        keep_alive::PipelineConfig config = keep_alive::pipeline_config_from(opts);
+        // Clients are bounded individually (see at_capacity()); the pipeline takes
+        // whatever they send, in completion order, and each connection
+        // restores its own frame order unless --out-of-order. submit() must
+        // never block the event loop: with the memory budget a client's
+        // requests may all wait for admission, and an admitted request still
+        // receiving images needs the loop to read them. So no read-ahead
+        // bound here; over_limit() caps each client's waiting requests.
+        config.max_in_flight = static_cast<size_t>(opts.max_in_flight) * static_cast<size_t>(opts.max_clients);
+        config.read_ahead = 0;
+        config.out_of_order = true;
+        return config;
+    }
+
+    bool add_to_epoll(int fd, uint64_t tag);
+    /// Register what the client waits for: input unless closed for reading or
+    /// held, output when `want_write`.
+    bool set_interest(Connection& client, bool want_write);
+    std::shared_ptr<Connection> find_client(uint64_t id) const;
+    void accept_clients();
+    void serve(const std::shared_ptr<Connection>& connection);
+    /// Consume staged bytes into frames. Returns false once the client asked
+    /// to close (zero-length frame).
+    bool drain_staging(const std::shared_ptr<Connection>& connection);
+    /// Stop reading from a client; it is destroyed once its answers are out.
+    void close_client(const std::shared_ptr<Connection>& connection, const std::string& reason);
+    /// Disconnect a client now (write failed, or too slow reading): its queued
+    /// and future answers are discarded and its requests cancelled.
+    void drop_client(const std::shared_ptr<Connection>& connection, const std::string& reason);
+    void resume_clients();
+
+    /// Any thread: append `frame` to the client's outbox and have the event
+    /// loop write it. `answer`: the frame answers an entry taken from `pending`.
+    void queue_frame(const std::shared_ptr<Connection>& connection, protocol_v2::FrameWriter frame, bool answer);
+    /// Write what the client's socket accepts now; poll EPOLLOUT for the rest.
+    void flush(const std::shared_ptr<Connection>& connection);
+    void flush_queued_clients();
+    /// Drop clients whose unwritten answers made no progress for kWriteStallTimeout.
+    void drop_stalled_clients();
+    /// After the pipeline shut down: write the last answers out, still
+    /// subject to the stall timeout.
+    void finish_writes();
+
+    /// True (and the client paused) when it has max_in_flight requests running
+    /// plus one read ahead, too many unanswered frames overall, or more than
+    /// kOutboxPauseBytes of answers it has not read yet. The read-ahead
+    /// request keeps the socket readable so a Cancel still gets through.
+    static bool over_limit(const Connection& connection, size_t max_in_flight);
+    bool at_capacity(Connection& connection);
+    void submit(const std::shared_ptr<Connection>& connection, std::shared_ptr<RequestJob> job);
+    /// Pipeline writer thread: answer `job` and any later frames it was holding up.
+    void complete(RequestJob& job);
+
+    const Options& opts_;
+    const size_t max_in_flight_per_client_;
+    keep_alive::ProtocolMetrics metrics_;
+    ModelRegistry models_;  // Outlives the pipeline, which uses it until shutdown
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    int signal_fd_ = -1;
+    bool bound_ = false;
+    uint64_t next_client_id_ = kFirstClientId;
+    std::unordered_map<uint64_t, std::shared_ptr<Connection>> connections_;
+    std::unordered_map<uint64_t, std::shared_ptr<Connection>> closing_;  // Closed for reading, answers still due
+    size_t write_blocked_ = 0;  // Clients polled for EPOLLOUT
+    std::mutex flush_mutex_;
+    std::vector<std::shared_ptr<Connection>> flush_queue_;  // Clients with newly queued frames
+    // Last member: its threads call back into the members above until shutdown().
+    keep_alive::Pipeline pipeline_;
+};
+
+bool SocketServer::start(const sigset_t& stop_signals) {
+    // Before listening: a client that can connect finds the models warm.
+    models_.preload(opts_.preload_models);
+
+    const std::string& path = opts_.socket_path;
+    struct sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        logger::error("Socket path too long (max " + std::to_string(sizeof(address.sun_path) - 1) + " bytes): " + path);
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        logger::error("socket() failed: " + errno_text());
+        return false;
+    }
+
+    // Replace a stale socket file left by a previous run, but never steal the
+    // path from a live server.
+    struct stat st{};
+    if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool live = probe >= 0 &&
+                          ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        if (probe >= 0) {
+            ::close(probe);
+        }
+        if (live) {
+            logger::error("Another server is already listening on " + path);
+            return false;
+        }
+        ::unlink(path.c_str());
+    }
+
+    if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        logger::error("bind(" + path + ") failed: " + errno_text());
+        return false;
+    }
+    bound_ = true;
+    if (::listen(listen_fd_, SOMAXCONN) != 0) {
+        logger::error("listen(" + path + ") failed: " + errno_text());
+        return false;
+    }
+
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    signal_fd_ = ::signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0 || signal_fd_ < 0) {
+        logger::error("Failed to create event loop descriptors: " + errno_text());
+        return false;
+    }
+    if (!add_to_epoll(listen_fd_, kListenTag) || !add_to_epoll(wake_fd_, kWakeTag) ||
+        !add_to_epoll(signal_fd_, kSignalTag)) {
+        return false;
+    }
+    metrics_.mark_ready();
+    return true;
+}
+
+bool SocketServer::add_to_epoll(int fd, uint64_t tag) {
+    struct epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = tag;
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+        logger::error("epoll_ctl(ADD) failed: " + errno_text());
+        return false;
+    }
+    return true;
+}
+
+bool SocketServer::set_interest(Connection& client, bool want_write) {
+    uint32_t events = 0;
+    if (client.reading && !client.held) {
+        events |= EPOLLIN;
+    }
+    if (want_write) {
+        events |= EPOLLOUT;
+    }
+    if (events == client.epoll_events) {
+        return true;
+    }
+    struct epoll_event event{};
+    event.events = events;
+    event.data.u64 = client.id;
+    const int op = client.epoll_events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if (::epoll_ctl(epoll_fd_, op, client.fd, &event) != 0) {
+        logger::error("epoll_ctl() failed for client " + std::to_string(client.id) + ": " + errno_text());
+        return false;
+    }
+    if ((events & EPOLLOUT) && !(client.epoll_events & EPOLLOUT)) {
+        ++write_blocked_;
+    } else if (!(events & EPOLLOUT) && (client.epoll_events & EPOLLOUT)) {
+        --write_blocked_;
+    }
+    client.epoll_events = events;
+    return true;
+}
+
+std::shared_ptr<Connection> SocketServer::find_client(uint64_t id) const {
+    auto it = connections_.find(id);
+    if (it != connections_.end()) {
+        return it->second;
+    }
+    it = closing_.find(id);
+    return it != closing_.end() ? it->second : nullptr;
+}
+
+void SocketServer::run() {
+    logger::info("Protocol v2 socket server listening on " + opts_.socket_path +
+                 " (max_clients=" + std::to_string(opts_.max_clients) +
+                 ", max_in_flight per client=" + std::to_string(max_in_flight_per_client_) + ")");
+
+    constexpr int kMaxEvents = 64;
+    struct epoll_event events[kMaxEvents];
+    while (true) {
+        const int ready = ::epoll_wait(epoll_fd_, events, kMaxEvents, write_blocked_ > 0 ? kStallCheckMs : -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logger::error("epoll_wait() failed: " + errno_text());
+            return;
+        }
+        for (int i = 0; i < ready; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == kListenTag) {
+                accept_clients();
+            } else if (tag == kWakeTag) {
+                uint64_t count = 0;
+                while (::read(wake_fd_, &count, sizeof(count)) > 0) {
+                }
+                flush_queued_clients();
+                resume_clients();
+            } else if (tag == kSignalTag) {
+                struct signalfd_siginfo info{};
+                if (::read(signal_fd_, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+                    logger::info("Received signal " + std::to_string(info.ssi_signo) + "; shutting down");
+                }
+                return;
+            } else {
+                // The client may have been closed earlier in this batch.
+                std::shared_ptr<Connection> connection = find_client(tag);
+                if (!connection) {
+                    continue;
+                }
+                const uint32_t ready_events = events[i].events;
+                if (ready_events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                    flush(connection);
+                    resume_clients();
+                }
+                if (connection->reading && (ready_events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                    serve(connection);
+                }
+            }
+        }
+        if (write_blocked_ > 0) {
+            drop_stalled_clients();
+        }
+    }
+}
+
+void SocketServer::accept_clients() {
+    while (true) {
+        const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                logger::error("accept() failed: " + errno_text());
+            }
+            return;
+        }
+        if (connections_.size() >= static_cast<size_t>(opts_.max_clients)) {
+            logger::warn("Rejecting client: --max-clients=" + std::to_string(opts_.max_clients) + " reached");
+            ::close(fd);
+            continue;
+        }
+        const uint64_t id = next_client_id_++;
+        auto connection = std::make_shared<Connection>(fd, id, opts_);
+        if (!set_interest(*connection, false)) {
+            continue;  // The connection closes the fd
+        }
+        connections_.emplace(id, connection);
+        if (opts_.ready_frame) {
+            queue_frame(connection, protocol_v2::ready_frame(keep_alive::startup_report(models_, metrics_.ready_ms())),
+                        false);
+        }
+        logger::info("Client " + std::to_string(id) + " connected (" + std::to_string(connections_.size()) + " open)");
+    }
+}
+
+bool SocketServer::over_limit(const Connection& connection, size_t max_in_flight) {
+    return connection.requests > max_in_flight ||
+           connection.pending.size() >= max_in_flight + kMaxPendingReplies ||
+           connection.outbox_bytes > kOutboxPauseBytes;
+}
+
+bool SocketServer::at_capacity(Connection& connection) {
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    if (!over_limit(connection, max_in_flight_per_client_)) {
+        return false;
+    }
+    connection.paused = true;
+    return true;
+}
+
+void SocketServer::submit(const std::shared_ptr<Connection>& connection, std::shared_ptr<RequestJob> job) {
+    job->context = connection;
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->pending.push_back({job, false, job->has_request});
+        if (job->has_request) {
+            ++connection->requests;
+        }
+    }
+    pipeline_.submit(std::move(job));
+}
+
+void SocketServer::serve(const std::shared_ptr<Connection>& connection) {
+    Connection& client = *connection;
+    while (true) {
+        if (!drain_staging(connection)) {
+            close_client(connection, "sent a shutdown frame");
+            return;
+        }
+        if (client.staging_begin < client.staging_end) {
+            // Paused with frames still staged: stop polling until resume_clients().
+            client.held = true;
+            set_interest(client, client.epoll_events & EPOLLOUT);
+            return;
+        }
+
+        // Receive straight into the pending frame, overflowing into staging.
+        struct iovec iov[2];
+        int count = 0;
+        size_t direct = 0;
+        if (client.frame) {
+            direct = client.frame->size() - client.frame_filled;
+            iov[count++] = {client.frame->data() + client.frame_filled, direct};
+        } else if (client.incremental) {
+            if (uint8_t* target = client.incremental->direct_buffer(direct)) {
+                iov[count++] = {target, direct};
+            }
+        }
+        iov[count++] = {client.staging.get(), kStagingSize};
+        client.staging_begin = 0;
+        client.staging_end = 0;
+
+        const ssize_t got = fd_io::receive(client.fd, iov, count, client.received_fds);
+        if (got == 0) {
+            close_client(connection, "disconnected");
+            return;
+        }
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                close_client(connection, "read failed: " + errno_text());
+            }
+            return;
+        }
+
+        const size_t into_frame = std::min(static_cast<size_t>(got), direct);
+        client.staging_end = static_cast<size_t>(got) - into_frame;
+        if (into_frame > 0 && client.incremental) {
+            client.incremental->direct_read(into_frame);
+            if (client.incremental->complete()) {
+                client.incremental.reset();
+            }
+        } else if (into_frame > 0) {
+            client.frame_filled += into_frame;
+            if (client.frame_filled == client.frame->size()) {
+                submit(connection, client.intake.build(std::move(client.frame), client.frame_start));
+                client.frame.reset();
+            }
+        }
+    }
+}
+
+bool SocketServer::drain_staging(const std::shared_ptr<Connection>& connection) {
+    Connection& client = *connection;
+    while (client.staging_begin < client.staging_end) {
+        const uint8_t* data = client.staging.get() + client.staging_begin;
+        const size_t available = client.staging_end - client.staging_begin;
+
+        if (client.discard_left > 0) {
+            const size_t skipped = std::min(available, client.discard_left);
+            client.discard_left -= skipped;
+            client.staging_begin += skipped;
+            continue;
+        }
+
+        if (client.frame) {
+            const size_t copied = std::min(available, client.frame->size() - client.frame_filled);
+            std::memcpy(client.frame->data() + client.frame_filled, data, copied);
+            client.frame_filled += copied;
+            client.staging_begin += copied;
+            if (client.frame_filled == client.frame->size()) {
+                submit(connection, client.intake.build(std::move(client.frame), client.frame_start));
+                client.frame.reset();
+            }
+            continue;
+        }
+
+        if (client.incremental) {
+            keep_alive::IncrementalFrame& frame = *client.incremental;
+            size_t copied = frame.wanted();
+            if (copied > 0) {
+                copied = frame.feed(data, available);
+            } else {
+                uint8_t* target = frame.direct_buffer(copied);
+                copied = std::min(available, copied);
+                std::memcpy(target, data, copied);
+                frame.direct_read(copied);
+            }
+            client.staging_begin += copied;
+            if (frame.complete()) {
+                client.incremental.reset();
+            }
+            continue;
+        }
+
+        // Next length prefix. Only start a frame when the client has a free slot.
+        if (client.length_filled == 0 && at_capacity(client)) {
+            return true;
+        }
+        const size_t copied = std::min(available, sizeof(client.length_bytes) - client.length_filled);
+        std::memcpy(client.length_bytes + client.length_filled, data, copied);
+        client.length_filled += copied;
+        client.staging_begin += copied;
+        if (client.length_filled < sizeof(client.length_bytes)) {
+            continue;
+        }
+        client.length_filled = 0;
+        const uint32_t message_len = protocol_v2::decode_u32_le(client.length_bytes);
+        client.frame_start = std::chrono::steady_clock::now();
+
+        if (message_len == 0) {
+            return false;
+        }
+        if (message_len < protocol_v2::kProtocolHeaderSize) {
+            logger::error("Client " + std::to_string(client.id) +
+                          " protocol v2 frame too small: " + std::to_string(message_len));
+            submit(connection, client.intake.respond(0, ProtocolStatus::InvalidFrame, "frame too short for header",
+                                                     client.frame_start, message_len));
+            client.discard_left = message_len;
+            continue;
+        }
+        if (message_len > keep_alive::kIncrementalFrameBytes) {
+            client.incremental = std::make_unique<keep_alive::IncrementalFrame>(
+                message_len, client.frame_start, static_cast<size_t>(opts_.max_batch_items),
+                static_cast<size_t>(opts_.max_frame_mb) << 20, client.intake, pipeline_, client.frame_pool,
+                [this, connection](std::shared_ptr<RequestJob> job) { submit(connection, std::move(job)); });
+            continue;
+        }
+        client.frame = client.frame_pool->acquire(message_len);
+        client.frame_filled = 0;
+    }
+    return true;
+}
+
+void SocketServer::close_client(const std::shared_ptr<Connection>& connection, const std::string& reason) {
+    connection->reading = false;
+    connection->frame.reset();
+    connection->incremental.reset();  // Aborts a request still receiving images
+    connections_.erase(connection->id);
+    closing_.emplace(connection->id, connection);
+    logger::info("Client " + std::to_string(connection->id) + " " + reason + " (" +
+                 std::to_string(connections_.size()) + " open)");
+    flush(connection);  // Forgets the client right away when no answer is due
+}
+
+void SocketServer::drop_client(const std::shared_ptr<Connection>& connection, const std::string& reason) {
+    Connection& client = *connection;
+    if (connections_.erase(client.id) == 0 && closing_.erase(client.id) == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(client.mutex);
+        client.dropped = true;
+        client.outbox.clear();
+        client.outbox_bytes = 0;
+        for (auto& entry : client.pending) {
+            entry.job->cancel.cancel();
+        }
+    }
+    client.reading = false;
+    client.frame.reset();
+    client.incremental.reset();
+    set_interest(client, false);
+    // The fd itself is closed with the last reference, once its jobs are done.
+    ::shutdown(client.fd, SHUT_RDWR);
+    logger::warn("Client " + std::to_string(client.id) + " " + reason + "; disconnected (" +
+                 std::to_string(connections_.size()) + " open)");
+}
+
+void SocketServer::resume_clients() {
+    std::vector<std::shared_ptr<Connection>> resumed;
+    for (auto& entry : connections_) {
+        Connection& client = *entry.second;
+        std::lock_guard<std::mutex> lock(client.mutex);
+        if (client.paused && !over_limit(client, max_in_flight_per_client_)) {
+            client.paused = false;
+            resumed.push_back(entry.second);
+        }
+    }
+    // A paused client was taken out of the input poll with frames still
+    // staged: handle those first, then poll its socket again.
+    for (auto& connection : resumed) {
+        connection->held = false;
+        if (connection->reading && set_interest(*connection, connection->epoll_events & EPOLLOUT)) {
+            serve(connection);
+        }
+    }
+}
+
+void SocketServer::queue_frame(const std::shared_ptr<Connection>& connection,
+                               protocol_v2::FrameWriter frame,
+                               bool answer) {
+    Connection& client = *connection;
+    const bool valid = frame.finish();
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(client.mutex);
+        if (answer) {
+            --client.answering;
+        }
+        if (client.dropped) {
+            return;
+        }
+        if (!valid) {
+            // Nothing to send, but a closing client may now be done.
+        } else if (!client.outbox.empty() && client.outbox_bytes + frame.unwritten() > kMaxOutboxBytes) {
+            client.dropped = true;
+            client.drop_reason = "left more than " + std::to_string(kMaxOutboxBytes >> 20) + " MiB of responses unread";
+            client.outbox.clear();
+            client.outbox_bytes = 0;
+        } else {
+            if (client.outbox.empty()) {
+                client.last_write = std::chrono::steady_clock::now();
+            }
+            client.outbox_bytes += frame.unwritten();
+            client.outbox.push_back(std::move(frame));
+        }
+        wake = !client.flush_queued;
+        client.flush_queued = true;
+    }
+    if (!wake) {
+        return;  // Already queued, the event loop has a wake-up pending
+    }
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex_);
+        flush_queue_.push_back(connection);
+    }
+    const uint64_t one = 1;
+    if (::write(wake_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        logger::error("Failed to wake the socket event loop: " + errno_text());
+    }
+}
+
+void SocketServer::flush(const std::shared_ptr<Connection>& connection) {
+    Connection& client = *connection;
+    std::string failure;
+    bool want_write = false;
+    bool finished = false;
+    {
+        // Only non-blocking writes happen under the lock.
+        std::lock_guard<std::mutex> lock(client.mutex);
+        client.flush_queued = false;
+        if (client.dropped) {
+            failure = client.drop_reason;
+        }
+        while (failure.empty() && !client.outbox.empty()) {
+            protocol_v2::FrameWriter& frame = client.outbox.front();
+            const size_t before = frame.unwritten();
+            if (!frame.write_available(client.fd)) {
+                failure = "write failed: " + errno_text();
+                break;
+            }
+            if (frame.unwritten() < before) {
+                client.outbox_bytes -= before - frame.unwritten();
+                client.last_write = std::chrono::steady_clock::now();
+            }
+            if (frame.unwritten() > 0) {
+                break;  // Socket full
+            }
+            client.outbox.pop_front();
+        }
+        want_write = !client.outbox.empty();
+        finished = !client.reading && client.pending.empty() && client.answering == 0 && !want_write;
+    }
+    if (!failure.empty()) {
+        drop_client(connection, failure);
+        return;
+    }
+    set_interest(client, want_write);
+    if (finished) {
+        closing_.erase(client.id);
+    }
+}
+
+void SocketServer::flush_queued_clients() {
+    std::vector<std::shared_ptr<Connection>> queued;
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex_);
+        queued.swap(flush_queue_);
+    }
+    for (auto& connection : queued) {
+        // Dropped clients are forgotten; their answers were discarded.
+        if (find_client(connection->id) == connection) {
+            flush(connection);
+        }
+    }
+}
+
+void SocketServer::drop_stalled_clients() {
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<Connection>> stalled;
+    for (const auto* clients : {&connections_, &closing_}) {
+        for (const auto& entry : *clients) {
+            Connection& client = *entry.second;
+            if (!(client.epoll_events & EPOLLOUT)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(client.mutex);
+            if (now - client.last_write > kWriteStallTimeout) {
+                stalled.push_back(entry.second);
+            }
+        }
+    }
+    for (auto& connection : stalled) {
+        drop_client(connection, "read none of its responses for " +
+                                    std::to_string(std::chrono::duration_cast<std::chrono::seconds>(kWriteStallTimeout).count()) + " s");
+    }
+}
+
+void SocketServer::finish_writes() {
+    if (epoll_fd_ < 0) {
+        return;
+    }
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, signal_fd_, nullptr);
+    std::vector<std::shared_ptr<Connection>> open;
+    for (auto& entry : connections_) {
+        open.push_back(entry.second);
+    }
+    for (auto& connection : open) {
+        close_client(connection, "closed for shutdown");
+    }
+    flush_queued_clients();
+
+    constexpr int kMaxEvents = 64;
+    struct epoll_event events[kMaxEvents];
+    while (write_blocked_ > 0) {
+        const int ready = ::epoll_wait(epoll_fd_, events, kMaxEvents, kStallCheckMs);
+        if (ready < 0 && errno != EINTR) {
+            logger::error("epoll_wait() failed: " + errno_text());
+            return;
+        }
+        for (int i = 0; i < ready; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == kWakeTag) {
+                uint64_t count = 0;
+                while (::read(wake_fd_, &count, sizeof(count)) > 0) {
+                }
+                flush_queued_clients();
+            } else if (std::shared_ptr<Connection> connection = find_client(tag)) {
+                flush(connection);
+            }
+        }
+        drop_stalled_clients();
+    }
+}
+
+void SocketServer::complete(RequestJob& job) {
+    auto connection = std::static_pointer_cast<Connection>(job.context);
+    std::vector<std::shared_ptr<RequestJob>> ready;
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        auto& pending = connection->pending;
+        auto it = std::find_if(pending.begin(), pending.end(),
+                               [&job](const Connection::Pending& entry) { return entry.job.get() == &job; });
+        if (it == pending.end()) {
+            return;
+        }
+        // Count by `counted`: admission may have cleared has_request since.
+        if (opts_.out_of_order) {
+            connection->requests -= it->counted ? 1 : 0;
+            ready.push_back(std::move(it->job));
+            pending.erase(it);
+        } else {
+            it->done = true;
+            while (!pending.empty() && pending.front().done) {
+                connection->requests -= pending.front().counted ? 1 : 0;
+                ready.push_back(std::move(pending.front().job));
+                pending.pop_front();
+            }
+        }
+        connection->answering += ready.size();
+    }
+
+    // Queuing wakes the event loop, which also resumes a paused client.
+    for (auto& done : ready) {
+        metrics_.fill_stats(*done);
+        protocol_v2::FrameWriter frame = keep_alive::job_response_frame(*done);
+        metrics_.record(*done);
+        // Keep only the outputs with the frame; moving the vector leaves the
+        // images where the frame references them.
+        frame.hold(std::make_shared<std::vector<image_io::EncodedImage>>(std::move(done->outputs)));
+        done->context.reset();
+        queue_frame(connection, std::move(frame), true);
+    }
+}
+
+} // namespace
+
+int run_socket_mode(BaseEngine* engine, const Options& opts) {
+    logger::info("Running socket mode");
+    if (!engine) {
+        logger::error("Engine missing");
+        return 1;
+    }
+
+    // Block the stop signals before the pipeline threads start (they inherit
+    // the mask) so they are only ever delivered through the signalfd.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    if (::pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr) != 0) {
+        logger::error("Failed to block SIGINT/SIGTERM");
+        return 1;
+    }
+    // A client hanging up early must not kill the server mid-write.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    SocketServer server(engine, opts);
+    if (!server.start(stop_signals)) {
+        return 1;
+    }
+    server.run();
+    return 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "../options.hpp"
+#include "../engines/base_engine.hpp"
+
+/// Serve protocol v2 on the Unix socket `opts.socket_path` until SIGINT/SIGTERM.
+int run_socket_mode(BaseEngine* engine, const Options& opts);
@@ -1,202 +1,74 @@
 #include "stdin_mode.hpp"
 
+#include "../protocol_writer.hpp"
+#include "../utils/fd_frame_reader.hpp"
+#include "../utils/fd_io.hpp"
+#include "../utils/frame_buffer_pool.hpp"
 #include "../utils/logger.hpp"
+#include "incremental_frame.hpp"
+#include "keep_alive_pipeline.hpp"
+#include "protocol_session.hpp"
 #include "protocol_v2.hpp"
 
 #include <algorithm>
-#include <array>
-#include <atomic>
 #include <chrono>
-#include <cstring>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include <memory>
 #include <string>
+#include <unistd.h>
 #include <vector>
 
-namespace {
-std::vector<uint8_t> read_all_stream(std::istream& stream) {
-    std::vector<uint8_t> buffer;
-    std::array<char, 4096> chunk;
-    while (stream.read(chunk.data(), chunk.size())) {
-        buffer.insert(buffer.end(), chunk.begin(), chunk.end());
-    }
-    buffer.insert(buffer.end(), chunk.begin(), chunk.begin() + stream.gcount());
-    return buffer;
-}
-
-using namespace protocol_v2;
-
-// Read exact number of bytes from stdin
-bool read_exact(std::istream& stream, uint8_t* buffer, size_t size) {
-    size_t total_read = 0;
-    while (total_read < size) {
-        stream.read(reinterpret_cast<char*>(buffer + total_read), size - total_read);
-        if (stream.eof() || stream.fail()) {
-            return false;
-        }
-        total_read += stream.gcount();
-    }
-    return true;
-}
-
-// Read uint32_t in little-endian
-bool read_u32(std::istream& stream, uint32_t& value) {
-    uint8_t bytes[4];
-    if (!read_exact(stream, bytes, 4)) {
-        return false;
-    }
-    value = static_cast<uint32_t>(bytes[0]) |
-            (static_cast<uint32_t>(bytes[1]) << 8) |
-            (static_cast<uint32_t>(bytes[2]) << 16) |
-            (static_cast<uint32_t>(bytes[3]) << 24);
-    return true;
-}
-
-// Write uint32_t in little-endian
-void write_u32(std::ostream& stream, uint32_t value) {
-    uint8_t bytes[4];
-    bytes[0] = value & 0xFF;
-    bytes[1] = (value >> 8) & 0xFF;
-    bytes[2] = (value >> 16) & 0xFF;
-    bytes[3] = (value >> 24) & 0xFF;
-    stream.write(reinterpret_cast<const char*>(bytes), 4);
-}
-
-void write_protocol_response(std::ostream& stream,
-                             uint32_t request_id,
-                             ProtocolStatus status,
-                             const std::string& error_message,
-                             const std::vector<std::vector<uint8_t>>& outputs) {
-    const uint32_t error_len = static_cast<uint32_t>(error_message.size());
-    uint32_t payload_bytes = 4 + 4 + 4 + error_len + 4;
-    uint32_t outputs_bytes = 0;
-    for (const auto& output : outputs) {
-        outputs_bytes += 4 + static_cast<uint32_t>(output.size());
-    }
-    payload_bytes += outputs_bytes;
-
-    write_u32(stream, payload_bytes);
-    write_u32(stream, request_id);
-    write_u32(stream, static_cast<uint32_t>(status));
-    write_u32(stream, error_len);
-    if (error_len > 0) {
-        stream.write(error_message.data(), error_len);
-    }
-    write_u32(stream, static_cast<uint32_t>(outputs.size()));
-    for (const auto& output : outputs) {
-        write_u32(stream, static_cast<uint32_t>(output.size()));
-        if (!output.empty()) {
-            stream.write(reinterpret_cast<const char*>(output.data()), output.size());
-        }
-    }
-    stream.flush();
-}
-
-void write_protocol_error(std::ostream& stream,
-                          uint32_t request_id,
-                          ProtocolStatus status,
-                          const std::string& message) {
-    write_protocol_response(stream, request_id, status, message, {});
-}
-
-struct ProtocolMetrics {
-    std::atomic<uint32_t> processed{0};
-    std::atomic<uint32_t> errors{0};
-    std::atomic<uint64_t> total_ns{0};
-};
-
-bool discard_bytes(std::istream& stream, size_t bytes_to_discard) {
-    constexpr size_t kChunk = 4096;
-    std::array<uint8_t, kChunk> buffer{};
-    while (bytes_to_discard > 0) {
-        const size_t chunk = std::min(bytes_to_discard, kChunk);
-        if (!read_exact(stream, buffer.data(), chunk)) {
-            return false;
-        }
-        bytes_to_discard -= chunk;
-    }
-    return true;
-}
-
-} // namespace
-
 int run_keep_alive_protocol_v2(BaseEngine* engine, const Options& opts) {
-    constexpr uint32_t kMaxMessageBytes = 64u * 1024u * 1024u;
-    uint32_t handled = 0;
-    ProtocolMetrics metrics;
-    const bool log_protocol = opts.log_protocol;
+    using keep_alive::kMaxMessageBytes;
+    using protocol_v2::ProtocolStatus;
 
-    // CRITICAL: Disable stdout buffering for protocol mode
-    // When stdout is piped (e.g., from Rust), it becomes fully buffered by default.
-    // This causes responses to be delayed until the buffer fills or the process exits.
-    // Setting unbuffered mode ensures each write is immediately visible to the parent process.
-    if (std::setvbuf(stdout, nullptr, _IONBF, 0) != 0) {
-        logger::warn("Failed to set stdout unbuffered; protocol responses may be delayed");
-    }
-    std::ios::sync_with_stdio(false);  // Disable C++ stream sync for performance
+    keep_alive::ProtocolMetrics metrics(opts);
+
+    // Requests are read from fd 0 through FdFrameReader and responses written to
+    // fd 1 with one gather write each, so neither std::cin nor std::cout (and
+    // their buffering) is involved; nothing sits in a userspace buffer when
+    // stdout is a pipe (e.g. from Rust).
+    FdFrameReader reader(STDIN_FILENO);
+    keep_alive::RequestIntake intake(
+        opts, reader.is_socket() ? keep_alive::RequestIntake::FdSource([&reader]() { return reader.take_received_fd(); })
+                                 : keep_alive::RequestIntake::FdSource());
 
     logger::info("Protocol v2 keep-alive loop started (magic=BRDR version=2, max_message_bytes=" +
-                 std::to_string(kMaxMessageBytes) + ")");
+                 std::to_string(kMaxMessageBytes) + ", incremental above " +
+                 std::to_string(keep_alive::kIncrementalFrameBytes) + ")");
+
+    // Both run on the pipeline writer thread: completions in frame order unless
+    // --out-of-order, stream items as soon as they are encoded.
+    auto complete = [&](keep_alive::RequestJob& job) {
+        metrics.fill_stats(job);
+        keep_alive::write_job_response(STDOUT_FILENO, job);
+        metrics.record(job);
+    };
+    auto stream_item = [&](keep_alive::RequestJob& job, keep_alive::StreamedItem& item) {
+        keep_alive::write_job_item(STDOUT_FILENO, job, item);
+    };
 
-    auto record_outcome = [&](uint32_t request_id,
-                              ProtocolStatus status,
-                              const std::string& error_message,
-                              size_t result_count,
-                              const std::chrono::steady_clock::time_point& start,
-                              size_t bytes_in,
-                              size_t bytes_out,
-                              const RequestPayload* request_info) {
-        const auto elapsed_ns =
-            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
-        metrics.total_ns.fetch_add(elapsed_ns, std::memory_order_relaxed);
-        if (status == ProtocolStatus::Ok) {
-            metrics.processed.fetch_add(1, std::memory_order_relaxed);
-        } else {
-            metrics.errors.fetch_add(1, std::memory_order_relaxed);
-        }
+    const keep_alive::PipelineConfig pipeline_config = keep_alive::pipeline_config_from(opts);
+    ModelRegistry models(engine, opts);
+    models.preload(opts.preload_models);
+    keep_alive::Pipeline pipeline(&models, opts.output_format, pipeline_config, complete, stream_item);
 
-        if (log_protocol) {
-            std::ostringstream oss;
-            oss << "Protocol v2 response request_id=" << request_id
-                << " status=" << static_cast<uint32_t>(status)
-                << " elapsed_ms=" << std::fixed << std::setprecision(2) << (elapsed_ns / 1e6)
-                << " results=" << result_count;
-            if (!error_message.empty()) {
-                oss << " error='" << error_message << "'";
-            }
-            logger::info(oss.str());
-        }
+    metrics.mark_ready();
+    // Nothing else writes to stdout before the first frame is read.
+    if (opts.ready_frame &&
+        !protocol_v2::write_ready(STDOUT_FILENO, keep_alive::startup_report(models, metrics.ready_ms()))) {
+        logger::error("Failed to write the protocol v2 readiness frame");
+    }
 
-        if (opts.profiling) {
-            std::ostringstream oss;
-            oss << std::fixed << std::setprecision(2);
-            oss << "Profiling request_id=" << request_id
-                << " status=" << static_cast<uint32_t>(status);
-            if (request_info) {
-                const auto engine_name = (request_info->engine == Options::EngineType::RealESRGAN)
-                                             ? "RealESRGAN"
-                                             : "RealCUGAN";
-                oss << " engine=" << engine_name
-                    << " quality_or_scale='" << request_info->quality_or_scale << "'"
-                    << " gpu_id=" << request_info->gpu_id
-                    << " batch_count=" << request_info->batch_count;
-            }
-            oss << " results=" << result_count
-                << " bytes_in=" << bytes_in
-                << " bytes_out=" << bytes_out
-                << " elapsed_ms=" << (elapsed_ns / 1e6);
-            if (!error_message.empty()) {
-                oss << " error_len=" << error_message.size() << " error='" << error_message << "'";
-            }
-            logger::info(oss.str());
-        }
-    };
+    // Frames are read into recycled buffers and parsed in place; the buffer goes
+    // back to the pool once the pipeline has decoded every image of the request.
+    auto frame_pool = FrameBufferPool::create(pipeline_config.max_in_flight + pipeline_config.read_ahead + 1, kMaxMessageBytes);
 
     while (true) {
         uint32_t message_len = 0;
-        if (!read_u32(std::cin, message_len)) {
-            logger::info("Protocol v2 stream closed by peer");
+        if (!reader.read_u32(message_len)) {
+            if (reader.eof()) {
+                logger::info("Protocol v2 stream closed by peer");
+            }
             break;
         }
 
@@ -207,211 +79,63 @@ int run_keep_alive_protocol_v2(BaseEngine* engine, const Options& opts) {
             break;
         }
 
-        if (message_len < kProtocolHeaderSize) {
+        if (message_len < protocol_v2::kProtocolHeaderSize) {
             logger::error("Protocol v2 frame too small: " + std::to_string(message_len));
-            if (!discard_bytes(std::cin, message_len)) {
+            if (!reader.discard(message_len)) {
                 logger::error("Failed to discard undersized frame data");
                 break;
             }
-            write_protocol_error(std::cout, 0, ProtocolStatus::InvalidFrame, "frame too short for header");
-            record_outcome(0,
-                           ProtocolStatus::InvalidFrame,
-                           "frame too short for header",
-                           0,
-                           frame_start,
-                           message_len,
-                           0,
-                           nullptr);
-            continue;
-        }
-
-        if (message_len > kMaxMessageBytes) {
-            logger::error("Protocol v2 frame too large: " + std::to_string(message_len));
-            if (!discard_bytes(std::cin, message_len)) {
-                logger::error("Failed to discard oversized frame data");
-                break;
-            }
-            write_protocol_error(std::cout, 0, ProtocolStatus::InvalidFrame, "frame exceeds max size");
-            record_outcome(0,
-                           ProtocolStatus::InvalidFrame,
-                           "frame exceeds max size",
-                           0,
-                           frame_start,
-                           message_len,
-                           0,
-                           nullptr);
-            continue;
-        }
-
-        std::vector<uint8_t> payload(message_len);
-        if (!read_exact(std::cin, payload.data(), payload.size())) {
-            logger::error("Failed to read protocol v2 payload (" + std::to_string(message_len) + " bytes)");
-            break;
-        }
-
-        ProtocolHeader header;
-        std::string header_error;
-        if (!parse_protocol_header(payload.data(), payload.size(), header, header_error)) {
-            logger::error("Protocol header validation failed: " + header_error);
-            write_protocol_error(std::cout, header.request_id, ProtocolStatus::ValidationError, header_error);
-            record_outcome(0,
-                           ProtocolStatus::ValidationError,
-                           header_error,
-                           0,
-                           frame_start,
-                           message_len,
-                           0,
-                           nullptr);
-            continue;
-        }
-
-        if (header.msg_type != static_cast<uint32_t>(ProtocolMessageType::Request)) {
-            const std::string message = "only request frames accepted";
-            logger::error("Protocol v2 message_type=" + std::to_string(header.msg_type) +
-                          " not supported; only request frames are allowed");
-            write_protocol_error(std::cout, header.request_id, ProtocolStatus::ValidationError, message);
-            record_outcome(header.request_id,
-                           ProtocolStatus::ValidationError,
-                           message,
-                           0,
-                           frame_start,
-                           message_len,
-                           0,
-                           nullptr);
-            continue;
-        }
-
-        const size_t body_size = payload.size() - kProtocolHeaderSize;
-        const uint8_t* body_ptr = payload.data() + kProtocolHeaderSize;
-
-        if (body_size == 0) {
-            const std::string message = "request body empty";
-            logger::warn("Protocol v2 request_id=" + std::to_string(header.request_id) + " has empty body");
-            write_protocol_error(std::cout, header.request_id, ProtocolStatus::ValidationError, message);
-            record_outcome(header.request_id,
-                           ProtocolStatus::ValidationError,
-                           message,
-                           0,
-                           frame_start,
-                           message_len,
-                           0,
-                           nullptr);
+            pipeline.submit(intake.respond(0, ProtocolStatus::InvalidFrame, "frame too short for header", frame_start,
+                                           message_len));
             continue;
         }
 
-        RequestPayload request;
-        ProtocolStatus payload_status = ProtocolStatus::ValidationError;
-        if (!parse_request_payload(body_ptr, body_size, opts.max_batch_items, request, header_error, payload_status)) {
-            logger::error("Protocol v2 request_id=" + std::to_string(header.request_id) +
-                          " payload parse failed: " + header_error);
-            write_protocol_error(std::cout, header.request_id, payload_status, header_error);
-            record_outcome(header.request_id,
-                           payload_status,
-                           header_error,
-                           0,
-                           frame_start,
-                           message_len,
-                           0,
-                           nullptr);
-            continue;
-        }
-
-        logger::info("Protocol v2 request_id=" + std::to_string(header.request_id) +
-                     " engine=" + (request.engine == Options::EngineType::RealESRGAN ? "RealESRGAN" : "RealCUGAN") +
-                     " quality_or_scale='" + request.quality_or_scale +
-                     "' gpu_id=" + std::to_string(request.gpu_id) +
-                     " batch_count=" + std::to_string(request.batch_count));
-
-        // The engine instance is configured once from opts at startup; it cannot switch
-        // engine or GPU per-request. Warn (don't fail) if the caller asks for something
-        // different — the request still runs on the configured engine.
-        if (request.engine != opts.engine) {
-            const auto opts_engine = (opts.engine == Options::EngineType::RealESRGAN) ? "RealESRGAN" : "RealCUGAN";
-            const auto req_engine = (request.engine == Options::EngineType::RealESRGAN) ? "RealESRGAN" : "RealCUGAN";
-            logger::warn(std::string("Request engine=") + req_engine +
-                         " differs from configured engine=" + opts_engine +
-                         "; processing with the configured engine");
-        }
-        if (opts.gpu_id != "auto") {
-            try {
-                const int configured_gpu = std::stoi(opts.gpu_id);
-                if (request.gpu_id != configured_gpu) {
-                    logger::warn("Request gpu_id=" + std::to_string(request.gpu_id) +
-                                 " differs from configured gpu_id=" + std::to_string(configured_gpu) +
-                                 "; processing on the configured GPU");
+        if (message_len > keep_alive::kIncrementalFrameBytes) {
+            // Images go to the pipeline as they arrive; small fields are staged.
+            keep_alive::IncrementalFrame frame(message_len, frame_start, static_cast<size_t>(opts.max_batch_items),
+                                               static_cast<size_t>(opts.max_frame_mb) << 20, intake, pipeline,
+                                               frame_pool,
+                                               [&pipeline](std::shared_ptr<keep_alive::RequestJob> job) {
+                                                   pipeline.submit(std::move(job));
+                                               });
+            uint8_t fields[4096];
+            bool read_ok = true;
+            while (read_ok && !frame.complete()) {
+                size_t size = 0;
+                if (uint8_t* direct = frame.direct_buffer(size)) {
+                    read_ok = reader.read_exact(direct, size);
+                    if (read_ok) {
+                        frame.direct_read(size);
+                    }
+                } else {
+                    size = std::min(frame.wanted(), sizeof(fields));
+                    read_ok = reader.read_exact(fields, size);
+                    if (read_ok) {
+                        frame.feed(fields, size);
+                    }
                 }
-            } catch (...) {
-                // opts.gpu_id is not a parseable int; leave as-is.
             }
-        }
-
-        std::vector<std::vector<uint8_t>> outputs;
-        outputs.reserve(request.batch_count);
-        bool failed = false;
-
-        for (uint32_t i = 0; i < request.batch_count; ++i) {
-            const auto& image = request.images[i];
-            std::vector<uint8_t> output;
-            if (!engine->process_single(image.data(), image.size(), output, opts.output_format)) {
-                const std::string error_msg =
-                    "engine processing failed at index " + std::to_string(i);
-                logger::error("Engine failed processing request_id=" + std::to_string(header.request_id) +
-                              " image index=" + std::to_string(i));
-                write_protocol_error(std::cout, header.request_id, ProtocolStatus::EngineError, error_msg);
-                record_outcome(header.request_id,
-                               ProtocolStatus::EngineError,
-                               error_msg,
-                               i,
-                               frame_start,
-                               message_len,
-                               0,
-                               &request);
-                failed = true;
+            if (!read_ok) {
+                logger::error("Failed to read protocol v2 payload (" + std::to_string(message_len) + " bytes)");
                 break;
             }
-            outputs.push_back(std::move(output));
-        }
-
-        if (failed) {
             continue;
         }
 
-        size_t output_bytes = 0;
-        for (const auto& output : outputs) {
-            output_bytes += output.size();
+        std::shared_ptr<FrameBuffer> frame = frame_pool->acquire(message_len);
+        if (!reader.read_exact(frame->data(), frame->size())) {
+            logger::error("Failed to read protocol v2 payload (" + std::to_string(message_len) + " bytes)");
+            break;
         }
 
-        write_protocol_response(std::cout, header.request_id, ProtocolStatus::Ok, "", outputs);
-
-        // Clear Vulkan allocator free-pools after each request to prevent GPU memory
-        // fragmentation from accumulating across images (keep-alive mode).
-        engine->clear_allocators();
-
-        record_outcome(header.request_id,
-                       ProtocolStatus::Ok,
-                       "",
-                       outputs.size(),
-                       frame_start,
-                       message_len,
-                       output_bytes,
-                       &request);
-        ++handled;
+        pipeline.submit(intake.build(std::move(frame), frame_start));
     }
 
-    const uint32_t processed = metrics.processed.load(std::memory_order_relaxed);
-    const uint32_t errors = metrics.errors.load(std::memory_order_relaxed);
-    const uint64_t total_ns = metrics.total_ns.load(std::memory_order_relaxed);
-    if (processed || errors) {
-        const double avg_ms = processed ? (total_ns / double(processed)) / 1e6 : 0.0;
-        std::ostringstream summary;
-        summary << std::fixed << std::setprecision(2);
-        summary << "Protocol v2 summary: processed=" << processed
-                << ", errors=" << errors
-                << ", avg_latency_ms=" << avg_ms;
-        logger::info(summary.str());
-    }
+    // Let in-flight requests finish and their responses go out before exiting.
+    pipeline.shutdown();
 
-    logger::info("Protocol v2 keep-alive loop exiting after " + std::to_string(handled) + " frames");
+    metrics.log_summary();
+    logger::info("Protocol v2 keep-alive loop exiting after " + std::to_string(metrics.processed()) + " frames");
     return 0;
 }
 
@@ -426,7 +150,12 @@ int run_stdin_mode(BaseEngine* engine, const Options& opts) {
     // NOTE: In this mode, the caller must close stdin (send EOF) before the process can start
     // processing; otherwise the process will block waiting for more input.
     if (!opts.keep_alive) {
-        auto input = read_all_stream(std::cin);
+        std::vector<uint8_t> input;
+        FdFrameReader reader(STDIN_FILENO);
+        if (!reader.read_to_end(input)) {
+            logger::error("Failed to read stdin payload");
+            return 1;
+        }
         if (input.empty()) {
             return 0;
         }
@@ -437,8 +166,10 @@ int run_stdin_mode(BaseEngine* engine, const Options& opts) {
             return 1;
         }
 
-        std::cout.write(reinterpret_cast<const char*>(output.data()), output.size());
-        std::cout.flush();
+        if (!fd_io::write_all(STDOUT_FILENO, output.data(), output.size())) {
+            logger::error("Failed to write stdout payload");
+            return 1;
+        }
         return 0;
     }
 
@@ -1,6 +1,7 @@
 #include "options.hpp"
 
 #include <algorithm>
+#include <cctype>
 #include <cxxopts.hpp>
 #include <iostream>
 #include <string>
@@ -22,6 +23,9 @@ Options::Mode parse_mode(const std::string& value) {
     if (to_lower(value) == "stdin") {
         return Options::Mode::Stdin;
     }
+    if (to_lower(value) == "socket") {
+        return Options::Mode::Socket;
+    }
     return Options::Mode::File;
 }
 
@@ -33,20 +37,63 @@ bool parse_options(int argc, char** argv, Options& opts) {
         parser.positional_help("arguments");
         parser.add_options()
             ("engine", "Engine (realcugan|realesrgan)", cxxopts::value<std::string>()->default_value("realcugan"))
-            ("mode", "Mode (file|stdin)", cxxopts::value<std::string>()->default_value("file"))
+            ("mode", "Mode (file|stdin|socket)", cxxopts::value<std::string>()->default_value("file"))
             ("input", "Input path", cxxopts::value<std::string>()->default_value(""))
             ("output", "Output path", cxxopts::value<std::string>()->default_value(""))
+            ("socket", "Unix socket path to listen on (socket mode)", cxxopts::value<std::string>()->default_value(""))
             ("gpu-id", "GPU id (auto, -1, 0, ...)", cxxopts::value<std::string>()->default_value("auto"))
             ("tile-size", "Tile size", cxxopts::value<int>()->default_value("0"))
+            ("engine-instances", "Inference contexts sharing the loaded model weights (0 = auto from the core count; Vulkan uses 1)",
+                cxxopts::value<int>()->default_value("1"))
+            ("threads-per-instance", "ncnn threads per engine instance (0 = split the cores between instances)",
+                cxxopts::value<int>()->default_value("0"))
             ("scale", "Scale factor (realesrgan)", cxxopts::value<int>()->default_value("2"))
             ("noise", "Noise level (realcugan)", cxxopts::value<int>()->default_value("-1"))
             ("quality", "Quality flag (F/E/Q/H)", cxxopts::value<std::string>()->default_value("E"))
             ("model", "RealCUGAN model path (default: models/realcugan/models-se)", cxxopts::value<std::string>()->default_value("models/realcugan/models-se"))
             ("model-name", "RealESRGAN model name (optional, auto-selects by scale if empty)", cxxopts::value<std::string>()->default_value(""))
+            ("alt-model", "Model path of the engine not selected by --engine, for requests that ask for it",
+                cxxopts::value<std::string>()->default_value(""))
+            ("model-load", "Model weights loading (mmap: shared page-cache mapping, read: private copy)",
+                cxxopts::value<std::string>()->default_value("mmap"))
+            ("preload-models", "Keep-alive models loaded in parallel at startup: comma-separated [engine:]quality_or_scale",
+                cxxopts::value<std::string>()->default_value(""))
+            ("model-memory-mb", "Keep-alive budget for model weights loaded on request (MiB)",
+                cxxopts::value<int>()->default_value("512"))
+            ("cache-memory-mb", "Keep-alive in-memory result cache budget (MiB, 0 disables it)",
+                cxxopts::value<int>()->default_value("128"))
+            ("cache-dir", "Directory of the keep-alive on-disk result cache (disabled if empty)",
+                cxxopts::value<std::string>()->default_value(""))
+            ("cache-disk-mb", "Keep-alive on-disk result cache budget (MiB)", cxxopts::value<int>()->default_value("1024"))
+            ("memory-budget-mb", "Keep-alive estimated working memory admitted at once (MiB, 0 = half of the RAM)",
+                cxxopts::value<int>()->default_value("0"))
+            ("atlas-window-ms", "Keep-alive wait (ms) for small images to share one inference atlas (0 disables it)",
+                cxxopts::value<int>()->default_value("0"))
+            ("atlas-max-image", "Largest width/height of an image packed into an atlas",
+                cxxopts::value<int>()->default_value("256"))
+            ("shader-cache-dir", "Directory for the Vulkan driver's on-disk shader cache (driver default if empty)",
+                cxxopts::value<std::string>()->default_value(""))
             ("format", "Output format", cxxopts::value<std::string>()->default_value("webp"))
+            ("encoder-effort", "Keep-alive encoder effort (auto|fast|balanced|best), unless a request sets its own",
+                cxxopts::value<std::string>()->default_value("balanced"))
             ("max-batch-items", "Max batch items", cxxopts::value<int>()->default_value("8"))
+            ("max-frame-mb", "Keep-alive limit on the image bytes of one request frame above 1 MiB (MiB, 1-4095)",
+                cxxopts::value<int>()->default_value("512"))
+            ("decode-threads", "Keep-alive pipeline decoder threads", cxxopts::value<int>()->default_value("2"))
+            ("encode-threads", "Keep-alive pipeline encoder threads", cxxopts::value<int>()->default_value("2"))
+            ("queue-capacity", "Keep-alive pipeline queue capacity (images per stage)", cxxopts::value<int>()->default_value("4"))
+            ("max-in-flight", "Max keep-alive requests read ahead but not yet answered", cxxopts::value<int>()->default_value("4"))
+            ("priority-aging-ms", "Queue wait (ms) that promotes a keep-alive request one priority class",
+                cxxopts::value<int>()->default_value("2000"))
+            ("max-clients", "Max concurrent socket mode clients", cxxopts::value<int>()->default_value("64"))
+            ("out-of-order", "Write keep-alive responses as they complete (correlate by request_id)",
+                cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
             ("keep-alive", "Keep process alive for multiple invocations",
                 cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+            ("warmup", "Run a warm-up inference per engine instance at the tile size before serving",
+                cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
+            ("ready-frame", "Keep-alive: send a readiness frame with the init timings before the first response",
+                cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
             ("log-protocol", "Log protocol frames at info level",
                 cxxopts::value<bool>()->default_value("false")->implicit_value("true"))
             ("profiling", "Emit per-image profiling metrics",
@@ -65,16 +112,41 @@ bool parse_options(int argc, char** argv, Options& opts) {
         opts.mode = parse_mode(result["mode"].as<std::string>());
         opts.gpu_id = result["gpu-id"].as<std::string>();
         opts.tile_size = result["tile-size"].as<int>();
+        opts.engine_instances = result["engine-instances"].as<int>();
+        opts.threads_per_instance = result["threads-per-instance"].as<int>();
         opts.scale = result["scale"].as<int>();
         opts.noise_level = result["noise"].as<int>();
         opts.quality = result["quality"].as<std::string>();
         opts.model = result["model"].as<std::string>();
         opts.model_name = result["model-name"].as<std::string>();
+        opts.alt_model = result["alt-model"].as<std::string>();
+        opts.model_load = to_lower(result["model-load"].as<std::string>());
+        opts.preload_models = result["preload-models"].as<std::string>();
+        opts.model_memory_mb = result["model-memory-mb"].as<int>();
+        opts.cache_memory_mb = result["cache-memory-mb"].as<int>();
+        opts.cache_dir = result["cache-dir"].as<std::string>();
+        opts.cache_disk_mb = result["cache-disk-mb"].as<int>();
+        opts.shader_cache_dir = result["shader-cache-dir"].as<std::string>();
+        opts.memory_budget_mb = result["memory-budget-mb"].as<int>();
+        opts.atlas_window_ms = result["atlas-window-ms"].as<int>();
+        opts.atlas_max_image = result["atlas-max-image"].as<int>();
         opts.input_path = result["input"].as<std::string>();
         opts.output_path = result["output"].as<std::string>();
+        opts.socket_path = result["socket"].as<std::string>();
         opts.output_format = result["format"].as<std::string>();
+        opts.encoder_effort = to_lower(result["encoder-effort"].as<std::string>());
         opts.max_batch_items = result["max-batch-items"].as<int>();
+        opts.max_frame_mb = result["max-frame-mb"].as<int>();
+        opts.decode_threads = result["decode-threads"].as<int>();
+        opts.encode_threads = result["encode-threads"].as<int>();
+        opts.queue_capacity = result["queue-capacity"].as<int>();
+        opts.max_in_flight = result["max-in-flight"].as<int>();
+        opts.max_clients = result["max-clients"].as<int>();
+        opts.priority_aging_ms = result["priority-aging-ms"].as<int>();
+        opts.out_of_order = result["out-of-order"].as<bool>();
         opts.keep_alive = result["keep-alive"].as<bool>();
+        opts.warmup = result["warmup"].as<bool>();
+        opts.ready_frame = result["ready-frame"].as<bool>();
         opts.log_protocol = result["log-protocol"].as<bool>();
         opts.profiling = result["profiling"].as<bool>();
         opts.verbose = result["verbose"].as<bool>();
@@ -91,6 +163,82 @@ bool parse_options(int argc, char** argv, Options& opts) {
             std::cerr << "Invalid arguments: --max-batch-items must be > 0 (got " << opts.max_batch_items << ")\n";
             return false;
         }
+        // Frame lengths are u32: 4095 MiB is the largest payload one can carry.
+        if (opts.max_frame_mb <= 0 || opts.max_frame_mb > 4095) {
+            std::cerr << "Invalid arguments: --max-frame-mb must be in 1..4095 (got " << opts.max_frame_mb << ")\n";
+            return false;
+        }
+
+        if (opts.decode_threads <= 0) {
+            std::cerr << "Invalid arguments: --decode-threads must be > 0 (got " << opts.decode_threads << ")\n";
+            return false;
+        }
+        if (opts.encode_threads <= 0) {
+            std::cerr << "Invalid arguments: --encode-threads must be > 0 (got " << opts.encode_threads << ")\n";
+            return false;
+        }
+        if (opts.queue_capacity <= 0) {
+            std::cerr << "Invalid arguments: --queue-capacity must be > 0 (got " << opts.queue_capacity << ")\n";
+            return false;
+        }
+        if (opts.max_in_flight <= 0) {
+            std::cerr << "Invalid arguments: --max-in-flight must be > 0 (got " << opts.max_in_flight << ")\n";
+            return false;
+        }
+        if (opts.model_memory_mb < 0) {
+            std::cerr << "Invalid arguments: --model-memory-mb must be >= 0 (got " << opts.model_memory_mb << ")\n";
+            return false;
+        }
+        if (opts.cache_memory_mb < 0) {
+            std::cerr << "Invalid arguments: --cache-memory-mb must be >= 0 (got " << opts.cache_memory_mb << ")\n";
+            return false;
+        }
+        if (opts.cache_disk_mb <= 0) {
+            std::cerr << "Invalid arguments: --cache-disk-mb must be > 0 (got " << opts.cache_disk_mb << ")\n";
+            return false;
+        }
+        if (opts.memory_budget_mb < 0) {
+            std::cerr << "Invalid arguments: --memory-budget-mb must be >= 0 (got " << opts.memory_budget_mb << ")\n";
+            return false;
+        }
+        if (opts.engine_instances < 0) {
+            std::cerr << "Invalid arguments: --engine-instances must be >= 0 (got " << opts.engine_instances << ")\n";
+            return false;
+        }
+        if (opts.threads_per_instance < 0) {
+            std::cerr << "Invalid arguments: --threads-per-instance must be >= 0 (got " << opts.threads_per_instance << ")\n";
+            return false;
+        }
+        if (opts.atlas_window_ms < 0) {
+            std::cerr << "Invalid arguments: --atlas-window-ms must be >= 0 (got " << opts.atlas_window_ms << ")\n";
+            return false;
+        }
+        if (opts.atlas_max_image < 1) {
+            std::cerr << "Invalid arguments: --atlas-max-image must be >= 1 (got " << opts.atlas_max_image << ")\n";
+            return false;
+        }
+        if (opts.model_load != "mmap" && opts.model_load != "read") {
+            std::cerr << "Invalid arguments: --model-load must be mmap or read (got " << opts.model_load << ")\n";
+            return false;
+        }
+        if (opts.encoder_effort != "auto" && opts.encoder_effort != "fast" && opts.encoder_effort != "balanced" &&
+            opts.encoder_effort != "best") {
+            std::cerr << "Invalid arguments: --encoder-effort must be auto, fast, balanced or best (got "
+                      << opts.encoder_effort << ")\n";
+            return false;
+        }
+        if (opts.priority_aging_ms <= 0) {
+            std::cerr << "Invalid arguments: --priority-aging-ms must be > 0 (got " << opts.priority_aging_ms << ")\n";
+            return false;
+        }
+        if (opts.max_clients <= 0) {
+            std::cerr << "Invalid arguments: --max-clients must be > 0 (got " << opts.max_clients << ")\n";
+            return false;
+        }
+        if (opts.mode == Options::Mode::Socket && opts.socket_path.empty()) {
+            std::cerr << "Invalid arguments: --mode socket requires --socket <path>\n";
+            return false;
+        }
 
         return true;
     } catch (const cxxopts::exceptions::exception& ex) {
@@ -98,3 +246,24 @@ bool parse_options(int argc, char** argv, Options& opts) {
         return false;
     }
 }
+
+bool quality_noise_level(const std::string& quality, int& noise_level) {
+    if (quality.empty()) {
+        return false;
+    }
+    switch (std::toupper(static_cast<unsigned char>(quality.front()))) {
+        case 'F': noise_level = -1; return true;
+        case 'E': noise_level = 0; return true;
+        case 'Q': noise_level = 1; return true;
+        case 'H': noise_level = 2; return true;
+        default: return false;
+    }
+}
+
+int effective_noise_level(const Options& opts) {
+    if (opts.noise_level >= 0) {
+        return opts.noise_level;
+    }
+    int noise_level = -1;
+    return quality_noise_level(opts.quality, noise_level) ? noise_level : -1;
+}
@@ -4,25 +4,57 @@
 
 struct Options {
     enum class EngineType { RealCUGAN, RealESRGAN };
-    enum class Mode { File, Stdin };
+    enum class Mode { File, Stdin, Socket };
 
     EngineType engine = EngineType::RealCUGAN;
     Mode mode = Mode::File;
     std::string gpu_id = "auto";
     int tile_size = 0;
+    int engine_instances = 1;      // Execution contexts sharing the model weights (CPU); 0: auto
+    int threads_per_instance = 0;  // 0: ncnn default, split between instances
     int max_batch_items = 8;
+    int max_frame_mb = 512;  // Image bytes of one request received incrementally (keep-alive)
+    int decode_threads = 2;
+    int encode_threads = 2;
+    int queue_capacity = 4;
+    int max_in_flight = 4;
+    int max_clients = 64;
+    int priority_aging_ms = 2000;
+    int model_memory_mb = 512;
+    int cache_memory_mb = 128;
+    int cache_disk_mb = 1024;
+    int memory_budget_mb = 0;  // 0: half of the physical memory
+    int atlas_window_ms = 0;   // 0: small images are not packed into atlases
+    int atlas_max_image = 256;
     int scale = 2;
     int noise_level = -1;
     std::string quality = "E";
     std::string model = "models/realcugan/models-se";
     std::string model_name = "";  // Empty by default, will use scale factor to select model
+    std::string alt_model;        // Model path of the other engine, for per-request engine selection
+    std::string model_load = "mmap";  // mmap|read: how the weights file is loaded
+    std::string preload_models;   // Keep-alive: comma-separated [engine:]quality_or_scale loaded at startup
     std::string input_path;
     std::string output_path;
     std::string output_format = "webp";
+    std::string encoder_effort = "balanced";  // auto|fast|balanced|best (keep-alive)
+    std::string socket_path;
+    std::string cache_dir;        // On-disk result cache tier; empty keeps results in memory only
+    std::string shader_cache_dir;  // Vulkan driver shader cache directory; empty keeps the driver defaults
     bool verbose = false;
     bool keep_alive = false;
+    bool out_of_order = false;
     bool profiling = false;
     bool log_protocol = false;
+    bool warmup = false;          // Warm-up inference per engine instance at the end of init()
+    bool ready_frame = false;     // Keep-alive: announce readiness with a StreamFrameKind::Ready frame
 };
 
 bool parse_options(int argc, char** argv, Options& opts);
+
+/// RealCUGAN noise level for a quality flag (F=-1, E=0, Q=1, H=2; first
+/// letter, case-insensitive). False for anything else.
+bool quality_noise_level(const std::string& quality, int& noise_level);
+
+/// Noise level RealCUGAN runs with: --noise if set, else derived from --quality.
+int effective_noise_level(const Options& opts);
@@ -1,5 +1,8 @@
 #include "protocol_v2.hpp"
+#include "utils/frame_buffer_pool.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -13,6 +16,11 @@ void append_u32(std::vector<uint8_t>& buffer, uint32_t value) {
     buffer.push_back(static_cast<uint8_t>((value >> 24) & 0xFF));
 }
 
+void append_u64(std::vector<uint8_t>& buffer, uint64_t value) {
+    append_u32(buffer, static_cast<uint32_t>(value & 0xFFFFFFFFu));
+    append_u32(buffer, static_cast<uint32_t>(value >> 32));
+}
+
 void append_i32(std::vector<uint8_t>& buffer, int32_t value) {
     append_u32(buffer, static_cast<uint32_t>(value));
 }
@@ -58,6 +66,56 @@ int main() {
         return 1;
     }
 
+    // Images are views into the parsed buffer, not copies.
+    // Layout: engine(1) + meta_len(4) + "E"(1) + gpu_id(4) + batch_count(4) + len(4) → first image at 18.
+    const uint8_t* first_image = valid_payload.data() + 18;
+    const uint8_t* second_image = first_image + images[0].size() + 4;
+    if (request.images[0].data != first_image || request.images[0].size != images[0].size() ||
+        request.images[1].data != second_image || request.images[1].size != images[1].size()) {
+        std::cerr << "Image views do not alias the payload buffer\n";
+        return 1;
+    }
+    if (std::memcmp(request.images[1].data, images[1].data(), images[1].size()) != 0) {
+        std::cerr << "Image view content mismatch\n";
+        return 1;
+    }
+    if (request.storage) {
+        std::cerr << "Parser must not take ownership of the payload\n";
+        return 1;
+    }
+
+    // Views stay valid through RequestPayload::storage once the caller drops its
+    // own reference, and the frame buffer is recycled after the request is gone.
+    auto pool = FrameBufferPool::create(2, 1024);
+    {
+        std::shared_ptr<FrameBuffer> frame = pool->acquire(valid_payload.size());
+        std::memcpy(frame->data(), valid_payload.data(), valid_payload.size());
+        RequestPayload pooled;
+        if (!parse_request_payload(frame->data(), frame->size(), 8, pooled, error, status)) {
+            std::cerr << "Pooled request rejected: " << error << "\n";
+            return 1;
+        }
+        const uint8_t* frame_data = frame->data();
+        pooled.storage = std::move(frame);
+        if (pooled.images[0].data != frame_data + 18 || pooled.images[0].data[0] != 0x01) {
+            std::cerr << "Pooled image view mismatch\n";
+            return 1;
+        }
+        if (pool->idle_count() != 0) {
+            std::cerr << "Frame buffer recycled while still referenced\n";
+            return 1;
+        }
+    }
+    if (pool->idle_count() != 1) {
+        std::cerr << "Frame buffer not returned to the pool\n";
+        return 1;
+    }
+    auto reused = pool->acquire(8);
+    if (pool->idle_count() != 0 || reused->size() != 8 || reused->capacity() < valid_payload.size()) {
+        std::cerr << "Frame buffer not reused\n";
+        return 1;
+    }
+
     auto overflow_payload = build_payload(0, "E", 0, 9, images);
     if (parse_request_payload(overflow_payload.data(), overflow_payload.size(), 8, request, error, status)) {
         std::cerr << "Overflow batch_count accepted\n";
@@ -82,6 +140,310 @@ int main() {
         return 1;
     }
 
+    // Streaming requests share the request header; other message types are rejected.
+    for (uint32_t msg_type : {1u, 3u, 2u}) {
+        std::vector<uint8_t> header_bytes;
+        append_u32(header_bytes, kProtocolMagic);
+        append_u32(header_bytes, kProtocolVersion);
+        append_u32(header_bytes, msg_type);
+        append_u32(header_bytes, 42);
+        ProtocolHeader header{};
+        const bool accepted = parse_protocol_header(header_bytes.data(), header_bytes.size(), header, error);
+        if (accepted != (msg_type != 2u) || (accepted && header.request_id != 42)) {
+            std::cerr << "Unexpected header validation for msg_type " << msg_type << "\n";
+            return 1;
+        }
+    }
+
+    // Options block: [options_len][tag:u16][len:u16][value]...
+    {
+        std::vector<uint8_t> block;
+        append_u32(block, 10);
+        block.insert(block.end(), {1, 0, 1, 0, 1});  // input_encoding = raw pixels
+        block.insert(block.end(), {2, 0, 1, 0, 2});  // output_encoding = raw LZ4
+        block.push_back(0xEE);                       // first byte of the request body
+        RequestOptions options;
+        size_t consumed = 0;
+        if (!parse_request_options(block.data(), block.size(), options, consumed, error) || consumed != 14 ||
+            options.input != InputEncoding::RawPixels || options.output != OutputEncoding::RawPixelsLz4) {
+            std::cerr << "Valid options block rejected: " << error << "\n";
+            return 1;
+        }
+
+        block[4] = 9;  // unknown tag
+        if (parse_request_options(block.data(), block.size(), options, consumed, error) ||
+            error.find("unknown request option") == std::string::npos) {
+            std::cerr << "Unknown option tag accepted\n";
+            return 1;
+        }
+
+        std::vector<uint8_t> truncated;
+        append_u32(truncated, 6);
+        truncated.insert(truncated.end(), {1, 0, 1, 0, 1});
+        if (parse_request_options(truncated.data(), truncated.size(), options, consumed, error)) {
+            std::cerr << "Truncated options block accepted\n";
+            return 1;
+        }
+
+        std::vector<uint8_t> header_bytes;
+        append_u32(header_bytes, kProtocolMagic);
+        append_u32(header_bytes, kProtocolVersion);
+        append_u32(header_bytes, 3u | kMessageFlagOptions);
+        append_u32(header_bytes, 7);
+        ProtocolHeader header{};
+        if (!parse_protocol_header(header_bytes.data(), header_bytes.size(), header, error)) {
+            std::cerr << "Options flag rejected on a stream request: " << error << "\n";
+            return 1;
+        }
+
+        // Messages without a request body take no options.
+        for (ProtocolMessageType type : {ProtocolMessageType::RegisterBuffer, ProtocolMessageType::ReleaseBuffer,
+                                         ProtocolMessageType::Cancel, ProtocolMessageType::Stats}) {
+            std::vector<uint8_t> flagged;
+            append_u32(flagged, kProtocolMagic);
+            append_u32(flagged, kProtocolVersion);
+            append_u32(flagged, static_cast<uint32_t>(type) | kMessageFlagOptions);
+            append_u32(flagged, 8);
+            if (parse_protocol_header(flagged.data(), flagged.size(), header, error) ||
+                !options_flag_misplaced(header)) {
+                std::cerr << "Options flag accepted on msg_type " << static_cast<uint32_t>(type) << "\n";
+                return 1;
+            }
+            flagged[8] = static_cast<uint8_t>(type);
+            flagged[9] = 0;
+            if (!parse_protocol_header(flagged.data(), flagged.size(), header, error) ||
+                options_flag_misplaced(header)) {
+                std::cerr << "msg_type " << static_cast<uint32_t>(type) << " rejected without options\n";
+                return 1;
+            }
+        }
+    }
+
+    // Shared memory transport: option tag 3, 40-byte image slots.
+    {
+        std::vector<uint8_t> block;
+        append_u32(block, 5);
+        block.insert(block.end(), {3, 0, 1, 0, 1});  // transport = shared memory
+        RequestOptions options;
+        size_t consumed = 0;
+        if (!parse_request_options(block.data(), block.size(), options, consumed, error) ||
+            options.transport != Transport::SharedMemory) {
+            std::cerr << "Shared memory transport option rejected: " << error << "\n";
+            return 1;
+        }
+
+        std::vector<uint8_t> slot_bytes;
+        append_u32(slot_bytes, 7);
+        append_u64(slot_bytes, 4096);
+        append_u64(slot_bytes, 1000);
+        append_u32(slot_bytes, 8);
+        append_u64(slot_bytes, 0);
+        append_u64(slot_bytes, 1u << 20);
+        ShmImageSlot slot;
+        if (!parse_shm_slot(ImageView{slot_bytes.data(), slot_bytes.size()}, slot, error) ||
+            slot.in_buffer != 7 || slot.in_offset != 4096 || slot.in_length != 1000 ||
+            slot.out_buffer != 8 || slot.out_offset != 0 || slot.out_capacity != (1u << 20)) {
+            std::cerr << "Shared memory slot misparsed: " << error << "\n";
+            return 1;
+        }
+        if (parse_shm_slot(ImageView{slot_bytes.data(), slot_bytes.size() - 1}, slot, error)) {
+            std::cerr << "Short shared memory slot accepted\n";
+            return 1;
+        }
+
+        std::vector<uint8_t> header_bytes;
+        append_u32(header_bytes, kProtocolMagic);
+        append_u32(header_bytes, kProtocolVersion);
+        append_u32(header_bytes, static_cast<uint32_t>(ProtocolMessageType::RegisterBuffer));
+        append_u32(header_bytes, 8);
+        ProtocolHeader header{};
+        if (!parse_protocol_header(header_bytes.data(), header_bytes.size(), header, error)) {
+            std::cerr << "RegisterBuffer header rejected: " << error << "\n";
+            return 1;
+        }
+    }
+
+    // Deadline option (tag 4, u32 milliseconds) and Cancel messages.
+    {
+        std::vector<uint8_t> block;
+        append_u32(block, 8);
+        block.insert(block.end(), {4, 0, 4, 0});
+        append_u32(block, 250);
+        RequestOptions options;
+        size_t consumed = 0;
+        if (!parse_request_options(block.data(), block.size(), options, consumed, error) ||
+            options.deadline_ms != 250) {
+            std::cerr << "Deadline option rejected: " << error << "\n";
+            return 1;
+        }
+
+        std::vector<uint8_t> zero;
+        append_u32(zero, 8);
+        zero.insert(zero.end(), {4, 0, 4, 0});
+        append_u32(zero, 0);
+        if (parse_request_options(zero.data(), zero.size(), options, consumed, error)) {
+            std::cerr << "Zero deadline accepted\n";
+            return 1;
+        }
+
+        std::vector<uint8_t> header_bytes;
+        append_u32(header_bytes, kProtocolMagic);
+        append_u32(header_bytes, kProtocolVersion);
+        append_u32(header_bytes, static_cast<uint32_t>(ProtocolMessageType::Cancel));
+        append_u32(header_bytes, 9);
+        ProtocolHeader header{};
+        if (!parse_protocol_header(header_bytes.data(), header_bytes.size(), header, error)) {
+            std::cerr << "Cancel header rejected: " << error << "\n";
+            return 1;
+        }
+    }
+
+    // One-byte options: the largest valid value is accepted, the next one is
+    // rejected. Their effect is covered by keep_alive_test.
+    {
+        struct ByteOption {
+            uint8_t tag;
+            uint8_t max_value;
+            const char* name;
+        };
+        for (const ByteOption& option : {ByteOption{5, 2, "priority"}, ByteOption{6, 4, "encoder effort"},
+                                         ByteOption{7, 1, "item status"}}) {
+            std::vector<uint8_t> block;
+            append_u32(block, 5);
+            block.insert(block.end(), {option.tag, 0, 1, 0, option.max_value});
+            RequestOptions options;
+            size_t consumed = 0;
+            if (!parse_request_options(block.data(), block.size(), options, consumed, error)) {
+                std::cerr << option.name << " option rejected: " << error << "\n";
+                return 1;
+            }
+            block.back() = static_cast<uint8_t>(option.max_value + 1);
+            if (parse_request_options(block.data(), block.size(), options, consumed, error)) {
+                std::cerr << option.name << " value " << option.max_value + 1 << " accepted\n";
+                return 1;
+            }
+        }
+        const RequestOptions defaults;
+        if (defaults.priority != Priority::Normal || defaults.effort != EncoderEffort::Default ||
+            defaults.item_status) {
+            std::cerr << "Unexpected request option defaults\n";
+            return 1;
+        }
+    }
+
+    // Stats messages (type 7) have an empty body.
+    {
+        std::vector<uint8_t> header_bytes;
+        append_u32(header_bytes, kProtocolMagic);
+        append_u32(header_bytes, kProtocolVersion);
+        append_u32(header_bytes, static_cast<uint32_t>(ProtocolMessageType::Stats));
+        append_u32(header_bytes, 11);
+        ProtocolHeader header{};
+        if (!parse_protocol_header(header_bytes.data(), header_bytes.size(), header, error) ||
+            header.msg_type != 7 || header.request_id != 11) {
+            std::cerr << "Stats header rejected: " << error << "\n";
+            return 1;
+        }
+        header_bytes[8] = 8;  // Next unassigned type
+        if (parse_protocol_header(header_bytes.data(), header_bytes.size(), header, error)) {
+            std::cerr << "Unknown msg_type 8 accepted\n";
+            return 1;
+        }
+    }
+
+    // Incremental parsing: fields and length prefixes fed in pieces, image
+    // bytes read by the caller; same result as the whole-body parser.
+    {
+        std::vector<uint8_t> body;
+        append_u32(body, 5);
+        body.insert(body.end(), {5, 0, 1, 0, 0});  // priority = interactive
+        const auto payload = build_payload(1, "x4", 0, 2, images);
+        body.insert(body.end(), payload.begin(), payload.end());
+
+        for (size_t chunk : {size_t{1}, size_t{3}, body.size()}) {
+            RequestBodyParser parser(body.size(), true, 8, kMaxBatchPayloadBytes);
+            std::vector<std::vector<uint8_t>> received;
+            size_t offset = 0;
+            while (!parser.finished()) {
+                if (parser.state() == RequestBodyParser::State::ImageBytes) {
+                    if (parser.image_index() != received.size()) {
+                        std::cerr << "Incremental parser skipped an image\n";
+                        return 1;
+                    }
+                    received.emplace_back(body.begin() + offset, body.begin() + offset + parser.image_size());
+                    offset += parser.image_size();
+                    parser.image_read();
+                    continue;
+                }
+                offset += parser.feed(body.data() + offset, std::min(chunk, body.size() - offset));
+            }
+            if (parser.state() != RequestBodyParser::State::Done || received != images ||
+                parser.options().priority != Priority::Interactive || parser.request().batch_count != 2 ||
+                parser.request().quality_or_scale != "x4" || parser.remaining() != 0) {
+                std::cerr << "Incremental parse (chunk " << chunk << ") failed: " << parser.error() << "\n";
+                return 1;
+            }
+        }
+
+        // Checks fire as soon as the offending field is in.
+        auto fail_status = [](const std::vector<uint8_t>& bytes, size_t body_size, std::string& message) {
+            RequestBodyParser parser(body_size, false, 8, size_t{1} << 30);
+            size_t offset = 0;
+            while (!parser.finished() && parser.state() != RequestBodyParser::State::ImageBytes &&
+                   offset < bytes.size()) {
+                offset += parser.feed(bytes.data() + offset, 1);
+            }
+            message = parser.error();
+            return parser.state() == RequestBodyParser::State::Failed ? parser.status() : ProtocolStatus::Ok;
+        };
+        auto oversized = build_payload(0, "E", -1, 1, {});
+        append_u32(oversized, kMaxImageSizeBytes + 1);
+        if (fail_status(oversized, 1u << 30, error) != ProtocolStatus::ResourceLimit) {
+            std::cerr << "Incremental parser accepted an oversized image\n";
+            return 1;
+        }
+        auto truncated = build_payload(0, "E", -1, 1, {{1, 2, 3}});
+        if (fail_status(truncated, truncated.size() - 1, error) != ProtocolStatus::ValidationError ||
+            error != "image payload truncated for entry 0") {
+            std::cerr << "Truncated image not reported: " << error << "\n";
+            return 1;
+        }
+        if (fail_status({}, 0, error) != ProtocolStatus::ValidationError || error != "request body empty") {
+            std::cerr << "Empty incremental body not reported: " << error << "\n";
+            return 1;
+        }
+        // The whole-batch limit does not apply: images are never all resident.
+        auto head = build_payload(0, "E", -1, 2, {});
+        append_u32(head, kMaxImageSizeBytes);
+        const size_t large_body = head.size() + kMaxImageSizeBytes + 4 + (1u << 20);
+        RequestBodyParser large(large_body, false, 8, size_t{1} << 30);
+        for (size_t offset = 0; offset < head.size();) {
+            offset += large.feed(head.data() + offset, head.size() - offset);
+        }
+        large.image_read();
+        std::vector<uint8_t> second;
+        append_u32(second, static_cast<uint32_t>(large.remaining() - 4));
+        large.feed(second.data(), second.size());
+        if (large.state() != RequestBodyParser::State::ImageBytes) {
+            std::cerr << "Incremental parser applied the batch payload limit: " << large.error() << "\n";
+            return 1;
+        }
+        // Its own limit fires once the fields are in, before image 0.
+        auto capped_head = build_payload(0, "E", -1, 2, {});
+        if (fail_status(capped_head, large_body, error) != ProtocolStatus::Ok) {
+            std::cerr << "Incremental parser failed under its payload limit: " << error << "\n";
+            return 1;
+        }
+        RequestBodyParser capped(large_body, false, 8, kMaxImageSizeBytes);
+        for (size_t offset = 0; offset < capped_head.size() && !capped.finished();) {
+            offset += capped.feed(capped_head.data() + offset, capped_head.size() - offset);
+        }
+        if (capped.state() != RequestBodyParser::State::Failed || capped.status() != ProtocolStatus::ResourceLimit) {
+            std::cerr << "Incremental parser ignored its payload limit\n";
+            return 1;
+        }
+    }
+
     std::cout << "protocol_request_payload_test passed\n";
     return 0;
 }
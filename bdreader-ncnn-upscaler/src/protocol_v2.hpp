@@ -2,10 +2,12 @@
 
 #include "options.hpp"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -21,6 +23,87 @@ constexpr size_t kMaxBatchPayloadBytes = 48u * 1024u * 1024u;
 enum class ProtocolMessageType : uint8_t {
     Request = 1,
     Response = 2,
+    /// Same body as Request, but each image is answered with its own
+    /// StreamFrameKind::Item frame as soon as it is encoded, followed by one
+    /// StreamFrameKind::End frame (see write_stream_item/write_stream_end).
+    StreamRequest = 3,
+    /// Body `[buffer_id:u32]`; a memfd (or any mmap-able fd) is passed with the
+    /// frame via SCM_RIGHTS when stdin is a Unix socket. Answered with an empty
+    /// response.
+    RegisterBuffer = 4,
+    /// Body `[buffer_id:u32]`; unmaps the buffer once no request uses it.
+    ReleaseBuffer = 5,
+    /// Body `[target_request_id:u32]`; stops that in-flight request at its next
+    /// checkpoint (it is answered with ProtocolStatus::Cancelled). Answered
+    /// with an empty response, ValidationError if no such request is running.
+    Cancel = 6,
+    /// Empty body. Answered with a response carrying one output: a UTF-8 JSON
+    /// snapshot of the process (latency percentiles by status and by stage,
+    /// queue depths, bytes in/out, memory use).
+    Stats = 7,
+};
+
+/// Flag bit on a request msg_type: the body starts with an options block
+/// `[options_len:u32][tlv...]` (see parse_request_options) before the regular
+/// request body. The low byte keeps the ProtocolMessageType.
+constexpr uint32_t kMessageTypeMask = 0xFF;
+constexpr uint32_t kMessageFlagOptions = 0x100;
+
+/// Option tags of the request options block. Each entry is
+/// `[tag:u16][len:u16][value:len bytes]`; unknown tags are rejected.
+enum class RequestOptionTag : uint16_t {
+    InputEncoding = 1,   // u8 InputEncoding
+    OutputEncoding = 2,  // u8 OutputEncoding
+    Transport = 3,       // u8 Transport
+    Deadline = 4,        // u32 milliseconds from receipt; ProtocolStatus::Timeout past it
+    Priority = 5,        // u8 Priority
+    EncoderEffort = 6,   // u8 EncoderEffort
+    ItemStatus = 7,      // u8 0/1: images fail independently; Request answered with StreamFrameKind::Items
+};
+
+/// Scheduling class of a request. Lower values are served first; within a
+/// class, the request with the least estimated work left goes first.
+enum class Priority : uint8_t {
+    Interactive = 0,  // The page the user is looking at
+    Normal = 1,
+    Prefetch = 2,     // Speculative work (pages ahead, thumbnails)
+};
+
+/// Encoder effort for compressed outputs (image_io::EncodeEffort): encoding
+/// time against output size. The quality setting stays the same, but lossy
+/// WebP output pixels differ between levels (method and filter strength).
+enum class EncoderEffort : uint8_t {
+    Default = 0,  // --encoder-effort of the process
+    Auto = 1,     // Lowered under load or deadline pressure, raised when idle
+    Fast = 2,
+    Balanced = 3,
+    Best = 4,
+};
+
+enum class Transport : uint8_t {
+    Inline = 0,        // Image bytes inside the frame
+    SharedMemory = 1,  // Each image entry is a ShmImageSlot
+};
+
+enum class InputEncoding : uint8_t {
+    Compressed = 0,  // JPEG/PNG/WebP... decoded by image_io
+    RawPixels = 1,   // raw_pixels blob (optionally LZ4-compressed)
+};
+
+enum class OutputEncoding : uint8_t {
+    Compressed = 0,    // --format of the process
+    RawPixels = 1,     // raw_pixels blob, uncompressed
+    RawPixelsLz4 = 2,  // raw_pixels blob, LZ4-compressed
+};
+
+/// Second u32 of a streamed or per-item response frame. Legacy responses
+/// carry `status` in that position, so kinds start at 0x10 to never collide
+/// with a status.
+enum class StreamFrameKind : uint32_t {
+    Item = 0x10,
+    End = 0x11,
+    Items = 0x12,  // Response with a status per image (RequestOptionTag::ItemStatus)
+    Ready = 0x13,  // Unsolicited, request_id 0: the worker is warm (--ready-frame, see write_ready)
 };
 
 enum class ProtocolStatus : uint32_t {
@@ -30,6 +113,7 @@ enum class ProtocolStatus : uint32_t {
     EngineError = 3,
     ResourceLimit = 4,
     Timeout = 5,
+    Cancelled = 6,
 };
 
 struct ProtocolHeader {
@@ -41,12 +125,51 @@ struct ProtocolHeader {
 
 static_assert(sizeof(ProtocolHeader) == 16, "BRDR header must be exactly 16 bytes");
 
+/// Non-owning view of one image's bytes inside a request frame.
+struct ImageView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+struct RequestOptions {
+    InputEncoding input = InputEncoding::Compressed;
+    OutputEncoding output = OutputEncoding::Compressed;
+    Transport transport = Transport::Inline;
+    uint32_t deadline_ms = 0;  // 0 = no deadline
+    Priority priority = Priority::Normal;
+    EncoderEffort effort = EncoderEffort::Default;
+    bool item_status = false;  // A failed image does not fail the others
+};
+
+/// Image entry of a Transport::SharedMemory request (in place of the image
+/// bytes, so its length prefix is kShmImageSlotSize):
+/// `[in_buffer:u32][in_offset:u64][in_length:u64][out_buffer:u32][out_offset:u64][out_capacity:u64]`.
+/// Each output is written to its out region and the response carries a
+/// kShmOutputDescriptorSize descriptor `[buffer_id:u32][offset:u64][length:u64]`
+/// instead of the image bytes.
+struct ShmImageSlot {
+    uint32_t in_buffer = 0;
+    uint64_t in_offset = 0;
+    uint64_t in_length = 0;
+    uint32_t out_buffer = 0;
+    uint64_t out_offset = 0;
+    uint64_t out_capacity = 0;
+};
+
+constexpr size_t kShmImageSlotSize = 4 + 8 + 8 + 4 + 8 + 8;
+constexpr size_t kShmOutputDescriptorSize = 4 + 8 + 8;
+
 struct RequestPayload {
+    RequestOptions options;
     Options::EngineType engine;
     std::string quality_or_scale;
     int32_t gpu_id;
     uint32_t batch_count;
-    std::vector<std::vector<uint8_t>> images;
+    /// Views into the frame the request was parsed from (no per-image copy).
+    std::vector<ImageView> images;
+    /// Keeps the bytes behind `images` alive. parse_request_payload() does not
+    /// set it; the caller attaches the frame buffer it parsed from.
+    std::shared_ptr<const void> storage;
 };
 
 constexpr uint32_t decode_u32_le(const uint8_t* ptr) {
@@ -56,6 +179,13 @@ constexpr uint32_t decode_u32_le(const uint8_t* ptr) {
            (static_cast<uint32_t>(ptr[3]) << 24);
 }
 
+inline void encode_u32_le(uint8_t* ptr, uint32_t value) {
+    ptr[0] = static_cast<uint8_t>(value & 0xFF);
+    ptr[1] = static_cast<uint8_t>((value >> 8) & 0xFF);
+    ptr[2] = static_cast<uint8_t>((value >> 16) & 0xFF);
+    ptr[3] = static_cast<uint8_t>((value >> 24) & 0xFF);
+}
+
 inline bool read_le_u32(const uint8_t*& ptr, size_t& remaining, uint32_t& value) {
     if (remaining < 4) {
         return false;
@@ -66,6 +196,15 @@ inline bool read_le_u32(const uint8_t*& ptr, size_t& remaining, uint32_t& value)
     return true;
 }
 
+constexpr uint64_t decode_u64_le(const uint8_t* ptr) {
+    return static_cast<uint64_t>(decode_u32_le(ptr)) | (static_cast<uint64_t>(decode_u32_le(ptr + 4)) << 32);
+}
+
+inline void encode_u64_le(uint8_t* ptr, uint64_t value) {
+    encode_u32_le(ptr, static_cast<uint32_t>(value));
+    encode_u32_le(ptr + 4, static_cast<uint32_t>(value >> 32));
+}
+
 inline bool read_le_i32(const uint8_t*& ptr, size_t& remaining, int32_t& value) {
     uint32_t raw;
     if (!read_le_u32(ptr, remaining, raw)) {
@@ -75,6 +214,18 @@ inline bool read_le_i32(const uint8_t*& ptr, size_t& remaining, int32_t& value)
     return true;
 }
 
+/// True if `header` sets kMessageFlagOptions on a message type without a
+/// request body (Stats, Cancel, RegisterBuffer, ReleaseBuffer): the body is
+/// not laid out as the flag says, so the frame is invalid.
+inline bool options_flag_misplaced(const ProtocolHeader& header) {
+    const uint32_t base_type = header.msg_type & kMessageTypeMask;
+    return (header.msg_type & kMessageFlagOptions) != 0 &&
+           (base_type == static_cast<uint32_t>(ProtocolMessageType::RegisterBuffer) ||
+            base_type == static_cast<uint32_t>(ProtocolMessageType::ReleaseBuffer) ||
+            base_type == static_cast<uint32_t>(ProtocolMessageType::Cancel) ||
+            base_type == static_cast<uint32_t>(ProtocolMessageType::Stats));
+}
+
 inline bool parse_protocol_header(const uint8_t* payload,
                                   size_t payload_size,
                                   ProtocolHeader& header,
@@ -98,24 +249,125 @@ inline bool parse_protocol_header(const uint8_t* payload,
         error = "unsupported protocol version " + std::to_string(header.version);
         return false;
     }
-    if (header.msg_type != static_cast<uint32_t>(ProtocolMessageType::Request)) {
+    const uint32_t base_type = header.msg_type & kMessageTypeMask;
+    if ((header.msg_type & ~(kMessageTypeMask | kMessageFlagOptions)) != 0 ||
+        (base_type != static_cast<uint32_t>(ProtocolMessageType::Request) &&
+         base_type != static_cast<uint32_t>(ProtocolMessageType::StreamRequest) &&
+         base_type != static_cast<uint32_t>(ProtocolMessageType::RegisterBuffer) &&
+         base_type != static_cast<uint32_t>(ProtocolMessageType::ReleaseBuffer) &&
+         base_type != static_cast<uint32_t>(ProtocolMessageType::Cancel) &&
+         base_type != static_cast<uint32_t>(ProtocolMessageType::Stats))) {
         error = "unsupported msg_type " + std::to_string(header.msg_type);
         return false;
     }
+    if (options_flag_misplaced(header)) {
+        error = "options flag on msg_type " + std::to_string(base_type) + ", which takes no options";
+        return false;
+    }
 
     return true;
 }
 
-inline bool parse_request_payload(const uint8_t* data,
+/// Parse the options block that precedes the request body when the msg_type
+/// carries kMessageFlagOptions. `consumed` receives the block size (length
+/// prefix included) so the caller can skip to the regular body.
+inline bool parse_request_options(const uint8_t* data,
                                   size_t size,
-                                  size_t max_batch_items,
-                                  RequestPayload& request,
-                                  std::string& error,
-                                  ProtocolStatus& status) {
+                                  RequestOptions& options,
+                                  size_t& consumed,
+                                  std::string& error) {
+    options = RequestOptions{};
     const uint8_t* ptr = data;
     size_t remaining = size;
-    status = ProtocolStatus::ValidationError;
+    uint32_t options_len = 0;
+    if (!read_le_u32(ptr, remaining, options_len) || options_len > remaining) {
+        error = "options block truncated";
+        return false;
+    }
+    consumed = 4 + options_len;
+    remaining = options_len;
+
+    while (remaining > 0) {
+        if (remaining < 4) {
+            error = "option entry truncated";
+            return false;
+        }
+        const uint16_t tag = static_cast<uint16_t>(ptr[0] | (ptr[1] << 8));
+        const uint16_t len = static_cast<uint16_t>(ptr[2] | (ptr[3] << 8));
+        ptr += 4;
+        remaining -= 4;
+        if (len > remaining) {
+            error = "option " + std::to_string(tag) + " value truncated";
+            return false;
+        }
+
+        switch (static_cast<RequestOptionTag>(tag)) {
+            case RequestOptionTag::InputEncoding:
+                if (len != 1 || ptr[0] > static_cast<uint8_t>(InputEncoding::RawPixels)) {
+                    error = "input_encoding must be one byte, 0 (compressed) or 1 (raw pixels)";
+                    return false;
+                }
+                options.input = static_cast<InputEncoding>(ptr[0]);
+                break;
+            case RequestOptionTag::OutputEncoding:
+                if (len != 1 || ptr[0] > static_cast<uint8_t>(OutputEncoding::RawPixelsLz4)) {
+                    error = "output_encoding must be one byte, 0 (compressed), 1 (raw) or 2 (raw LZ4)";
+                    return false;
+                }
+                options.output = static_cast<OutputEncoding>(ptr[0]);
+                break;
+            case RequestOptionTag::Transport:
+                if (len != 1 || ptr[0] > static_cast<uint8_t>(Transport::SharedMemory)) {
+                    error = "transport must be one byte, 0 (inline) or 1 (shared memory)";
+                    return false;
+                }
+                options.transport = static_cast<Transport>(ptr[0]);
+                break;
+            case RequestOptionTag::Deadline:
+                if (len != 4 || decode_u32_le(ptr) == 0) {
+                    error = "deadline must be a non-zero u32 (milliseconds)";
+                    return false;
+                }
+                options.deadline_ms = decode_u32_le(ptr);
+                break;
+            case RequestOptionTag::Priority:
+                if (len != 1 || ptr[0] > static_cast<uint8_t>(Priority::Prefetch)) {
+                    error = "priority must be one byte, 0 (interactive), 1 (normal) or 2 (prefetch)";
+                    return false;
+                }
+                options.priority = static_cast<Priority>(ptr[0]);
+                break;
+            case RequestOptionTag::EncoderEffort:
+                if (len != 1 || ptr[0] > static_cast<uint8_t>(EncoderEffort::Best)) {
+                    error = "encoder_effort must be one byte, 0 (default), 1 (auto), 2 (fast), 3 (balanced) or 4 (best)";
+                    return false;
+                }
+                options.effort = static_cast<EncoderEffort>(ptr[0]);
+                break;
+            case RequestOptionTag::ItemStatus:
+                if (len != 1 || ptr[0] > 1) {
+                    error = "item_status must be one byte, 0 or 1";
+                    return false;
+                }
+                options.item_status = ptr[0] != 0;
+                break;
+            default:
+                error = "unknown request option " + std::to_string(tag);
+                return false;
+        }
+        ptr += len;
+        remaining -= len;
+    }
+    return true;
+}
 
+/// Parse the fields of a request body that precede its images (engine,
+/// quality/scale, gpu_id, batch_count), advancing `ptr` / `remaining` past them.
+inline bool parse_request_fields(const uint8_t*& ptr,
+                                 size_t& remaining,
+                                 size_t max_batch_items,
+                                 RequestPayload& request,
+                                 std::string& error) {
     if (remaining < 1) {
         error = "missing engine enum";
         return false;
@@ -165,6 +417,24 @@ inline bool parse_request_payload(const uint8_t* data,
         error = "batch_count exceeds --max-batch-items";
         return false;
     }
+    return true;
+}
+
+/// Parse a request body. On success `request.images` point into `data`, which
+/// must outlive them (see RequestPayload::storage).
+inline bool parse_request_payload(const uint8_t* data,
+                                  size_t size,
+                                  size_t max_batch_items,
+                                  RequestPayload& request,
+                                  std::string& error,
+                                  ProtocolStatus& status) {
+    const uint8_t* ptr = data;
+    size_t remaining = size;
+    status = ProtocolStatus::ValidationError;
+
+    if (!parse_request_fields(ptr, remaining, max_batch_items, request, error)) {
+        return false;
+    }
 
     request.images.clear();
     request.images.reserve(request.batch_count);
@@ -190,7 +460,7 @@ inline bool parse_request_payload(const uint8_t* data,
             error = "image payload truncated for entry " + std::to_string(i);
             return false;
         }
-        request.images.emplace_back(ptr, ptr + image_len);
+        request.images.push_back(ImageView{ptr, image_len});
         ptr += image_len;
         remaining -= image_len;
     }
@@ -203,4 +473,248 @@ inline bool parse_request_payload(const uint8_t* data,
     return true;
 }
 
+/// Incremental counterpart of parse_request_options + parse_request_payload,
+/// for a Request / StreamRequest body read piece by piece: each image can be
+/// handed on as soon as its own bytes are in, instead of once the whole frame
+/// is. Same checks and messages, except the batch payload limit: images need
+/// not be resident together, so it is `max_payload_bytes` (`--max-frame-mb`)
+/// instead of kMaxBatchPayloadBytes, checked once the fields are in (before
+/// any image).
+///
+/// The options block, fields and length prefixes go through feed(); image
+/// bytes do not, so the caller can read them straight into storage of its
+/// choosing:
+///
+///   RequestBodyParser parser(body_size, has_options, max_batch_items, max_payload_bytes);
+///   while (!parser.finished()) {
+///       if (parser.state() == RequestBodyParser::State::ImageBytes) {
+///           // read parser.image_size() bytes of image parser.image_index()
+///           parser.image_read();
+///       } else {
+///           // read n <= parser.wanted() bytes into buf
+///           parser.feed(buf, n);
+///       }
+///   }
+class RequestBodyParser {
+public:
+    enum class State {
+        Fields,       // Options block and payload fields: feed()
+        ImageLength,  // Length prefix of image image_index(): feed()
+        ImageBytes,   // image_size() bytes of image image_index(), read by the caller: image_read()
+        Done,         // Whole body parsed
+        Failed,       // error() and status() say why
+    };
+
+    RequestBodyParser(size_t body_size, bool has_options, size_t max_batch_items, size_t max_payload_bytes)
+        : body_size_(body_size),
+          has_options_(has_options),
+          max_batch_items_(max_batch_items),
+          max_payload_bytes_(max_payload_bytes) {
+        advance_fields();
+    }
+
+    State state() const { return state_; }
+    bool finished() const { return state_ == State::Done || state_ == State::Failed; }
+
+    /// Bytes feed() takes next; 0 outside State::Fields / State::ImageLength.
+    size_t wanted() const {
+        switch (state_) {
+            case State::Fields:
+                return fields_target_ - fields_.size();
+            case State::ImageLength:
+                return sizeof(length_) - length_filled_;
+            default:
+                return 0;
+        }
+    }
+
+    /// Consume up to wanted() bytes of `data`; returns how many were taken.
+    size_t feed(const uint8_t* data, size_t size) {
+        const size_t taken = std::min(size, wanted());
+        if (state_ == State::Fields) {
+            fields_.insert(fields_.end(), data, data + taken);
+            consumed_ += taken;
+            if (fields_.size() == fields_target_) {
+                advance_fields();
+            }
+        } else if (state_ == State::ImageLength) {
+            std::memcpy(length_ + length_filled_, data, taken);
+            length_filled_ += taken;
+            consumed_ += taken;
+            if (length_filled_ == sizeof(length_)) {
+                start_image();
+            }
+        }
+        return taken;
+    }
+
+    /// The caller has read the image_size() bytes of the current image.
+    void image_read() {
+        if (state_ != State::ImageBytes) {
+            return;
+        }
+        consumed_ += image_size_;
+        ++image_index_;
+        next_image();
+    }
+
+    /// Options and payload fields, set once past State::Fields (`images` stays
+    /// empty).
+    const RequestOptions& options() const { return options_; }
+    const RequestPayload& request() const { return request_; }
+    uint32_t image_index() const { return image_index_; }
+    uint32_t image_size() const { return image_size_; }
+    /// Body bytes not consumed yet.
+    size_t remaining() const { return body_size_ - consumed_; }
+    /// The options block and fields, as fed.
+    const std::vector<uint8_t>& fields() const { return fields_; }
+
+    const std::string& error() const { return error_; }
+    ProtocolStatus status() const { return status_; }
+
+private:
+    /// Bytes the options block and fields span, as far as the bytes fed so far
+    /// tell, capped at the body. Stops growing at the first field that is
+    /// bound to be rejected.
+    size_t fields_size() const {
+        const uint8_t* data = fields_.data();
+        const size_t have = fields_.size();
+        size_t need = 0;
+        if (has_options_) {
+            need = 4;
+            if (have < need) {
+                return std::min(need, body_size_);
+            }
+            const uint32_t options_len = decode_u32_le(data);
+            if (options_len > body_size_ - need) {
+                return need;
+            }
+            need += options_len;
+            if (have < need) {
+                return need;
+            }
+        }
+        need += 1 + 4;  // engine, meta_len
+        if (have < need) {
+            return std::min(need, body_size_);
+        }
+        const uint32_t meta_len = decode_u32_le(data + need - 4);
+        if (meta_len > kMaxMetaStringBytes) {
+            return need;
+        }
+        need += meta_len + 4 + 4;  // meta, gpu_id, batch_count
+        return std::min(need, body_size_);
+    }
+
+    void advance_fields() {
+        fields_target_ = fields_size();
+        if (fields_target_ > fields_.size()) {
+            return;
+        }
+
+        const uint8_t* ptr = fields_.data();
+        size_t remaining = fields_.size();
+        if (has_options_) {
+            size_t options_size = 0;
+            if (!parse_request_options(ptr, remaining, options_, options_size, error_)) {
+                fail(ProtocolStatus::ValidationError);
+                return;
+            }
+            ptr += options_size;
+            remaining -= options_size;
+        }
+        if (remaining == 0) {
+            error_ = "request body empty";
+            fail(ProtocolStatus::ValidationError);
+            return;
+        }
+        if (!parse_request_fields(ptr, remaining, max_batch_items_, request_, error_)) {
+            fail(ProtocolStatus::ValidationError);
+            return;
+        }
+        // Image bytes: the rest of the body but the length prefixes (a body
+        // too short for them fails on the missing prefix instead).
+        const size_t prefixes = static_cast<size_t>(request_.batch_count) * sizeof(length_);
+        const size_t rest = body_size_ - consumed_;
+        if (rest > prefixes && rest - prefixes > max_payload_bytes_) {
+            error_ = "batch payload exceeds memory budget";
+            fail(ProtocolStatus::ResourceLimit);
+            return;
+        }
+        next_image();
+    }
+
+    void next_image() {
+        if (image_index_ == request_.batch_count) {
+            if (remaining() > 0) {
+                error_ = "trailing bytes after images";
+                fail(ProtocolStatus::ValidationError);
+                return;
+            }
+            state_ = State::Done;
+            return;
+        }
+        if (remaining() < sizeof(length_)) {
+            error_ = "missing image length for entry " + std::to_string(image_index_);
+            fail(ProtocolStatus::ValidationError);
+            return;
+        }
+        length_filled_ = 0;
+        state_ = State::ImageLength;
+    }
+
+    void start_image() {
+        image_size_ = decode_u32_le(length_);
+        if (image_size_ > kMaxImageSizeBytes) {
+            error_ = "image size exceeds limit: " + std::to_string(image_size_);
+            fail(ProtocolStatus::ResourceLimit);
+            return;
+        }
+        if (image_size_ > remaining()) {
+            error_ = "image payload truncated for entry " + std::to_string(image_index_);
+            fail(ProtocolStatus::ValidationError);
+            return;
+        }
+        state_ = State::ImageBytes;
+    }
+
+    void fail(ProtocolStatus status) {
+        status_ = status;
+        state_ = State::Failed;
+    }
+
+    const size_t body_size_;
+    const bool has_options_;
+    const size_t max_batch_items_;
+    const size_t max_payload_bytes_;
+    State state_ = State::Fields;
+    size_t consumed_ = 0;
+    std::vector<uint8_t> fields_;
+    size_t fields_target_ = 0;
+    RequestOptions options_;
+    RequestPayload request_{};
+    uint8_t length_[4] = {};
+    size_t length_filled_ = 0;
+    uint32_t image_index_ = 0;
+    uint32_t image_size_ = 0;
+    std::string error_;
+    ProtocolStatus status_ = ProtocolStatus::Ok;
+};
+
+/// Decode the shared-memory slot stored in place of an image's bytes.
+inline bool parse_shm_slot(const ImageView& entry, ShmImageSlot& slot, std::string& error) {
+    if (entry.size != kShmImageSlotSize) {
+        error = "shared memory image entry must be " + std::to_string(kShmImageSlotSize) + " bytes";
+        return false;
+    }
+    const uint8_t* ptr = entry.data;
+    slot.in_buffer = decode_u32_le(ptr);
+    slot.in_offset = decode_u64_le(ptr + 4);
+    slot.in_length = decode_u64_le(ptr + 12);
+    slot.out_buffer = decode_u32_le(ptr + 20);
+    slot.out_offset = decode_u64_le(ptr + 24);
+    slot.out_capacity = decode_u64_le(ptr + 32);
+    return true;
+}
+
 } // namespace protocol_v2
@@ -0,0 +1,226 @@
+#include "protocol_writer.hpp"
+
+#include "utils/fd_io.hpp"
+#include "utils/logger.hpp"
+
+#include <limits>
+#include <sys/uio.h>
+
+namespace protocol_v2 {
+
+FrameWriter::FrameWriter() {
+    // Typical response: a handful of u32 fields plus one length per output.
+    inline_.reserve(64);
+    put_u32(0);  // payload_len, patched in write_to()
+    payload_size_ = 0;
+}
+
+void FrameWriter::put_u32(uint32_t value) {
+    uint8_t bytes[4];
+    encode_u32_le(bytes, value);
+    put_inline(bytes, sizeof(bytes));
+}
+
+void FrameWriter::put_inline(const void* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    const size_t offset = inline_.size();
+    const auto* src = static_cast<const uint8_t*>(data);
+    inline_.insert(inline_.end(), src, src + size);
+    if (!segments_.empty() && segments_.back().external == nullptr) {
+        segments_.back().size += size;  // Extend the current inline run
+    } else {
+        segments_.push_back(Segment{nullptr, offset, size});
+    }
+    payload_size_ += size;
+}
+
+void FrameWriter::put_external(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    segments_.push_back(Segment{data, 0, size});
+    payload_size_ += size;
+}
+
+void FrameWriter::hold(std::shared_ptr<const void> owner) {
+    owners_.push_back(std::move(owner));
+}
+
+bool FrameWriter::finish() {
+    if (!iov_.empty()) {
+        return true;
+    }
+    if (payload_size_ > std::numeric_limits<uint32_t>::max()) {
+        logger::error("Protocol v2 response too large: " + std::to_string(payload_size_) + " bytes");
+        return false;
+    }
+    encode_u32_le(inline_.data(), static_cast<uint32_t>(payload_size_));
+
+    // inline_ no longer grows, so slices can be resolved to stable pointers now
+    // (moving the frame moves inline_'s storage, not the bytes).
+    iov_.resize(segments_.size());
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        const Segment& segment = segments_[i];
+        const uint8_t* base = segment.external ? segment.external : inline_.data() + segment.offset;
+        iov_[i].iov_base = const_cast<uint8_t*>(base);
+        iov_[i].iov_len = segment.size;
+    }
+    next_iov_ = 0;
+    unwritten_ = sizeof(uint32_t) + payload_size_;
+    return true;
+}
+
+bool FrameWriter::write_to(int fd) {
+    if (!finish()) {
+        return false;
+    }
+    const bool written = fd_io::write_all(fd, iov_.data() + next_iov_, iov_.size() - next_iov_);
+    next_iov_ = iov_.size();
+    unwritten_ = 0;
+    return written;
+}
+
+bool FrameWriter::write_available(int fd) {
+    struct iovec* iov = iov_.data() + next_iov_;
+    size_t count = iov_.size() - next_iov_;
+    if (!fd_io::write_available(fd, iov, count)) {
+        return false;
+    }
+    // fd_io trimmed the entries in place: what is left of them is unwritten.
+    next_iov_ = iov_.size() - count;
+    unwritten_ = 0;
+    for (size_t i = next_iov_; i < iov_.size(); ++i) {
+        unwritten_ += iov_[i].iov_len;
+    }
+    return true;
+}
+
+FrameWriter response_frame(uint32_t request_id,
+                           ProtocolStatus status,
+                           const std::string& error_message,
+                           const std::vector<image_io::EncodedImage>& outputs) {
+    FrameWriter frame;
+    frame.put_u32(request_id);
+    frame.put_u32(static_cast<uint32_t>(status));
+    frame.put_u32(static_cast<uint32_t>(error_message.size()));
+    frame.put_inline(error_message.data(), error_message.size());
+    frame.put_u32(static_cast<uint32_t>(outputs.size()));
+    for (const auto& output : outputs) {
+        frame.put_u32(static_cast<uint32_t>(output.size()));
+        frame.put_external(output.data(), output.size());
+    }
+    return frame;
+}
+
+FrameWriter item_response_frame(uint32_t request_id,
+                                ProtocolStatus status,
+                                const std::string& error_message,
+                                const std::vector<image_io::EncodedImage>& outputs,
+                                const std::vector<ProtocolStatus>& item_statuses,
+                                const std::vector<std::string>& item_errors) {
+    FrameWriter frame;
+    frame.put_u32(request_id);
+    frame.put_u32(static_cast<uint32_t>(StreamFrameKind::Items));
+    frame.put_u32(static_cast<uint32_t>(status));
+    frame.put_u32(static_cast<uint32_t>(error_message.size()));
+    frame.put_inline(error_message.data(), error_message.size());
+    frame.put_u32(static_cast<uint32_t>(outputs.size()));
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        frame.put_u32(static_cast<uint32_t>(item_statuses[i]));
+        frame.put_u32(static_cast<uint32_t>(item_errors[i].size()));
+        frame.put_inline(item_errors[i].data(), item_errors[i].size());
+        frame.put_u32(static_cast<uint32_t>(outputs[i].size()));
+        frame.put_external(outputs[i].data(), outputs[i].size());
+    }
+    return frame;
+}
+
+namespace {
+void put_stream_prefix(FrameWriter& frame,
+                       uint32_t request_id,
+                       StreamFrameKind kind,
+                       uint32_t item_index,
+                       ProtocolStatus status,
+                       const std::string& error_message) {
+    frame.put_u32(request_id);
+    frame.put_u32(static_cast<uint32_t>(kind));
+    frame.put_u32(item_index);
+    frame.put_u32(static_cast<uint32_t>(status));
+    frame.put_u32(static_cast<uint32_t>(error_message.size()));
+    frame.put_inline(error_message.data(), error_message.size());
+}
+} // namespace
+
+FrameWriter stream_item_frame(uint32_t request_id,
+                              uint32_t item_index,
+                              ProtocolStatus status,
+                              const std::string& error_message,
+                              const image_io::EncodedImage& output) {
+    FrameWriter frame;
+    put_stream_prefix(frame, request_id, StreamFrameKind::Item, item_index, status, error_message);
+    frame.put_u32(static_cast<uint32_t>(output.size()));
+    frame.put_external(output.data(), output.size());
+    return frame;
+}
+
+FrameWriter stream_end_frame(uint32_t request_id,
+                             uint32_t items_ok,
+                             ProtocolStatus status,
+                             const std::string& error_message) {
+    FrameWriter frame;
+    put_stream_prefix(frame, request_id, StreamFrameKind::End, items_ok, status, error_message);
+    frame.put_u32(0);
+    return frame;
+}
+
+FrameWriter ready_frame(const std::string& report) {
+    FrameWriter frame;
+    frame.put_u32(0);
+    frame.put_u32(static_cast<uint32_t>(StreamFrameKind::Ready));
+    frame.put_u32(static_cast<uint32_t>(report.size()));
+    frame.put_inline(report.data(), report.size());
+    return frame;
+}
+
+bool write_response(int fd,
+                    uint32_t request_id,
+                    ProtocolStatus status,
+                    const std::string& error_message,
+                    const std::vector<image_io::EncodedImage>& outputs) {
+    return response_frame(request_id, status, error_message, outputs).write_to(fd);
+}
+
+bool write_item_response(int fd,
+                         uint32_t request_id,
+                         ProtocolStatus status,
+                         const std::string& error_message,
+                         const std::vector<image_io::EncodedImage>& outputs,
+                         const std::vector<ProtocolStatus>& item_statuses,
+                         const std::vector<std::string>& item_errors) {
+    return item_response_frame(request_id, status, error_message, outputs, item_statuses, item_errors).write_to(fd);
+}
+
+bool write_stream_item(int fd,
+                       uint32_t request_id,
+                       uint32_t item_index,
+                       ProtocolStatus status,
+                       const std::string& error_message,
+                       const image_io::EncodedImage& output) {
+    return stream_item_frame(request_id, item_index, status, error_message, output).write_to(fd);
+}
+
+bool write_stream_end(int fd,
+                      uint32_t request_id,
+                      uint32_t items_ok,
+                      ProtocolStatus status,
+                      const std::string& error_message) {
+    return stream_end_frame(request_id, items_ok, status, error_message).write_to(fd);
+}
+
+bool write_ready(int fd, const std::string& report) {
+    return ready_frame(report).write_to(fd);
+}
+
+} // namespace protocol_v2
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "protocol_v2.hpp"
+#include "utils/image_io.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+namespace protocol_v2 {
+
+/// One outgoing frame (`[u32 payload_len][payload]`) assembled for a single
+/// gather write.
+///
+/// Small fields (u32s, error text) are packed into one inline buffer; large
+/// buffers (encoded images) are referenced in place and only ever touched by
+/// writev(). Referenced buffers must outlive the write; a frame written later
+/// (socket mode queues them per client) keeps their owner with hold().
+class FrameWriter {
+public:
+    FrameWriter();
+
+    FrameWriter(FrameWriter&&) = default;
+    FrameWriter& operator=(FrameWriter&&) = default;
+
+    void put_u32(uint32_t value);
+    /// Copy `size` bytes into the inline buffer (for short fields).
+    void put_inline(const void* data, size_t size);
+    /// Reference `size` bytes without copying.
+    void put_external(const uint8_t* data, size_t size);
+    /// Keep `owner` (of referenced bytes) alive as long as the frame.
+    void hold(std::shared_ptr<const void> owner);
+
+    /// Payload bytes so far (excluding the u32 length prefix).
+    size_t payload_size() const { return payload_size_; }
+
+    /// Patch the length prefix and lay the frame out for writing; nothing may
+    /// be put afterwards. False if the payload does not fit the prefix.
+    bool finish();
+
+    /// finish() and write the whole frame to `fd`, waiting while it is full.
+    bool write_to(int fd);
+
+    /// Write what non-blocking `fd` accepts now, resuming after the bytes
+    /// earlier calls wrote. Needs finish(). False on a hard error.
+    bool write_available(int fd);
+
+    /// Frame bytes (length prefix included) not yet written; 0 once
+    /// write_available() is done. Only meaningful after finish().
+    size_t unwritten() const { return unwritten_; }
+
+private:
+    struct Segment {
+        const uint8_t* external = nullptr;  // nullptr → slice of inline_
+        size_t offset = 0;
+        size_t size = 0;
+    };
+
+    std::vector<uint8_t> inline_;
+    std::vector<Segment> segments_;
+    size_t payload_size_ = 0;
+    std::vector<std::shared_ptr<const void>> owners_;
+    // Set by finish(): the unwritten part of the frame, from iov_[next_iov_].
+    std::vector<struct iovec> iov_;
+    size_t next_iov_ = 0;
+    size_t unwritten_ = 0;
+};
+
+// Frame builders. Images are referenced, not copied (see FrameWriter).
+
+/// Response frame:
+/// `[payload_len][request_id][status][error_len][error][result_count]([out_len][out])*`
+FrameWriter response_frame(uint32_t request_id,
+                           ProtocolStatus status,
+                           const std::string& error_message,
+                           const std::vector<image_io::EncodedImage>& outputs);
+
+/// Per-item response frame (RequestOptionTag::ItemStatus):
+/// `[payload_len][request_id][kind=Items][status][error_len][error][result_count]`
+/// `([item_status][item_error_len][item_error][out_len][out])*`.
+/// `item_errors` / `item_statuses` have one entry per output.
+FrameWriter item_response_frame(uint32_t request_id,
+                                ProtocolStatus status,
+                                const std::string& error_message,
+                                const std::vector<image_io::EncodedImage>& outputs,
+                                const std::vector<ProtocolStatus>& item_statuses,
+                                const std::vector<std::string>& item_errors);
+
+/// One streamed item frame (StreamRequest):
+/// `[payload_len][request_id][kind=Item][item_index][status][error_len][error][out_len][out]`
+FrameWriter stream_item_frame(uint32_t request_id,
+                              uint32_t item_index,
+                              ProtocolStatus status,
+                              const std::string& error_message,
+                              const image_io::EncodedImage& output);
+
+/// Frame closing a streamed request; same layout as an item with kind=End,
+/// `item_index` = number of items streamed with status Ok and no output.
+FrameWriter stream_end_frame(uint32_t request_id,
+                             uint32_t items_ok,
+                             ProtocolStatus status,
+                             const std::string& error_message);
+
+/// Readiness frame (`--ready-frame`), before any response:
+/// `[payload_len][request_id=0][kind=Ready][report_len][report]`, `report`
+/// being UTF-8 JSON with the init timings.
+FrameWriter ready_frame(const std::string& report);
+
+// Blocking writes of the frames above to `fd`.
+
+bool write_response(int fd,
+                    uint32_t request_id,
+                    ProtocolStatus status,
+                    const std::string& error_message,
+                    const std::vector<image_io::EncodedImage>& outputs);
+
+bool write_item_response(int fd,
+                         uint32_t request_id,
+                         ProtocolStatus status,
+                         const std::string& error_message,
+                         const std::vector<image_io::EncodedImage>& outputs,
+                         const std::vector<ProtocolStatus>& item_statuses,
+                         const std::vector<std::string>& item_errors);
+
+bool write_stream_item(int fd,
+                       uint32_t request_id,
+                       uint32_t item_index,
+                       ProtocolStatus status,
+                       const std::string& error_message,
+                       const image_io::EncodedImage& output);
+
+bool write_stream_end(int fd,
+                      uint32_t request_id,
+                      uint32_t items_ok,
+                      ProtocolStatus status,
+                      const std::string& error_message);
+
+bool write_ready(int fd, const std::string& report);
+
+} // namespace protocol_v2
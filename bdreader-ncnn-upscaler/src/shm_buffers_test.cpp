@@ -0,0 +1,160 @@
+#include "utils/fd_io.hpp"
+#include "utils/shm_buffers.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kBufferSize = 4096;
+
+/// Client side: a memfd of kBufferSize bytes filled with `fill`, sealed
+/// against shrinking when `seal` is set.
+int make_memfd(unsigned int flags, bool seal, uint8_t fill) {
+    const int fd = ::memfd_create("shm_buffers_test", MFD_CLOEXEC | flags);
+    if (fd < 0 || ::ftruncate(fd, kBufferSize) != 0) {
+        return -1;
+    }
+    std::string bytes(kBufferSize, static_cast<char>(fill));
+    if (::pwrite(fd, bytes.data(), bytes.size(), 0) != static_cast<ssize_t>(bytes.size())) {
+        return -1;
+    }
+    if (seal && ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK) != 0) {
+        return -1;
+    }
+    return fd;
+}
+
+/// Client side: send `fd` with one byte over the Unix socket, as a
+/// RegisterBuffer frame carries it.
+bool send_fd(int socket, int fd) {
+    const char byte = 'R';
+    struct iovec iov{const_cast<char*>(&byte), 1};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return ::sendmsg(socket, &msg, 0) == 1;
+}
+
+/// Server side: receive one fd the way the frame readers do.
+int receive_fd(int socket) {
+    char byte = 0;
+    struct iovec iov{&byte, 1};
+    std::deque<int> fds;
+    if (fd_io::receive(socket, &iov, 1, fds) != 1 || fds.size() != 1) {
+        return -1;
+    }
+    return fds.front();
+}
+
+/// Send `client_fd` across `sockets` and map what arrives.
+std::shared_ptr<shm::MappedBuffer> exchange(const int sockets[2], int client_fd, std::string& error) {
+    if (!send_fd(sockets[0], client_fd)) {
+        error = "sendmsg failed";
+        return nullptr;
+    }
+    const int received = receive_fd(sockets[1]);
+    if (received < 0) {
+        error = "no fd received";
+        return nullptr;
+    }
+    return shm::MappedBuffer::map(received, error);
+}
+
+} // namespace
+
+int main() {
+    int sockets[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+        std::cerr << "socketpair failed: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    std::string error;
+
+    // Unsealed memfd: the client could still truncate it under the mapping.
+    const int unsealed = make_memfd(MFD_ALLOW_SEALING, false, 0x11);
+    if (exchange(sockets, unsealed, error) || error.find("F_SEAL_SHRINK") == std::string::npos) {
+        std::cerr << "Unsealed memfd accepted: " << error << "\n";
+        return 1;
+    }
+    ::close(unsealed);
+
+    // memfd created without MFD_ALLOW_SEALING can never be sealed.
+    error.clear();
+    const int unsealable = make_memfd(0, false, 0x22);
+    if (exchange(sockets, unsealable, error) || error.find("F_SEAL_SHRINK") == std::string::npos) {
+        std::cerr << "Unsealable memfd accepted: " << error << "\n";
+        return 1;
+    }
+    ::close(unsealable);
+
+    // Not a memfd at all.
+    error.clear();
+    int pipe_fds[2];
+    if (::pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        std::cerr << "pipe2 failed\n";
+        return 1;
+    }
+    if (exchange(sockets, pipe_fds[0], error) || error.find("MFD_ALLOW_SEALING") == std::string::npos) {
+        std::cerr << "Pipe accepted as shared buffer: " << error << "\n";
+        return 1;
+    }
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+
+    // Sealed memfd: mapped, and both sides see each other's writes.
+    error.clear();
+    const int sealed = make_memfd(MFD_ALLOW_SEALING, true, 0x33);
+    auto buffer = exchange(sockets, sealed, error);
+    if (!buffer || buffer->size() != kBufferSize) {
+        std::cerr << "Sealed memfd rejected: " << error << "\n";
+        return 1;
+    }
+    if (buffer->data()[0] != 0x33 || buffer->data()[kBufferSize - 1] != 0x33) {
+        std::cerr << "Mapping does not show the client's bytes\n";
+        return 1;
+    }
+    buffer->data()[100] = 0x44;
+    uint8_t readback = 0;
+    if (::pread(sealed, &readback, 1, 100) != 1 || readback != 0x44) {
+        std::cerr << "Server write not visible to the client\n";
+        return 1;
+    }
+    if (::ftruncate(sealed, kBufferSize / 2) == 0 || errno != EPERM) {
+        std::cerr << "Sealed memfd could be shrunk\n";
+        return 1;
+    }
+
+    // Registered regions are bounds-checked against the mapping.
+    shm::BufferRegistry registry;
+    registry.add(7, buffer);
+    shm::Region region;
+    if (!registry.resolve(7, 100, 8, region, error) || region.data()[0] != 0x44) {
+        std::cerr << "Valid region not resolved: " << error << "\n";
+        return 1;
+    }
+    if (registry.resolve(7, kBufferSize - 4, 8, region, error) || registry.resolve(8, 0, 1, region, error)) {
+        std::cerr << "Out-of-bounds or unknown region resolved\n";
+        return 1;
+    }
+    ::close(sealed);
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+
+    std::cout << "shm_buffers_test passed\n";
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "atlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace atlas {
+
+bool Packer::add(int width, int height, Placement& placement) {
+    // Even bound, so rounding the atlas up to even sizes never crosses it.
+    const int max_side = max_side_ & ~1;
+    const int cell_width = width + 2 * kGutter;
+    const int cell_height = height + 2 * kGutter;
+    if (width <= 0 || height <= 0 || cell_width > max_side || cell_height > max_side) {
+        return false;
+    }
+
+    int x = shelf_x_;
+    int y = shelf_y_;
+    int shelf_height = shelf_height_;
+    if (x + cell_width > max_side) {
+        // Start a new shelf under the current one.
+        x = 0;
+        y += shelf_height;
+        shelf_height = 0;
+    }
+    if (y + cell_height > max_side) {
+        return false;
+    }
+
+    placement.x = x + kGutter;
+    placement.y = y + kGutter;
+    placement.width = width;
+    placement.height = height;
+    shelf_x_ = x + cell_width;
+    shelf_y_ = y;
+    shelf_height_ = std::max(shelf_height, cell_height);
+    width_ = std::max(width_, shelf_x_);
+    return true;
+}
+
+void compose(const std::vector<const image_io::ImagePixels*>& images,
+             const std::vector<Placement>& placements,
+             int width,
+             int height,
+             image_io::ImagePixels& out) {
+    constexpr int ch = 3;
+    out.width = width;
+    out.height = height;
+    out.channels = ch;
+    out.pixels.assign(static_cast<size_t>(width) * height * ch, 0);
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        const image_io::ImagePixels& src = *images[i];
+        const Placement& at = placements[i];
+        const int src_row_bytes = src.width * ch;
+
+        for (int y = -kGutter; y < src.height + kGutter; ++y) {
+            const int src_y = std::clamp(y, 0, src.height - 1);
+            const uint8_t* src_row = src.pixels.data() + static_cast<size_t>(src_y) * src_row_bytes;
+            uint8_t* dst_row = out.pixels.data() + (static_cast<size_t>(at.y + y) * width + at.x) * ch;
+
+            // Gutter columns replicate the edge pixels, like the engine input padding.
+            for (int x = 1; x <= kGutter; ++x) {
+                std::memcpy(dst_row - x * ch, src_row, ch);
+                std::memcpy(dst_row + src_row_bytes + (x - 1) * ch, src_row + src_row_bytes - ch, ch);
+            }
+            std::memcpy(dst_row, src_row, src_row_bytes);
+        }
+    }
+}
+
+bool slice(const image_io::ImagePixels& upscaled,
+           const Placement& placement,
+           int scale,
+           image_io::ImagePixels& out) {
+    constexpr int ch = 3;
+    const int x = placement.x * scale;
+    const int y = placement.y * scale;
+    const int width = placement.width * scale;
+    const int height = placement.height * scale;
+    if (upscaled.channels != ch || x + width > upscaled.width || y + height > upscaled.height) {
+        return false;
+    }
+
+    out.width = width;
+    out.height = height;
+    out.channels = ch;
+    out.pixels.resize(static_cast<size_t>(width) * height * ch);
+    for (int row = 0; row < height; ++row) {
+        const uint8_t* src_row = upscaled.pixels.data() + (static_cast<size_t>(y + row) * upscaled.width + x) * ch;
+        std::memcpy(out.pixels.data() + static_cast<size_t>(row) * width * ch, src_row, static_cast<size_t>(width) * ch);
+    }
+    return true;
+}
+
+} // namespace atlas
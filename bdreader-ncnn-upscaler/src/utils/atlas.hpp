@@ -0,0 +1,70 @@
+#pragma once
+
+#include "image_io.hpp"
+#include "image_padding.hpp"
+
+#include <vector>
+
+/**
+ * Atlas packing: several small images upscaled by a single engine call.
+ *
+ * Each process_rgb() call pays a fixed price (extractor setup, padding,
+ * allocator churn) that dominates for thumbnails and icons. Packing them side
+ * by side into one atlas pays it once; the upscaled atlas is then cut back
+ * into one output per image.
+ *
+ * Every image sits in a cell with a replicated-edge gutter as wide as the
+ * padding process_image() adds around a lone image, so the model sees the
+ * same border either way and neighbours do not bleed into each other.
+ */
+
+namespace atlas {
+
+constexpr int kGutter = image_padding::kDefaultUpscalerPadding;
+
+/// Where an image sits in the atlas (top-left of its pixels, gutter excluded).
+struct Placement {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+/// Shelf packer filling an atlas of at most `max_side` × `max_side` pixels,
+/// in arrival order.
+class Packer {
+public:
+    explicit Packer(int max_side) : max_side_(max_side) {}
+
+    /// Reserve a cell for a `width` × `height` image. False (nothing reserved)
+    /// when it does not fit in what is left of the atlas.
+    bool add(int width, int height, Placement& placement);
+
+    /// Atlas size covering every cell added so far (even, see image_padding::padded_extent()).
+    int width() const { return (width_ + 1) & ~1; }
+    int height() const { return (shelf_y_ + shelf_height_ + 1) & ~1; }
+
+private:
+    int max_side_;
+    int width_ = 0;         // Right edge of the widest shelf
+    int shelf_x_ = 0;       // Next free column on the current shelf
+    int shelf_y_ = 0;       // Top of the current shelf
+    int shelf_height_ = 0;  // Tallest cell on the current shelf
+};
+
+/// Build the atlas: each image at its placement, surrounded by its gutter;
+/// pixels outside every cell are black.
+void compose(const std::vector<const image_io::ImagePixels*>& images,
+             const std::vector<Placement>& placements,
+             int width,
+             int height,
+             image_io::ImagePixels& out);
+
+/// Cut the upscaled pixels of `placement` out of an atlas upscaled by `scale`.
+/// False if the atlas is too small to hold them.
+bool slice(const image_io::ImagePixels& upscaled,
+           const Placement& placement,
+           int scale,
+           image_io::ImagePixels& out);
+
+} // namespace atlas
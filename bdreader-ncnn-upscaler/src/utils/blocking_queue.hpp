@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -84,6 +85,25 @@ public:
         return true;
     }
 
+    /// Pop item, waiting at most until `deadline`
+    /// @param item Output parameter
+    /// @return true if popped, false on timeout or if queue closed and empty
+    template<typename Clock, typename Duration>
+    bool pop_until(T& item, const std::chrono::time_point<Clock, Duration>& deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (!cv_not_empty_.wait_until(lock, deadline, [this]() { return !queue_.empty() || closed_; }) ||
+            queue_.empty()) {
+            return false;
+        }
+
+        item = std::move(queue_.front());
+        queue_.pop();
+        cv_not_full_.notify_one();
+
+        return true;
+    }
+
     /// Try to pop without blocking (non-blocking variant)
     /// @param item Output parameter
     /// @return true if popped, false if empty
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/// Lets long-running work stop early: cancelled explicitly (from another
+/// thread) or because its deadline has passed.
+///
+/// There is no preemption: workers poll stop_reason() between units of work
+/// (tiles, batch items), so a stop takes effect at the next checkpoint.
+class CancelToken {
+public:
+    enum class Reason : uint8_t {
+        None = 0,
+        Cancelled,
+        DeadlineExpired,
+    };
+
+    /// Must be called before the token is shared with other threads.
+    void set_deadline(std::chrono::steady_clock::time_point deadline) {
+        deadline_ = deadline;
+        has_deadline_ = true;
+    }
+
+    /// Thread-safe. No effect once the token has stopped for another reason.
+    void cancel() { latch(Reason::Cancelled); }
+
+    /// Why work should stop, or Reason::None. The first reason observed sticks.
+    Reason stop_reason() const {
+        const Reason reason = reason_.load(std::memory_order_acquire);
+        if (reason != Reason::None || !has_deadline_ || std::chrono::steady_clock::now() < deadline_) {
+            return reason;
+        }
+        return latch(Reason::DeadlineExpired);
+    }
+
+    bool stop_requested() const { return stop_reason() != Reason::None; }
+
+    bool has_deadline() const { return has_deadline_; }
+
+    /// Time until the deadline (negative once past); max() without one.
+    std::chrono::steady_clock::duration time_left() const {
+        if (!has_deadline_) {
+            return std::chrono::steady_clock::duration::max();
+        }
+        return deadline_ - std::chrono::steady_clock::now();
+    }
+
+private:
+    Reason latch(Reason reason) const {
+        Reason expected = Reason::None;
+        if (reason_.compare_exchange_strong(expected, reason, std::memory_order_acq_rel)) {
+            return reason;
+        }
+        return expected;
+    }
+
+    mutable std::atomic<Reason> reason_{Reason::None};
+    std::chrono::steady_clock::time_point deadline_{};
+    bool has_deadline_ = false;
+};
@@ -0,0 +1,113 @@
+#include "utils/content_hash.hpp"
+
+#include <cstring>
+
+namespace content_hash {
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+constexpr uint64_t kSecondSeed = 0x5BD1E9955BD1E995ULL;
+
+inline uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Little-endian host assumed, like the rest of the protocol code.
+inline uint64_t read64(const uint8_t* ptr) {
+    uint64_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline uint32_t read32(const uint8_t* ptr) {
+    uint32_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+    acc ^= round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace
+
+uint64_t xxh64(const uint8_t* data, size_t size, uint64_t seed) {
+    const uint8_t* ptr = data;
+    const uint8_t* const end = data + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        const uint8_t* const limit = end - 32;
+        do {
+            v1 = round(v1, read64(ptr));
+            v2 = round(v2, read64(ptr + 8));
+            v3 = round(v3, read64(ptr + 16));
+            v4 = round(v4, read64(ptr + 24));
+            ptr += 32;
+        } while (ptr <= limit);
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge_round(hash, v1);
+        hash = merge_round(hash, v2);
+        hash = merge_round(hash, v3);
+        hash = merge_round(hash, v4);
+    } else {
+        hash = seed + kPrime5;
+    }
+
+    hash += static_cast<uint64_t>(size);
+    while (ptr + 8 <= end) {
+        hash ^= round(0, read64(ptr));
+        hash = rotl(hash, 27) * kPrime1 + kPrime4;
+        ptr += 8;
+    }
+    if (ptr + 4 <= end) {
+        hash ^= static_cast<uint64_t>(read32(ptr)) * kPrime1;
+        hash = rotl(hash, 23) * kPrime2 + kPrime3;
+        ptr += 4;
+    }
+    while (ptr < end) {
+        hash ^= static_cast<uint64_t>(*ptr) * kPrime5;
+        hash = rotl(hash, 11) * kPrime1;
+        ++ptr;
+    }
+
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+Digest hash128(const uint8_t* data, size_t size) {
+    return Digest{xxh64(data, size, 0), xxh64(data, size, kSecondSeed)};
+}
+
+std::string Digest::hex() const {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string out(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        out[15 - i] = kDigits[(high >> (4 * i)) & 0xF];
+        out[31 - i] = kDigits[(low >> (4 * i)) & 0xF];
+    }
+    return out;
+}
+
+} // namespace content_hash
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Fast non-cryptographic hashing of image payloads, for content-addressed
+/// caching. Not suitable against adversarial collisions.
+namespace content_hash {
+
+struct Digest {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    /// 32 lowercase hex characters.
+    std::string hex() const;
+};
+
+/// XXH64 of `data` with `seed`.
+uint64_t xxh64(const uint8_t* data, size_t size, uint64_t seed);
+
+/// 128-bit digest: two XXH64 passes with independent seeds, which keeps
+/// accidental collisions out of reach for any realistic cache size.
+Digest hash128(const uint8_t* data, size_t size);
+
+} // namespace content_hash
@@ -0,0 +1,218 @@
+#include "utils/fd_frame_reader.hpp"
+
+#include "utils/fd_io.hpp"
+#include "utils/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+// Pipe capacity we ask for when reading from a pipe. The kernel caps this at
+// /proc/sys/fs/pipe-max-size (1 MB by default) for unprivileged processes.
+constexpr int kPipeCapacity = 1 << 20;
+
+bool wait_readable(int fd) {
+    struct pollfd pfd{};
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (true) {
+        const int ready = ::poll(&pfd, 1, -1);
+        if (ready > 0) {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+} // namespace
+
+FdFrameReader::FdFrameReader(int fd, size_t buffer_size)
+    : fd_(fd),
+      capacity_(std::max<size_t>(buffer_size, 64)) {
+    struct stat st{};
+    if (::fstat(fd_, &st) != 0) {
+        return;
+    }
+    socket_ = S_ISSOCK(st.st_mode);
+#ifdef F_SETPIPE_SZ
+    if (S_ISFIFO(st.st_mode)) {
+        const int current = ::fcntl(fd_, F_GETPIPE_SZ);
+        if (current >= 0 && current < kPipeCapacity && ::fcntl(fd_, F_SETPIPE_SZ, kPipeCapacity) < 0) {
+            logger::info("Could not enlarge stdin pipe buffer (" + std::string(std::strerror(errno)) + ")");
+        }
+    }
+#endif
+}
+
+FdFrameReader::~FdFrameReader() {
+    for (int fd : received_fds_) {
+        ::close(fd);
+    }
+}
+
+int FdFrameReader::take_received_fd() {
+    if (received_fds_.empty()) {
+        return -1;
+    }
+    const int fd = received_fds_.front();
+    received_fds_.pop_front();
+    return fd;
+}
+
+long FdFrameReader::read_some(const struct iovec* iov, int count) {
+    while (true) {
+        const ssize_t got = socket_ ? fd_io::receive(fd_, iov, count, received_fds_)
+                            : count == 1 ? ::read(fd_, iov[0].iov_base, iov[0].iov_len)
+                                         : ::readv(fd_, iov, count);
+        if (got > 0) {
+            bytes_read_ += static_cast<uint64_t>(got);
+            return static_cast<long>(got);
+        }
+        if (got == 0) {
+            eof_ = true;
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_readable(fd_)) {
+            continue;
+        }
+        logger::error("read() failed on fd " + std::to_string(fd_) + ": " + std::strerror(errno));
+        return -1;
+    }
+}
+
+long FdFrameReader::read_some(uint8_t* dst, size_t size) {
+    struct iovec iov{};
+    iov.iov_base = dst;
+    iov.iov_len = size;
+    return read_some(&iov, 1);
+}
+
+bool FdFrameReader::fill() {
+    if (!buffer_) {
+        buffer_.reset(new uint8_t[capacity_]);
+    }
+    begin_ = 0;
+    end_ = 0;
+    const long got = read_some(buffer_.get(), capacity_);
+    if (got <= 0) {
+        return false;
+    }
+    end_ = static_cast<size_t>(got);
+    return true;
+}
+
+bool FdFrameReader::read_exact(uint8_t* dst, size_t size) {
+    // Serve what is already buffered first.
+    const size_t buffered = std::min(size, end_ - begin_);
+    if (buffered > 0) {
+        std::memcpy(dst, buffer_.get() + begin_, buffered);
+        begin_ += buffered;
+        dst += buffered;
+        size -= buffered;
+    }
+
+    while (size > 0) {
+        if (size >= capacity_ / 2) {
+            // Bulk payload: read straight into the destination, and let the same
+            // readv() top up the staging buffer with whatever follows (usually
+            // the next frame's length prefix).
+            if (!buffer_) {
+                buffer_.reset(new uint8_t[capacity_]);
+            }
+            struct iovec iov[2];
+            iov[0].iov_base = dst;
+            iov[0].iov_len = size;
+            iov[1].iov_base = buffer_.get();
+            iov[1].iov_len = capacity_;
+            const long got = read_some(iov, 2);
+            if (got <= 0) {
+                return false;
+            }
+            if (static_cast<size_t>(got) > size) {
+                begin_ = 0;
+                end_ = static_cast<size_t>(got) - size;
+                return true;
+            }
+            dst += got;
+            size -= static_cast<size_t>(got);
+            continue;
+        }
+
+        // Small read: refill the staging buffer, which also picks up the start
+        // of the following frames in the same syscall.
+        if (!fill()) {
+            return false;
+        }
+        const size_t chunk = std::min(size, end_);
+        std::memcpy(dst, buffer_.get(), chunk);
+        begin_ = chunk;
+        dst += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool FdFrameReader::read_u32(uint32_t& value) {
+    uint8_t bytes[4];
+    if (!read_exact(bytes, sizeof(bytes))) {
+        return false;
+    }
+    value = static_cast<uint32_t>(bytes[0]) |
+            (static_cast<uint32_t>(bytes[1]) << 8) |
+            (static_cast<uint32_t>(bytes[2]) << 16) |
+            (static_cast<uint32_t>(bytes[3]) << 24);
+    return true;
+}
+
+bool FdFrameReader::discard(size_t size) {
+    while (size > 0) {
+        if (begin_ == end_ && !fill()) {
+            return false;
+        }
+        const size_t chunk = std::min(size, end_ - begin_);
+        begin_ += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool FdFrameReader::read_to_end(std::vector<uint8_t>& out) {
+    if (begin_ != end_) {
+        out.insert(out.end(), buffer_.get() + begin_, buffer_.get() + end_);
+        begin_ = end_ = 0;
+    }
+
+    // Regular file: we know how much is coming. Otherwise start small (a
+    // thumbnail must not pay for a large zero-filled vector) and double.
+    size_t grow = 64u * 1024u;
+    struct stat st{};
+    if (::fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        grow = static_cast<size_t>(st.st_size) + 1;  // +1 so the final read sees EOF without regrowing
+    }
+
+    size_t used = out.size();
+    while (!eof_) {
+        if (out.size() - used == 0) {
+            out.resize(used + std::max(grow, used));
+        }
+        const long got = read_some(out.data() + used, out.size() - used);
+        if (got < 0) {
+            out.resize(used);
+            return false;
+        }
+        used += static_cast<size_t>(got);
+    }
+    out.resize(used);
+    return true;
+}
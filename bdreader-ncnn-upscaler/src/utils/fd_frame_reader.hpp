@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+/// Buffered reader over a raw file descriptor (stdin in practice).
+///
+/// Replaces std::istream for protocol input: small fields (frame lengths,
+/// headers of tiny frames) are served from an internal staging buffer filled
+/// with large read() calls, while bulk reads (frame payloads) that exceed the
+/// buffered bytes go straight from the kernel into the caller's buffer, so a
+/// 20 MB frame lands in its FrameBuffer without an intermediate copy.
+///
+/// When the fd is a pipe, the pipe buffer is enlarged (F_SETPIPE_SZ) so the
+/// writer can run further ahead of us between reads. When it is a Unix socket,
+/// reads go through recvmsg() and file descriptors passed with SCM_RIGHTS are
+/// queued for take_received_fd().
+///
+/// Not thread-safe; one reader thread owns it.
+class FdFrameReader {
+public:
+    /// Staging buffer size. Bytes that land here ahead of a large payload cost
+    /// one memcpy, so it is kept small; it only needs to batch tiny frames.
+    static constexpr size_t kDefaultBufferSize = 128u * 1024u;
+
+    explicit FdFrameReader(int fd, size_t buffer_size = kDefaultBufferSize);
+    ~FdFrameReader();
+
+    FdFrameReader(const FdFrameReader&) = delete;
+    FdFrameReader& operator=(const FdFrameReader&) = delete;
+
+    /// Read exactly `size` bytes into `dst`.
+    /// @return false on EOF or error before `size` bytes (see eof()).
+    bool read_exact(uint8_t* dst, size_t size);
+
+    /// Read a little-endian uint32_t.
+    bool read_u32(uint32_t& value);
+
+    /// Skip `size` bytes.
+    bool discard(size_t size);
+
+    /// Append everything up to EOF to `out` (legacy single-shot mode).
+    /// Reads straight into `out` (no staging copy), growing it geometrically.
+    /// @return false on a read error (EOF is success)
+    bool read_to_end(std::vector<uint8_t>& out);
+
+    /// True once read() returned 0 (peer closed), as opposed to an I/O error.
+    bool eof() const { return eof_; }
+
+    /// True when reading from a Unix socket (file descriptors can be received).
+    bool is_socket() const { return socket_; }
+
+    /// Oldest file descriptor received and not yet taken (caller owns it), or
+    /// -1. An fd sent along with a frame has always been received by the time
+    /// that frame's bytes have been read.
+    int take_received_fd();
+
+    /// Total bytes consumed from the fd so far.
+    uint64_t bytes_read() const { return bytes_read_; }
+
+private:
+    /// Refill the staging buffer (which must be empty). Returns false on EOF/error.
+    bool fill();
+    /// One read()/readv() retried on EINTR and waited on EAGAIN. Returns bytes
+    /// read, 0 on EOF, -1 on error.
+    long read_some(const struct iovec* iov, int count);
+    long read_some(uint8_t* dst, size_t size);
+
+    int fd_;
+    std::unique_ptr<uint8_t[]> buffer_;  // Allocated on first use
+    size_t capacity_;
+    size_t begin_ = 0;  // First unread byte in buffer_
+    size_t end_ = 0;    // One past the last buffered byte
+    bool eof_ = false;
+    bool socket_ = false;
+    std::deque<int> received_fds_;
+    uint64_t bytes_read_ = 0;
+};
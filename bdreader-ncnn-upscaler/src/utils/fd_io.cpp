@@ -0,0 +1,125 @@
+#include "utils/fd_io.hpp"
+
+#include "utils/logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace fd_io {
+namespace {
+#ifdef IOV_MAX
+constexpr size_t kMaxIovPerCall = IOV_MAX;
+#else
+constexpr size_t kMaxIovPerCall = 1024;
+#endif
+
+bool wait_writable(int fd) {
+    struct pollfd pfd{};
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    while (true) {
+        const int ready = ::poll(&pfd, 1, -1);
+        if (ready > 0) {
+            // POLLERR/POLLHUP: let the next write report the actual error.
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+} // namespace
+
+bool write_available(int fd, struct iovec*& iov, size_t& count) {
+    // Skip leading empty entries so the loop only sees pending data.
+    while (count > 0 && iov->iov_len == 0) {
+        ++iov;
+        --count;
+    }
+
+    while (count > 0) {
+        const int batch = static_cast<int>(std::min(count, kMaxIovPerCall));
+        const ssize_t written = ::writev(fd, iov, batch);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        // Advance past fully written entries, then trim the partially written one.
+        size_t remaining = static_cast<size_t>(written);
+        while (count > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0 && remaining > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
+        }
+        while (count > 0 && iov->iov_len == 0) {
+            ++iov;
+            --count;
+        }
+    }
+    return true;
+}
+
+bool write_all(int fd, struct iovec* iov, size_t count) {
+    while (true) {
+        if (!write_available(fd, iov, count)) {
+            return false;
+        }
+        if (count == 0) {
+            return true;
+        }
+        if (!wait_writable(fd)) {
+            return false;
+        }
+    }
+}
+
+bool write_all(int fd, const void* data, size_t size) {
+    struct iovec iov{};
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    return write_all(fd, &iov, 1);
+}
+
+ssize_t receive(int fd, const struct iovec* iov, int count, std::deque<int>& fds) {
+    constexpr size_t kMaxFdsPerMessage = 16;
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxFdsPerMessage)];
+    struct msghdr msg{};
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = static_cast<size_t>(count);
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    const ssize_t got = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (got < 0) {
+        return got;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const size_t fd_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < fd_count; ++i) {
+            int received = -1;
+            std::memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            fds.push_back(received);
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        logger::warn("Received more file descriptors than expected in one message; extra ones were dropped");
+    }
+    return got;
+}
+
+} // namespace fd_io
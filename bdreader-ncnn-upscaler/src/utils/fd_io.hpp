@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace fd_io {
+
+/// Write every byte described by `iov` to `fd`.
+///
+/// Uses writev() so a header plus several large buffers go out in as few
+/// syscalls as possible, and resumes after partial writes, EINTR, and
+/// EAGAIN/EWOULDBLOCK (waiting for POLLOUT when `fd` is non-blocking).
+/// `iov` is modified in place while progressing.
+/// @return false on a hard error (EPIPE, closed peer, ...)
+bool write_all(int fd, struct iovec* iov, size_t count);
+
+/// Non-blocking counterpart of write_all(): write what `fd` accepts right
+/// now and return on EAGAIN/EWOULDBLOCK instead of waiting. `iov`/`count`
+/// are advanced past the bytes written (`count` is 0 once everything is out).
+/// @return false on a hard error (EPIPE, closed peer, ...)
+bool write_available(int fd, struct iovec*& iov, size_t& count);
+
+/// Convenience overload for a single contiguous buffer.
+bool write_all(int fd, const void* data, size_t size);
+
+/// One recvmsg() into `iov` on a Unix socket; file descriptors passed with
+/// SCM_RIGHTS are appended to `fds` (close-on-exec, caller owns them).
+/// No retry: returns recvmsg()'s result, errno set on -1.
+ssize_t receive(int fd, const struct iovec* iov, int count, std::deque<int>& fds);
+
+} // namespace fd_io
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Uninitialized byte buffer holding one protocol frame.
+///
+/// Unlike std::vector<uint8_t>, resizing within capacity never zero-fills, so a
+/// recycled 64 MB buffer costs nothing before the next read overwrites it.
+class FrameBuffer {
+public:
+    explicit FrameBuffer(size_t capacity)
+        : storage_(new uint8_t[capacity]), capacity_(capacity) {}
+
+    uint8_t* data() { return storage_.get(); }
+    const uint8_t* data() const { return storage_.get(); }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+
+    /// Set the logical size; must not exceed capacity().
+    void set_size(size_t size) { size_ = size; }
+
+private:
+    std::unique_ptr<uint8_t[]> storage_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+};
+
+/// Recycles frame buffers between keep-alive requests.
+///
+/// acquire() hands out a shared_ptr whose deleter returns the buffer to the
+/// pool once the last reference (reader, parsed request, pipeline job) drops,
+/// instead of freeing it. The pool keeps at most `max_buffers` idle buffers and
+/// `max_retained_bytes` of idle capacity; anything beyond is freed. Buffers may
+/// outlive the pool: they are then simply deleted.
+///
+/// Usage:
+///   auto pool = FrameBufferPool::create(4, 128u << 20);
+///   std::shared_ptr<FrameBuffer> frame = pool->acquire(message_len);
+class FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool> {
+public:
+    static std::shared_ptr<FrameBufferPool> create(size_t max_buffers, size_t max_retained_bytes) {
+        return std::shared_ptr<FrameBufferPool>(new FrameBufferPool(max_buffers, max_retained_bytes));
+    }
+
+    /// Get a buffer with size() == `size` (contents unspecified).
+    /// Reuses the smallest idle buffer that fits, or allocates a new one.
+    std::shared_ptr<FrameBuffer> acquire(size_t size) {
+        std::unique_ptr<FrameBuffer> buffer;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t best = idle_.size();
+            for (size_t i = 0; i < idle_.size(); ++i) {
+                if (idle_[i]->capacity() >= size &&
+                    (best == idle_.size() || idle_[i]->capacity() < idle_[best]->capacity())) {
+                    best = i;
+                }
+            }
+            if (best != idle_.size()) {
+                buffer = std::move(idle_[best]);
+                idle_.erase(idle_.begin() + static_cast<std::ptrdiff_t>(best));
+                idle_bytes_ -= buffer->capacity();
+            }
+        }
+        if (!buffer) {
+            buffer = std::make_unique<FrameBuffer>(size);
+        }
+        buffer->set_size(size);
+
+        std::weak_ptr<FrameBufferPool> weak_pool = shared_from_this();
+        return std::shared_ptr<FrameBuffer>(buffer.release(), [weak_pool](FrameBuffer* released) {
+            std::unique_ptr<FrameBuffer> owned(released);
+            if (auto pool = weak_pool.lock()) {
+                pool->recycle(std::move(owned));
+            }
+        });
+    }
+
+    /// Idle buffers currently retained (for diagnostics/tests).
+    size_t idle_count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return idle_.size();
+    }
+
+private:
+    FrameBufferPool(size_t max_buffers, size_t max_retained_bytes)
+        : max_buffers_(max_buffers), max_retained_bytes_(max_retained_bytes) {}
+
+    void recycle(std::unique_ptr<FrameBuffer> buffer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.size() >= max_buffers_ || idle_bytes_ + buffer->capacity() > max_retained_bytes_) {
+            return;  // Over budget: let the buffer be freed
+        }
+        idle_bytes_ += buffer->capacity();
+        idle_.push_back(std::move(buffer));
+    }
+
+    const size_t max_buffers_;
+    const size_t max_retained_bytes_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<FrameBuffer>> idle_;
+    size_t idle_bytes_ = 0;
+};
@@ -1,7 +1,10 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <condition_variable>
 #include <cstring>
+#include <limits>
+#include <mutex>
 #include <utility>
 #include <webp/decode.h>
 #include <webp/encode.h>
@@ -114,6 +117,51 @@ struct WebPPictureRAII {
     WebPPicture* get() { return initialized ? &pic : nullptr; }
     bool is_initialized() const { return initialized; }
 };
+
+// stb_image_write takes its PNG zlib level and row filter from process-wide
+// globals. Holding a PngSettings pins them for one encode: encoders asking for
+// the same settings run concurrently, a change waits until the encoders using
+// the previous ones are done.
+class PngSettings {
+public:
+    PngSettings(int level, int filter) {
+        std::unique_lock<std::mutex> lock(state().mutex);
+        state().changed.wait(lock, [&] {
+            return state().users == 0 || (state().level == level && state().filter == filter);
+        });
+        if (state().users == 0) {
+            state().level = level;
+            state().filter = filter;
+            stbi_write_png_compression_level = level;
+            stbi_write_force_png_filter = filter;
+        }
+        ++state().users;
+    }
+
+    ~PngSettings() {
+        std::lock_guard<std::mutex> lock(state().mutex);
+        if (--state().users == 0) {
+            state().changed.notify_all();
+        }
+    }
+
+    PngSettings(const PngSettings&) = delete;
+    PngSettings& operator=(const PngSettings&) = delete;
+
+private:
+    struct State {
+        std::mutex mutex;
+        std::condition_variable changed;
+        int level = 8;
+        int filter = -1;
+        size_t users = 0;
+    };
+
+    static State& state() {
+        static State instance;
+        return instance;
+    }
+};
 } // namespace
 
 namespace image_io {
@@ -148,8 +196,34 @@ bool decode_image(const uint8_t* data, size_t size, ImagePixels& out) {
     return true;
 }
 
-bool encode_image(const ImagePixels& img, const std::string& format, std::vector<uint8_t>& out) {
-    out.clear();
+bool probe_dimensions(const uint8_t* data, size_t size, int& width, int& height) {
+    if (!data || size == 0 || size > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        return false;
+    }
+    int channels = 0;
+    return stbi_info_from_memory(data, static_cast<int>(size), &width, &height, &channels) != 0;
+}
+
+const char* encode_effort_name(EncodeEffort effort) {
+    switch (effort) {
+        case EncodeEffort::Fast:
+            return "fast";
+        case EncodeEffort::Best:
+            return "best";
+        default:
+            return "balanced";
+    }
+}
+
+bool encode_image(const ImagePixels& img, const std::string& format, std::vector<uint8_t>& out, EncodeEffort effort) {
+    EncodedImage encoded;
+    const bool ok = encode_image(img, format, encoded, effort);
+    out = std::move(encoded).into_vector();
+    return ok;
+}
+
+bool encode_image(const ImagePixels& img, const std::string& format, EncodedImage& out, EncodeEffort effort) {
+    out = EncodedImage();
     const int quality = 90;
     std::string fmt = format.empty() ? "webp" : format;
     std::transform(fmt.begin(), fmt.end(), fmt.begin(), [](unsigned char c) { return std::tolower(c); });
@@ -168,6 +242,18 @@ bool encode_image(const ImagePixels& img, const std::string& format, std::vector
             return false;
         }
         config.quality = quality;
+        switch (effort) {
+            case EncodeEffort::Fast:
+                config.method = 0;
+                config.filter_strength = 20;
+                break;
+            case EncodeEffort::Balanced:
+                break;  // libwebp defaults: method 4, filter_strength 60
+            case EncodeEffort::Best:
+                config.method = 6;
+                config.autofilter = 1;
+                break;
+        }
 
         WebPPictureRAII pic_raii;
         if (!pic_raii.is_initialized()) {
@@ -189,18 +275,24 @@ bool encode_image(const ImagePixels& img, const std::string& format, std::vector
 
         const bool ok = WebPEncode(&config, pic) != 0;
         if (ok) {
+            // Adopt libwebp's buffer; the RAII wrapper then clears an empty writer.
             WebPMemoryWriter* writer = writer_raii.get();
-            out.assign(writer->mem, writer->mem + writer->size);
+            out = EncodedImage::adopt(writer->mem, writer->size, WebPFree);
+            writer->mem = nullptr;
+            writer->size = 0;
+            writer->max_size = 0;
         }
         return ok;
     }
 
     if (fmt == "png") {
-        return stbi_write_png_to_func(write_callback, &out, img.width, img.height, img.channels, img.pixels.data(), img.width * img.channels) != 0;
+        const bool fast = effort == EncodeEffort::Fast;
+        PngSettings settings(fast ? 5 : effort == EncodeEffort::Best ? 12 : 8, fast ? 4 : -1);
+        return stbi_write_png_to_func(write_callback, &out.bytes(), img.width, img.height, img.channels, img.pixels.data(), img.width * img.channels) != 0;
     }
 
     if (fmt == "jpg" || fmt == "jpeg") {
-        return stbi_write_jpg_to_func(write_callback, &out, img.width, img.height, img.channels, img.pixels.data(), quality) != 0;
+        return stbi_write_jpg_to_func(write_callback, &out.bytes(), img.width, img.height, img.channels, img.pixels.data(), quality) != 0;
     }
 
     return false;
@@ -2,7 +2,9 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace image_io {
@@ -14,7 +16,90 @@ struct ImagePixels {
     std::vector<uint8_t> pixels;
 };
 
+/// Encoded (compressed) image bytes.
+///
+/// Owns either a std::vector (stb encoders append into it) or a buffer adopted
+/// from a C encoder (libwebp's WebPMemoryWriter), so encoder output can be moved
+/// all the way to the response writer without an extra copy.
+class EncodedImage {
+public:
+    EncodedImage() = default;
+    explicit EncodedImage(std::vector<uint8_t> bytes) : bytes_(std::move(bytes)) {}
+
+    /// Take ownership of `data`, released later with `free_fn`.
+    static EncodedImage adopt(uint8_t* data, size_t size, void (*free_fn)(void*)) {
+        EncodedImage image;
+        image.foreign_ = std::unique_ptr<uint8_t, ForeignFree>(data, ForeignFree{free_fn});
+        image.foreign_size_ = size;
+        return image;
+    }
+
+    const uint8_t* data() const { return foreign_ ? foreign_.get() : bytes_.data(); }
+    size_t size() const { return foreign_ ? foreign_size_ : bytes_.size(); }
+    bool empty() const { return size() == 0; }
+
+    /// Vector the stb write callbacks append to (only meaningful when nothing
+    /// has been adopted).
+    std::vector<uint8_t>& bytes() { return bytes_; }
+
+    /// Convert to a plain vector; copies only when the bytes were adopted.
+    std::vector<uint8_t> into_vector() && {
+        if (!foreign_) {
+            return std::move(bytes_);
+        }
+        std::vector<uint8_t> copy(foreign_.get(), foreign_.get() + foreign_size_);
+        foreign_.reset();
+        foreign_size_ = 0;
+        return copy;
+    }
+
+private:
+    struct ForeignFree {
+        void (*free_fn)(void*);  // Value-initialized (null) by unique_ptr
+        void operator()(uint8_t* ptr) const {
+            if (ptr && free_fn) {
+                free_fn(ptr);
+            }
+        }
+    };
+
+    std::vector<uint8_t> bytes_;
+    std::unique_ptr<uint8_t, ForeignFree> foreign_;
+    size_t foreign_size_ = 0;
+};
+
+/// How much CPU the encoders spend for a smaller output. The quality setting
+/// is the same at every level (WebP and JPEG stay at quality 90, PNG is
+/// lossless), but lossy WebP output differs: the method and deblocking filter
+/// change the decoded pixels, not only the size.
+///
+///   Fast      WebP method 0, weaker deblocking filter; PNG zlib level 5, Paeth filter on every row
+///   Balanced  WebP method 4, filter strength 60 (libwebp defaults); PNG level 8, best filter per row
+///   Best      WebP method 6, filter strength searched; PNG level 12, best filter per row
+///
+/// stb's JPEG encoder has no effort setting: JPEG output is the same at every level.
+enum class EncodeEffort : uint8_t {
+    Fast = 0,
+    Balanced = 1,
+    Best = 2,
+};
+
+constexpr size_t kEncodeEffortCount = 3;
+
+/// "fast", "balanced" or "best".
+const char* encode_effort_name(EncodeEffort effort);
+
 bool decode_image(const uint8_t* data, size_t size, ImagePixels& out);
-bool encode_image(const ImagePixels& img, const std::string& format, std::vector<uint8_t>& out);
+/// Image dimensions read from the file header only (no pixel decoding).
+bool probe_dimensions(const uint8_t* data, size_t size, int& width, int& height);
+bool encode_image(const ImagePixels& img,
+                  const std::string& format,
+                  std::vector<uint8_t>& out,
+                  EncodeEffort effort = EncodeEffort::Balanced);
+/// Same as above, but hands over the encoder's own output buffer (no copy).
+bool encode_image(const ImagePixels& img,
+                  const std::string& format,
+                  EncodedImage& out,
+                  EncodeEffort effort = EncodeEffort::Balanced);
 
 } // namespace image_io
@@ -0,0 +1,197 @@
+#include "input_staging.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BDREADER_STAGING_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BDREADER_STAGING_NEON 1
+#endif
+
+namespace input_staging {
+
+namespace {
+
+void row_scalar(const uint8_t* src, int count, float scale, float* r, float* g, float* b) {
+    for (int x = 0; x < count; ++x) {
+        r[x] = static_cast<float>(src[x * 3 + 0]) * scale;
+        g[x] = static_cast<float>(src[x * 3 + 1]) * scale;
+        b[x] = static_cast<float>(src[x * 3 + 2]) * scale;
+    }
+}
+
+#if BDREADER_STAGING_X86
+
+/// Split 16 RGB pixels (48 bytes) into 16 R, 16 G and 16 B bytes.
+__attribute__((target("ssse3")))
+inline void deinterleave16(const uint8_t* src, __m128i& r, __m128i& g, __m128i& b) {
+    const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+    const __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+    r = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    b = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+__attribute__((target("ssse3")))
+inline void store16_sse(__m128i bytes, __m128 scale, float* dst) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+    _mm_storeu_ps(dst + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+    _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+    _mm_storeu_ps(dst + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+    _mm_storeu_ps(dst + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+}
+
+__attribute__((target("ssse3")))
+void row_ssse3(const uint8_t* src, int count, float scale, float* r, float* g, float* b) {
+    const __m128 factor = _mm_set1_ps(scale);
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i rv, gv, bv;
+        deinterleave16(src + x * 3, rv, gv, bv);
+        store16_sse(rv, factor, r + x);
+        store16_sse(gv, factor, g + x);
+        store16_sse(bv, factor, b + x);
+    }
+    row_scalar(src + x * 3, count - x, scale, r + x, g + x, b + x);
+}
+
+__attribute__((target("avx2")))
+inline void store16_avx2(__m128i bytes, __m256 scale, float* dst) {
+    _mm256_storeu_ps(dst + 0, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), scale));
+    _mm256_storeu_ps(dst + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8))), scale));
+}
+
+__attribute__((target("avx2")))
+void row_avx2(const uint8_t* src, int count, float scale, float* r, float* g, float* b) {
+    const __m256 factor = _mm256_set1_ps(scale);
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i rv, gv, bv;
+        deinterleave16(src + x * 3, rv, gv, bv);
+        store16_avx2(rv, factor, r + x);
+        store16_avx2(gv, factor, g + x);
+        store16_avx2(bv, factor, b + x);
+    }
+    row_scalar(src + x * 3, count - x, scale, r + x, g + x, b + x);
+}
+
+#elif BDREADER_STAGING_NEON
+
+inline void store16_neon(uint8x16_t bytes, float scale, float* dst) {
+    const uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+    const uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+    vst1q_f32(dst + 0, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), scale));
+    vst1q_f32(dst + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), scale));
+    vst1q_f32(dst + 8, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), scale));
+    vst1q_f32(dst + 12, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), scale));
+}
+
+void row_neon(const uint8_t* src, int count, float scale, float* r, float* g, float* b) {
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        const uint8x16x3_t rgb = vld3q_u8(src + x * 3);
+        store16_neon(rgb.val[0], scale, r + x);
+        store16_neon(rgb.val[1], scale, g + x);
+        store16_neon(rgb.val[2], scale, b + x);
+    }
+    row_scalar(src + x * 3, count - x, scale, r + x, g + x, b + x);
+}
+
+#endif
+
+Kernel select_kernel() {
+#if BDREADER_STAGING_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {row_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return {row_ssse3, "ssse3"};
+    }
+#elif BDREADER_STAGING_NEON
+    return {row_neon, "neon"};
+#endif
+    return {row_scalar, "scalar"};
+}
+
+const Kernel& kernel() {
+    static const Kernel selected = select_kernel();
+    return selected;
+}
+
+} // namespace
+
+void stage_planar(const RgbView& src, int padding, int out_width, int out_height, float scale,
+                  float* planes, size_t plane_stride) {
+    stage_planar(src, padding, out_width, out_height, scale, planes, plane_stride, kernel().row);
+}
+
+void stage_planar(const RgbView& src, int padding, int out_width, int out_height, float scale,
+                  float* planes, size_t plane_stride, RowKernel row) {
+    if (!src.data || src.width <= 0 || src.height <= 0) {
+        return;
+    }
+    float* channels[3] = {planes, planes + plane_stride, planes + plane_stride * 2};
+    const size_t row_bytes = static_cast<size_t>(out_width) * sizeof(float);
+    const auto out_row = [&](int c, int y) { return channels[c] + static_cast<size_t>(y) * out_width; };
+
+    // Source rows: one kernel call, then the left/right edge pixels repeated.
+    for (int y = 0; y < src.height; ++y) {
+        const int dst_y = padding + y;
+        row(src.data + static_cast<size_t>(y) * src.stride, src.width, scale,
+            out_row(0, dst_y) + padding, out_row(1, dst_y) + padding, out_row(2, dst_y) + padding);
+        for (int c = 0; c < 3; ++c) {
+            float* dst = out_row(c, dst_y);
+            std::fill(dst, dst + padding, dst[padding]);
+            std::fill(dst + padding + src.width, dst + out_width, dst[padding + src.width - 1]);
+        }
+    }
+
+    // Rows above and below repeat the first and last staged rows.
+    const int last_y = padding + src.height - 1;
+    for (int c = 0; c < 3; ++c) {
+        for (int y = 0; y < padding; ++y) {
+            std::memcpy(out_row(c, y), out_row(c, padding), row_bytes);
+        }
+        for (int y = last_y + 1; y < out_height; ++y) {
+            std::memcpy(out_row(c, y), out_row(c, last_y), row_bytes);
+        }
+    }
+}
+
+const char* kernel_name() {
+    return kernel().name;
+}
+
+std::vector<Kernel> supported_kernels() {
+    std::vector<Kernel> kernels{{row_scalar, "scalar"}};
+#if BDREADER_STAGING_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        kernels.push_back({row_ssse3, "ssse3"});
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({row_avx2, "avx2"});
+    }
+#elif BDREADER_STAGING_NEON
+    kernels.push_back({row_neon, "neon"});
+#endif
+    return kernels;
+}
+
+} // namespace input_staging
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Builds the network input in one pass over the source pixels: edge-replicate
+/// padding, even alignment (see image_padding::padded_extent()), uint8 → float
+/// scaling and RGB deinterleaving into planes, with no intermediate buffer.
+namespace input_staging {
+
+/// Interleaved RGB8 region of a larger image (e.g. one tile of the decoded
+/// image): `height` rows of `width` pixels, `stride` bytes apart.
+struct RgbView {
+    const uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t stride = 0;
+};
+
+/// Write `src` as three planes of `out_width` x `out_height` floats (plane c
+/// at `planes + c * plane_stride`), each value multiplied by `scale`. The
+/// source lands at (`padding`, `padding`); the pixels around it repeat the
+/// nearest source edge pixel. `out_width`/`out_height` must be at least
+/// `padding` plus the source extent.
+void stage_planar(const RgbView& src, int padding, int out_width, int out_height, float scale,
+                  float* planes, size_t plane_stride);
+
+/// Row kernel picked for this CPU ("avx2", "ssse3", "neon" or "scalar").
+const char* kernel_name();
+
+/// Deinterleave `count` RGB8 pixels into three float rows, times `scale`.
+using RowKernel = void (*)(const uint8_t* src, int count, float scale, float* r, float* g, float* b);
+
+struct Kernel {
+    RowKernel row;
+    const char* name;
+};
+
+/// Every row kernel of this build that this CPU can run, scalar first. For
+/// tests: stage_planar() always uses the one kernel_name() names.
+std::vector<Kernel> supported_kernels();
+
+/// stage_planar() with the given row kernel.
+void stage_planar(const RgbView& src, int padding, int out_width, int out_height, float scale,
+                  float* planes, size_t plane_stride, RowKernel row);
+
+} // namespace input_staging
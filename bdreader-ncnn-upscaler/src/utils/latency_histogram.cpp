@@ -0,0 +1,61 @@
+#include "utils/latency_histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+size_t LatencyHistogram::bucket_index(uint64_t ns) {
+    if (ns < kSubBuckets) {
+        return static_cast<size_t>(ns);
+    }
+    const unsigned exponent = 63u - static_cast<unsigned>(__builtin_clzll(ns));
+    const unsigned shift = exponent - kSubBucketBits;
+    const uint64_t mantissa = (ns >> shift) & (kSubBuckets - 1);
+    return static_cast<size_t>(kSubBuckets + shift * kSubBuckets + mantissa);
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(size_t index) {
+    if (index < kSubBuckets) {
+        return index;
+    }
+    const unsigned shift = static_cast<unsigned>((index - kSubBuckets) / kSubBuckets);
+    const uint64_t mantissa = (index - kSubBuckets) % kSubBuckets;
+    const uint64_t lower = (kSubBuckets + mantissa) << shift;
+    return lower + ((uint64_t{1} << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t seen = max_ns_.load(std::memory_order_relaxed);
+    while (ns > seen && !max_ns_.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+    Snapshot snapshot;
+    snapshot.buckets.resize(kBucketCount);
+    // Count from the buckets themselves so percentiles stay consistent with
+    // records racing the copy.
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.max_ns = max_ns_.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile(double quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+    const double clamped = std::min(1.0, std::max(0.0, quantile));
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped * static_cast<double>(count))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(bucket_upper_bound(i), max_ns);
+        }
+    }
+    return max_ns;
+}
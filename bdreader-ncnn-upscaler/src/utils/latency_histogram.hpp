@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Lock-free latency histogram with HDR-style log-linear buckets.
+///
+/// Each power-of-two range of nanoseconds is split into kSubBuckets linear
+/// buckets, so any recorded value is reported within 1/kSubBuckets (6.25%) of
+/// its true value, from nanoseconds to hours, in a fixed 8 KiB. record() is a
+/// couple of relaxed atomic increments and may be called from any thread.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 4;
+    static constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+    static constexpr size_t kBucketCount = kSubBuckets + (64 - kSubBucketBits) * kSubBuckets;
+
+    /// Point-in-time copy, for percentiles.
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t max_ns = 0;
+        std::vector<uint64_t> buckets;
+
+        /// Smallest value (ns) that `quantile` (0..1) of the samples do not
+        /// exceed, at bucket precision; 0 when empty.
+        uint64_t percentile(double quantile) const;
+    };
+
+    void record(uint64_t ns);
+    Snapshot snapshot() const;
+
+    /// Bucket holding `ns`, and the largest value that bucket holds.
+    static size_t bucket_index(uint64_t ns);
+    static uint64_t bucket_upper_bound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> max_ns_{0};
+};
@@ -2,10 +2,13 @@
 
 #include <atomic>
 #include <iostream>
+#include <mutex>
 
 namespace logger {
 namespace {
 std::atomic<int> g_level{static_cast<int>(Level::Warn)};
+// Serializes lines written from the keep-alive pipeline threads.
+std::mutex g_write_mutex;
 } // namespace
 
 void set_level(Level level) {
@@ -20,6 +23,7 @@ void info(const std::string& message) {
     if (g_level.load(std::memory_order_relaxed) < static_cast<int>(Level::Info)) {
         return;
     }
+    std::lock_guard<std::mutex> lock(g_write_mutex);
     std::clog << "[INFO] " << message << "\n";
 }
 
@@ -27,10 +31,12 @@ void warn(const std::string& message) {
     if (g_level.load(std::memory_order_relaxed) < static_cast<int>(Level::Warn)) {
         return;
     }
+    std::lock_guard<std::mutex> lock(g_write_mutex);
     std::clog << "[WARN] " << message << "\n";
 }
 
 void error(const std::string& message) {
+    std::lock_guard<std::mutex> lock(g_write_mutex);
     std::clog << "[ERROR] " << message << "\n";
 }
 } // namespace logger
@@ -0,0 +1,45 @@
+#include "utils/mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path, std::string& error) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = std::string("open failed: ") + std::strerror(errno);
+        return nullptr;
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        error = std::string("fstat failed: ") + std::strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+    if (st.st_size <= 0) {
+        error = "file is empty";
+        ::close(fd);
+        return nullptr;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    // Private and writable so a consumer touching a page only copies that page
+    // (copy-on-write); untouched pages stay shared through the page cache.
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file referenced; the descriptor is no longer needed.
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        error = std::string("mmap failed: ") + std::strerror(errno);
+        return nullptr;
+    }
+    // Whole file is read once at load time: start the readahead now.
+    ::madvise(data, size, MADV_WILLNEED);
+    return std::unique_ptr<MappedFile>(new MappedFile(static_cast<const uint8_t*>(data), size));
+}
+
+MappedFile::~MappedFile() {
+    ::munmap(const_cast<uint8_t*>(data_), size_);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/// Copy-on-write mapping of a whole file. Pages come from the page cache, so
+/// processes mapping the same file share one physical copy of every page
+/// they do not write to.
+class MappedFile {
+public:
+    /// Map `path` (must be non-empty). Null with `error` set on failure.
+    static std::unique_ptr<MappedFile> open(const std::string& path, std::string& error);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// Page-aligned start of the file contents.
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    MappedFile(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    const uint8_t* data_;
+    size_t size_;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <chrono>
+
+/// Time since the process started, for startup metrics (readiness, time to
+/// first response).
+namespace process_clock {
+
+/// Set during static initialisation, before main() runs.
+inline const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+inline double elapsed_ms() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace process_clock
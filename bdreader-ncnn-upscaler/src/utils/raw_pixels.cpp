@@ -0,0 +1,214 @@
+#include "utils/raw_pixels.hpp"
+
+#include "protocol_v2.hpp"
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if BDREADER_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace raw_pixels {
+namespace {
+
+struct BlobHeader {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t channels = 0;
+    uint32_t stride = 0;
+    uint32_t compression = 0;
+};
+
+bool parse_header(const uint8_t* data, size_t size, BlobHeader& header, std::string& error) {
+    if (!data || size < kHeaderSize) {
+        error = "raw pixel blob shorter than its header";
+        return false;
+    }
+    header.width = protocol_v2::decode_u32_le(data);
+    header.height = protocol_v2::decode_u32_le(data + 4);
+    header.channels = protocol_v2::decode_u32_le(data + 8);
+    header.stride = protocol_v2::decode_u32_le(data + 12);
+    header.compression = protocol_v2::decode_u32_le(data + 16);
+
+    if (header.width == 0 || header.height == 0 ||
+        header.width > static_cast<uint32_t>(std::numeric_limits<int>::max()) ||
+        header.height > static_cast<uint32_t>(std::numeric_limits<int>::max())) {
+        error = "raw pixel blob has invalid dimensions";
+        return false;
+    }
+    if (header.channels != 3 && header.channels != 4) {
+        error = "raw pixel blob channels must be 3 (RGB) or 4 (RGBA)";
+        return false;
+    }
+    if (static_cast<uint64_t>(header.stride) < static_cast<uint64_t>(header.width) * header.channels) {
+        error = "raw pixel blob stride smaller than width * channels";
+        return false;
+    }
+    const uint64_t pixel_bytes = static_cast<uint64_t>(header.stride) * header.height;
+    if (pixel_bytes > kMaxPixelBytes) {
+        error = "raw pixel blob exceeds " + std::to_string(kMaxPixelBytes) + " bytes";
+        return false;
+    }
+
+    const size_t data_size = size - kHeaderSize;
+    if (header.compression == static_cast<uint32_t>(Compression::None)) {
+        if (data_size != pixel_bytes) {
+            error = "raw pixel blob size does not match height * stride";
+            return false;
+        }
+    } else if (header.compression == static_cast<uint32_t>(Compression::Lz4)) {
+        if (!lz4_available()) {
+            error = "LZ4 raw pixel blobs not supported by this build";
+            return false;
+        }
+        if (data_size == 0) {
+            error = "empty LZ4 raw pixel blob";
+            return false;
+        }
+    } else {
+        error = "unknown raw pixel compression " + std::to_string(header.compression);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool lz4_available() {
+#if BDREADER_HAVE_LZ4
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool validate(const uint8_t* data, size_t size, std::string& error) {
+    BlobHeader header;
+    return parse_header(data, size, header, error);
+}
+
+bool dimensions(const uint8_t* data, size_t size, int& width, int& height) {
+    BlobHeader header;
+    std::string error;
+    if (!parse_header(data, size, header, error)) {
+        return false;
+    }
+    width = static_cast<int>(header.width);
+    height = static_cast<int>(header.height);
+    return true;
+}
+
+bool decode(const uint8_t* data, size_t size, image_io::ImagePixels& out, std::string& error) {
+    BlobHeader header;
+    if (!parse_header(data, size, header, error)) {
+        return false;
+    }
+
+    const size_t row_bytes = static_cast<size_t>(header.width) * 3;
+    const size_t pixel_bytes = static_cast<size_t>(header.stride) * header.height;
+    const uint8_t* source = data + kHeaderSize;
+
+    out.width = static_cast<int>(header.width);
+    out.height = static_cast<int>(header.height);
+    out.channels = 3;
+
+    std::vector<uint8_t> inflated;
+    if (header.compression == static_cast<uint32_t>(Compression::Lz4)) {
+#if BDREADER_HAVE_LZ4
+        // Packed RGB inflates straight into the output; anything else needs repacking.
+        const bool packed = header.channels == 3 && header.stride == row_bytes;
+        std::vector<uint8_t>& target = packed ? out.pixels : inflated;
+        target.resize(pixel_bytes);
+        const int got = LZ4_decompress_safe(reinterpret_cast<const char*>(source),
+                                            reinterpret_cast<char*>(target.data()),
+                                            static_cast<int>(size - kHeaderSize),
+                                            static_cast<int>(pixel_bytes));
+        if (got < 0 || static_cast<size_t>(got) != pixel_bytes) {
+            error = "corrupt LZ4 raw pixel blob";
+            return false;
+        }
+        if (packed) {
+            return true;
+        }
+        source = inflated.data();
+#else
+        error = "LZ4 raw pixel blobs not supported by this build";
+        return false;
+#endif
+    }
+
+    if (header.channels == 3 && header.stride == row_bytes) {
+        out.pixels.assign(source, source + pixel_bytes);
+        return true;
+    }
+
+    // Drop row padding and/or alpha.
+    out.pixels.resize(row_bytes * header.height);
+    uint8_t* dst = out.pixels.data();
+    for (uint32_t y = 0; y < header.height; ++y) {
+        const uint8_t* row = source + static_cast<size_t>(y) * header.stride;
+        if (header.channels == 3) {
+            std::memcpy(dst, row, row_bytes);
+            dst += row_bytes;
+            continue;
+        }
+        for (uint32_t x = 0; x < header.width; ++x) {
+            dst[0] = row[0];
+            dst[1] = row[1];
+            dst[2] = row[2];
+            dst += 3;
+            row += 4;
+        }
+    }
+    return true;
+}
+
+bool encode(const image_io::ImagePixels& img, Compression compression, image_io::EncodedImage& out) {
+    out = image_io::EncodedImage();
+    if (img.width <= 0 || img.height <= 0 || (img.channels != 3 && img.channels != 4)) {
+        return false;
+    }
+    const size_t stride = static_cast<size_t>(img.width) * img.channels;
+    const size_t pixel_bytes = stride * img.height;
+    if (img.pixels.size() < pixel_bytes || stride > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+
+    std::vector<uint8_t>& bytes = out.bytes();
+    uint8_t header[kHeaderSize];
+    protocol_v2::encode_u32_le(header, static_cast<uint32_t>(img.width));
+    protocol_v2::encode_u32_le(header + 4, static_cast<uint32_t>(img.height));
+    protocol_v2::encode_u32_le(header + 8, static_cast<uint32_t>(img.channels));
+    protocol_v2::encode_u32_le(header + 12, static_cast<uint32_t>(stride));
+    protocol_v2::encode_u32_le(header + 16, static_cast<uint32_t>(compression));
+
+    if (compression == Compression::None) {
+        bytes.reserve(kHeaderSize + pixel_bytes);
+        bytes.assign(header, header + kHeaderSize);
+        bytes.insert(bytes.end(), img.pixels.data(), img.pixels.data() + pixel_bytes);
+        return true;
+    }
+
+#if BDREADER_HAVE_LZ4
+    if (compression == Compression::Lz4 && pixel_bytes <= static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+        const int bound = LZ4_compressBound(static_cast<int>(pixel_bytes));
+        bytes.resize(kHeaderSize + static_cast<size_t>(bound));
+        std::memcpy(bytes.data(), header, kHeaderSize);
+        const int written = LZ4_compress_default(reinterpret_cast<const char*>(img.pixels.data()),
+                                                 reinterpret_cast<char*>(bytes.data() + kHeaderSize),
+                                                 static_cast<int>(pixel_bytes),
+                                                 bound);
+        if (written <= 0) {
+            bytes.clear();
+            return false;
+        }
+        bytes.resize(kHeaderSize + static_cast<size_t>(written));
+        return true;
+    }
+#endif
+    return false;
+}
+
+} // namespace raw_pixels
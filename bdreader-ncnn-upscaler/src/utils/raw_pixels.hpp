@@ -0,0 +1,51 @@
+#pragma once
+
+#include "image_io.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Raw pixel blobs for protocol v2 requests that skip the image codecs
+/// (InputEncoding::RawPixels / OutputEncoding::RawPixels*).
+///
+/// Layout (all u32 little-endian):
+///   [width][height][channels][stride][compression][data]
+/// - channels: 3 (RGB) or 4 (RGBA); rows are `stride` bytes apart
+///   (stride >= width * channels).
+/// - compression 0: `data` is height * stride bytes.
+/// - compression 1: `data` is one LZ4 block that inflates to height * stride
+///   bytes. Only available when built with LZ4 (BDREADER_HAVE_LZ4).
+///
+/// The engines are RGB-only: the alpha channel of RGBA input is dropped, and
+/// output blobs are always tightly packed RGB (stride = width * 3).
+namespace raw_pixels {
+
+constexpr size_t kHeaderSize = 5 * 4;
+/// Upper bound on height * stride, so a small LZ4 block cannot expand into an
+/// arbitrary allocation (256 MiB = 8192 x 8192 RGBA).
+constexpr size_t kMaxPixelBytes = 256u * 1024u * 1024u;
+
+enum class Compression : uint32_t {
+    None = 0,
+    Lz4 = 1,
+};
+
+/// True when the binary was built with LZ4 support.
+bool lz4_available();
+
+/// Cheap header-only check (dimensions, channels, stride, sizes, LZ4
+/// availability), done on the reader thread so malformed blobs are reported as
+/// validation errors before any work is scheduled.
+bool validate(const uint8_t* data, size_t size, std::string& error);
+
+/// Width and height from the blob header, without touching the pixel data.
+bool dimensions(const uint8_t* data, size_t size, int& width, int& height);
+
+/// Unpack a blob into tightly packed RGB pixels (inflating LZ4 if needed).
+bool decode(const uint8_t* data, size_t size, image_io::ImagePixels& out, std::string& error);
+
+/// Pack RGB/RGBA pixels into a blob, LZ4-compressed when `compression` asks for it.
+bool encode(const image_io::ImagePixels& img, Compression compression, image_io::EncodedImage& out);
+
+} // namespace raw_pixels
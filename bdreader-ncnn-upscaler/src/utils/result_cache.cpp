@@ -0,0 +1,253 @@
+#include "utils/result_cache.hpp"
+
+#include "utils/content_hash.hpp"
+#include "utils/logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Disk entry layout: magic, key length, key, payload.
+constexpr char kEntryMagic[4] = {'B', 'R', 'C', '1'};
+constexpr size_t kEntryHeaderSize = sizeof(kEntryMagic) + 4;
+constexpr const char* kEntrySuffix = ".res";
+constexpr const char* kTempMarker = ".tmp";
+
+} // namespace
+
+ResultCache::ResultCache(const ResultCacheConfig& config)
+    : memory_budget_(config.memory_bytes),
+      disk_budget_(config.disk_bytes),
+      directory_(config.directory) {
+    if (directory_.empty() || disk_budget_ == 0) {
+        return;
+    }
+    std::error_code ec;
+    fs::create_directories(directory_, ec);
+    if (ec || !fs::is_directory(directory_, ec)) {
+        logger::error("Result cache: cannot use directory " + directory_.string() +
+                      (ec ? ": " + ec.message() : std::string()));
+        return;
+    }
+    disk_enabled_ = true;
+    load_disk_index();
+}
+
+ResultCache::Payload ResultCache::get(const std::string& key) {
+    if (memory_budget_ > 0) {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        auto found = memory_index_.find(key);
+        if (found != memory_index_.end()) {
+            memory_lru_.splice(memory_lru_.begin(), memory_lru_, found->second);
+            return memory_lru_.front().payload;
+        }
+    }
+    if (!disk_enabled_) {
+        return nullptr;
+    }
+    Payload payload = get_disk(key);
+    if (payload) {
+        put_memory(key, payload);
+    }
+    return payload;
+}
+
+void ResultCache::put(const std::string& key, const Payload& payload) {
+    if (!payload) {
+        return;
+    }
+    put_memory(key, payload);
+    if (disk_enabled_) {
+        put_disk(key, payload);
+    }
+}
+
+size_t ResultCache::memory_bytes() const {
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    return memory_bytes_;
+}
+
+void ResultCache::put_memory(const std::string& key, const Payload& payload) {
+    const size_t bytes = payload->size() + key.size();
+    if (bytes > memory_budget_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    auto found = memory_index_.find(key);
+    if (found != memory_index_.end()) {
+        memory_lru_.splice(memory_lru_.begin(), memory_lru_, found->second);
+        return;
+    }
+    memory_lru_.push_front(MemoryEntry{key, payload});
+    memory_index_[key] = memory_lru_.begin();
+    memory_bytes_ += bytes;
+    while (memory_bytes_ > memory_budget_) {
+        const MemoryEntry& victim = memory_lru_.back();
+        memory_bytes_ -= victim.payload->size() + victim.key.size();
+        memory_index_.erase(victim.key);
+        memory_lru_.pop_back();
+    }
+}
+
+ResultCache::Payload ResultCache::get_disk(const std::string& key) {
+    const std::string name = file_name(key);
+    {
+        std::lock_guard<std::mutex> lock(disk_mutex_);
+        auto found = disk_index_.find(name);
+        if (found == disk_index_.end()) {
+            return nullptr;
+        }
+        disk_lru_.splice(disk_lru_.begin(), disk_lru_, found->second);
+    }
+
+    const fs::path path = directory_ / name;
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return nullptr;  // Evicted meanwhile
+    }
+    const auto file_size = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+    char header[kEntryHeaderSize];
+    if (file_size < kEntryHeaderSize || !in.read(header, sizeof(header)) ||
+        std::memcmp(header, kEntryMagic, sizeof(kEntryMagic)) != 0) {
+        return nullptr;
+    }
+    uint32_t key_size = 0;
+    std::memcpy(&key_size, header + sizeof(kEntryMagic), sizeof(key_size));
+    if (key_size != key.size() || file_size < kEntryHeaderSize + key_size) {
+        return nullptr;
+    }
+    std::string stored_key(key_size, '\0');
+    if (!in.read(&stored_key[0], key_size) || stored_key != key) {
+        return nullptr;  // Hash collision on the file name
+    }
+    std::vector<uint8_t> bytes(file_size - kEntryHeaderSize - key_size);
+    if (!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+        return nullptr;
+    }
+
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+}
+
+void ResultCache::put_disk(const std::string& key, const Payload& payload) {
+    const std::string name = file_name(key);
+    const uint64_t bytes = kEntryHeaderSize + key.size() + payload->size();
+    if (bytes > disk_budget_) {
+        return;
+    }
+    uint64_t temp_id = 0;
+    {
+        std::lock_guard<std::mutex> lock(disk_mutex_);
+        if (disk_index_.count(name) != 0) {
+            return;
+        }
+        temp_id = next_temp_++;
+    }
+
+    const fs::path path = directory_ / name;
+    const fs::path temp = directory_ / (name + kTempMarker + std::to_string(::getpid()) + "-" + std::to_string(temp_id));
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        const auto key_size = static_cast<uint32_t>(key.size());
+        char header[kEntryHeaderSize];
+        std::memcpy(header, kEntryMagic, sizeof(kEntryMagic));
+        std::memcpy(header + sizeof(kEntryMagic), &key_size, sizeof(key_size));
+        out.write(header, sizeof(header));
+        out.write(key.data(), static_cast<std::streamsize>(key.size()));
+        out.write(reinterpret_cast<const char*>(payload->data()), static_cast<std::streamsize>(payload->size()));
+        if (!out.flush()) {
+            logger::error("Result cache: failed to write " + temp.string());
+            out.close();
+            std::error_code ec;
+            fs::remove(temp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, path, ec);
+    if (ec) {
+        logger::error("Result cache: failed to store " + path.string() + ": " + ec.message());
+        fs::remove(temp, ec);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(disk_mutex_);
+    if (disk_index_.count(name) != 0) {
+        return;  // Stored concurrently by another thread
+    }
+    disk_lru_.push_front(DiskEntry{name, bytes});
+    disk_index_[name] = disk_lru_.begin();
+    disk_bytes_ += bytes;
+    evict_disk();
+}
+
+void ResultCache::load_disk_index() {
+    struct Found {
+        std::string name;
+        uint64_t bytes;
+        fs::file_time_type mtime;
+    };
+    std::vector<Found> found;
+    std::error_code ec;
+    for (fs::directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entry_ec;
+        if (!it->is_regular_file(entry_ec)) {
+            continue;
+        }
+        const std::string name = it->path().filename().string();
+        if (name.find(kTempMarker) != std::string::npos) {
+            fs::remove(it->path(), entry_ec);  // Left over by an interrupted write
+            continue;
+        }
+        if (name.size() <= std::strlen(kEntrySuffix) ||
+            name.compare(name.size() - std::strlen(kEntrySuffix), std::string::npos, kEntrySuffix) != 0) {
+            continue;
+        }
+        std::error_code size_ec;
+        std::error_code time_ec;
+        const uint64_t bytes = it->file_size(size_ec);
+        const fs::file_time_type mtime = it->last_write_time(time_ec);
+        if (!size_ec && !time_ec) {
+            found.push_back(Found{name, bytes, mtime});
+        }
+    }
+    if (ec) {
+        logger::error("Result cache: cannot list " + directory_.string() + ": " + ec.message());
+    }
+
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.mtime > b.mtime; });
+    std::lock_guard<std::mutex> lock(disk_mutex_);
+    for (auto& entry : found) {
+        disk_lru_.push_back(DiskEntry{std::move(entry.name), entry.bytes});
+        disk_index_[disk_lru_.back().name] = std::prev(disk_lru_.end());
+        disk_bytes_ += entry.bytes;
+    }
+    evict_disk();
+    logger::info("Result cache: " + std::to_string(disk_lru_.size()) + " entries (" +
+                 std::to_string(disk_bytes_) + " bytes) in " + directory_.string());
+}
+
+void ResultCache::evict_disk() {
+    while (disk_bytes_ > disk_budget_ && !disk_lru_.empty()) {
+        const DiskEntry& victim = disk_lru_.back();
+        std::error_code ec;
+        fs::remove(directory_ / victim.name, ec);
+        disk_bytes_ -= victim.bytes;
+        disk_index_.erase(victim.name);
+        disk_lru_.pop_back();
+    }
+}
+
+std::string ResultCache::file_name(const std::string& key) {
+    const auto* data = reinterpret_cast<const uint8_t*>(key.data());
+    return content_hash::hash128(data, key.size()).hex() + kEntrySuffix;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Sizing of a ResultCache. Both tiers are optional.
+struct ResultCacheConfig {
+    size_t memory_bytes = 0;  // In-memory tier budget; 0 disables it
+    std::string directory;    // On-disk tier location; empty disables it
+    size_t disk_bytes = 0;    // On-disk tier budget
+};
+
+/// Two-tier store of encoded results, keyed by an opaque string.
+///
+/// The memory tier is an LRU bounded by `memory_bytes`. The disk tier keeps
+/// one file per entry in `directory`, named after a hash of the key; the key
+/// is stored in the file too and checked on read. Files are written to a
+/// temporary name then renamed, so a crash never leaves a truncated entry
+/// behind. At startup the directory is indexed by modification time (a hit
+/// touches its file), and the least recently used files are deleted whenever
+/// the tier grows past `disk_bytes`.
+///
+/// Thread-safe. Disk reads and writes happen outside the locks.
+class ResultCache {
+public:
+    using Payload = std::shared_ptr<const std::vector<uint8_t>>;
+
+    explicit ResultCache(const ResultCacheConfig& config);
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    /// True when at least one tier is enabled.
+    bool enabled() const { return memory_budget_ > 0 || disk_enabled_; }
+
+    /// Cached result for `key`, or nullptr. Disk hits are promoted to memory.
+    Payload get(const std::string& key);
+
+    /// Store `payload` in both tiers (entries larger than a tier's budget are
+    /// not stored in it).
+    void put(const std::string& key, const Payload& payload);
+
+    /// Bytes held by the memory tier.
+    size_t memory_bytes() const;
+
+private:
+    struct MemoryEntry {
+        std::string key;
+        Payload payload;
+    };
+
+    struct DiskEntry {
+        std::string name;
+        uint64_t bytes = 0;
+    };
+
+    void put_memory(const std::string& key, const Payload& payload);
+    Payload get_disk(const std::string& key);
+    void put_disk(const std::string& key, const Payload& payload);
+    /// Index the files already in the directory, oldest first out.
+    void load_disk_index();
+    /// Drop the least recently used files until the tier fits its budget.
+    /// Called with disk_mutex_ held.
+    void evict_disk();
+
+    static std::string file_name(const std::string& key);
+
+    const size_t memory_budget_;
+    const uint64_t disk_budget_;
+    const std::filesystem::path directory_;
+    bool disk_enabled_ = false;
+
+    mutable std::mutex memory_mutex_;
+    size_t memory_bytes_ = 0;
+    std::list<MemoryEntry> memory_lru_;  // Most recently used first
+    std::unordered_map<std::string, std::list<MemoryEntry>::iterator> memory_index_;
+
+    std::mutex disk_mutex_;
+    uint64_t disk_bytes_ = 0;
+    uint64_t next_temp_ = 0;
+    std::list<DiskEntry> disk_lru_;  // Most recently used first
+    std::unordered_map<std::string, std::list<DiskEntry>::iterator> disk_index_;
+};
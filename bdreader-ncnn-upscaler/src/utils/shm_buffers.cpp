@@ -0,0 +1,70 @@
+#include "utils/shm_buffers.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace shm {
+
+std::shared_ptr<MappedBuffer> MappedBuffer::map(int fd, std::string& error) {
+    // A client shrinking the file under the mapping would make the next access
+    // raise SIGBUS in the server, so the size must be sealed first.
+    const int seals = ::fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        error = seals < 0 ? std::string("shared buffer is not a sealable memfd (MFD_ALLOW_SEALING): ") +
+                                std::strerror(errno)
+                          : "shared buffer must be sealed with F_SEAL_SHRINK";
+        ::close(fd);
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        error = std::string("fstat failed: ") + std::strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+    if (st.st_size <= 0) {
+        error = "shared buffer is empty";
+        ::close(fd);
+        return nullptr;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        error = std::string("mmap failed: ") + std::strerror(errno);
+        ::close(fd);
+        return nullptr;
+    }
+    return std::shared_ptr<MappedBuffer>(new MappedBuffer(fd, static_cast<uint8_t*>(data), size));
+}
+
+MappedBuffer::~MappedBuffer() {
+    ::munmap(data_, size_);
+    ::close(fd_);
+}
+
+bool BufferRegistry::resolve(uint32_t id, uint64_t offset, uint64_t length, Region& region, std::string& error) const {
+    const auto it = buffers_.find(id);
+    if (it == buffers_.end()) {
+        error = "unknown shared buffer " + std::to_string(id);
+        return false;
+    }
+    const uint64_t size = it->second->size();
+    if (offset > size || length > size - offset) {
+        error = "range [" + std::to_string(offset) + ", +" + std::to_string(length) +
+                ") outside shared buffer " + std::to_string(id) + " of " + std::to_string(size) + " bytes";
+        return false;
+    }
+    region.buffer = it->second;
+    region.buffer_id = id;
+    region.offset = offset;
+    region.length = length;
+    return true;
+}
+
+} // namespace shm
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/// Shared-memory buffers registered by the client (memfd passed over a Unix
+/// socket) for Transport::SharedMemory requests.
+namespace shm {
+
+/// A shared, writable mapping of a client-provided fd. Unmapped (and the fd
+/// closed) when the last reference goes away, so a buffer released while
+/// requests still use it stays valid until they finish.
+class MappedBuffer {
+public:
+    /// Map the whole of `fd` (size from fstat). `fd` must carry F_SEAL_SHRINK
+    /// (a memfd created with MFD_ALLOW_SEALING), so the client cannot truncate
+    /// it under the mapping. Takes ownership of `fd`, also on failure.
+    static std::shared_ptr<MappedBuffer> map(int fd, std::string& error);
+    ~MappedBuffer();
+
+    MappedBuffer(const MappedBuffer&) = delete;
+    MappedBuffer& operator=(const MappedBuffer&) = delete;
+
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    MappedBuffer(int fd, uint8_t* data, size_t size) : fd_(fd), data_(data), size_(size) {}
+
+    int fd_;
+    uint8_t* data_;
+    size_t size_;
+};
+
+/// A byte range inside a registered buffer; keeps the buffer mapped.
+struct Region {
+    std::shared_ptr<MappedBuffer> buffer;
+    uint32_t buffer_id = 0;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+
+    uint8_t* data() const { return buffer->data() + offset; }
+};
+
+/// buffer_id → mapping. Only touched by the frame reader thread.
+class BufferRegistry {
+public:
+    /// Replaces (and releases) any buffer already registered under `id`.
+    void add(uint32_t id, std::shared_ptr<MappedBuffer> buffer) { buffers_[id] = std::move(buffer); }
+    bool remove(uint32_t id) { return buffers_.erase(id) != 0; }
+
+    /// Resolve [offset, offset + length) of buffer `id`, bounds-checked.
+    bool resolve(uint32_t id, uint64_t offset, uint64_t length, Region& region, std::string& error) const;
+
+private:
+    std::unordered_map<uint32_t, std::shared_ptr<MappedBuffer>> buffers_;
+};
+
+} // namespace shm
@@ -0,0 +1,148 @@
+#include "tile_executor.hpp"
+
+#include "logger.hpp"
+
+#include <algorithm>
+#include <exception>
+
+namespace tiling {
+
+namespace {
+
+/// Tiles [next, end) not yet taken from one worker's run.
+struct Run {
+    size_t next = 0;
+    size_t end = 0;
+    size_t left() const { return end - next; }
+};
+
+} // namespace
+
+/// One run() call. Guarded by the executor's mutex, except the task and stop
+/// callbacks, which workers call unlocked.
+struct TileExecutor::Batch {
+    const Task* task = nullptr;
+    const StopRequested* stop_requested = nullptr;
+    std::vector<Run> runs;    // One per worker slot
+    size_t joined = 0;        // Slots handed out
+    size_t remaining = 0;     // Tiles not yet taken
+    size_t active = 0;        // Workers inside the batch
+    bool stopped = false;
+    std::condition_variable finished;
+};
+
+TileExecutor::TileExecutor(size_t workers) : workers_(workers == 0 ? 1 : workers) {
+    if (workers_ <= 1) {
+        return;
+    }
+    threads_.reserve(workers_);
+    for (size_t w = 0; w < workers_; ++w) {
+        threads_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+TileExecutor::~TileExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool TileExecutor::run_one(const Batch& batch, size_t index) {
+    if (*batch.stop_requested && (*batch.stop_requested)()) {
+        return false;
+    }
+    try {
+        return (*batch.task)(index);
+    } catch (const std::exception& e) {
+        logger::error("Tiling: exception processing tile " + std::to_string(index) + ": " + e.what());
+        return false;
+    }
+}
+
+bool TileExecutor::take(Batch& batch, size_t slot, size_t& index) {
+    // Own run front to back, else the back of the fullest other run.
+    Run& own = batch.runs[slot];
+    if (own.left() > 0) {
+        index = own.next++;
+    } else {
+        auto victim = std::max_element(batch.runs.begin(), batch.runs.end(),
+                                       [](const Run& a, const Run& b) { return a.left() < b.left(); });
+        if (victim->left() == 0) {
+            return false;
+        }
+        index = --victim->end;
+    }
+    --batch.remaining;
+    return true;
+}
+
+bool TileExecutor::run(size_t count, const Task& task, const StopRequested& stop_requested) {
+    auto batch = std::make_shared<Batch>();
+    batch->task = &task;
+    batch->stop_requested = &stop_requested;
+
+    if (threads_.empty() || count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!run_one(*batch, i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const size_t slots = std::min(workers_, count);
+    batch->runs.resize(slots);
+    for (size_t s = 0; s < slots; ++s) {
+        batch->runs[s].next = count * s / slots;
+        batch->runs[s].end = count * (s + 1) / slots;
+    }
+    batch->remaining = count;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    batches_.push_back(batch);
+    work_available_.notify_all();
+    batch->finished.wait(lock, [&] { return batch->active == 0 && (batch->stopped || batch->remaining == 0); });
+    // Slots nobody joined (every tile already taken, or stopped early).
+    const auto queued = std::find(batches_.begin(), batches_.end(), batch);
+    if (queued != batches_.end()) {
+        batches_.erase(queued);
+    }
+    return !batch->stopped;
+}
+
+void TileExecutor::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_available_.wait(lock, [this] { return stopping_ || !batches_.empty(); });
+        if (batches_.empty()) {
+            return;
+        }
+        // Oldest image first: its tiles get every free worker before the next one.
+        std::shared_ptr<Batch> batch = batches_.front();
+        const size_t slot = batch->joined++;
+        if (batch->joined == batch->runs.size()) {
+            batches_.pop_front();
+        }
+        ++batch->active;
+
+        size_t index = 0;
+        while (!batch->stopped && take(*batch, slot, index)) {
+            lock.unlock();
+            const bool ok = run_one(*batch, index);
+            lock.lock();
+            if (!ok) {
+                batch->stopped = true;
+            }
+        }
+        if (--batch->active == 0 && (batch->stopped || batch->remaining == 0)) {
+            batch->finished.notify_all();
+        }
+    }
+}
+
+} // namespace tiling
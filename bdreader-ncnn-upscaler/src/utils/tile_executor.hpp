@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tiling {
+
+/**
+ * Persistent work-stealing pool for the independent tiles of images.
+ *
+ * Each run() splits its tiles into contiguous runs, one per worker slot
+ * (neighbouring source rows stay in one worker's cache); a worker takes its
+ * run front to back, and once it runs dry steals from the back of the fullest
+ * remaining run, so a slow tile never leaves the other workers idle.
+ *
+ * The workers are started once and shared by every caller: concurrent run()
+ * calls (one per pipeline inference thread) queue their tiles on the same
+ * `workers` threads, which are meant to match the engine's inference
+ * contexts, instead of each image starting threads of its own. The caller
+ * waits for its tiles. With a single worker no thread is started and run()
+ * executes the tiles on the calling thread.
+ *
+ * Tasks must be safe to run concurrently: tiles write disjoint regions of the
+ * output canvas, and each engine call runs on its own inference context. A
+ * task must not call run() on the same executor.
+ */
+class TileExecutor {
+public:
+    /// Task for tile `index`; false stops every worker of that run.
+    using Task = std::function<bool(size_t index)>;
+    /// Polled before each tile; true stops every worker of that run.
+    using StopRequested = std::function<bool()>;
+
+    explicit TileExecutor(size_t workers);
+    ~TileExecutor();
+
+    TileExecutor(const TileExecutor&) = delete;
+    TileExecutor& operator=(const TileExecutor&) = delete;
+
+    /// Run tasks 0..count-1. True when all of them ran and succeeded.
+    /// Thread-safe.
+    bool run(size_t count, const Task& task, const StopRequested& stop_requested = {});
+
+    size_t workers() const { return workers_; }
+
+private:
+    struct Batch;
+
+    void worker_loop();
+    /// Next tile of `batch` for `slot`; false once every tile is taken.
+    static bool take(Batch& batch, size_t slot, size_t& index);
+    static bool run_one(const Batch& batch, size_t index);
+
+    const size_t workers_;
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::deque<std::shared_ptr<Batch>> batches_;  // Batches with worker slots left
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+} // namespace tiling
@@ -1,6 +1,8 @@
 #include "tiling_processor.hpp"
 #include "image_padding.hpp"
+#include "tile_executor.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 
 namespace tiling {
@@ -10,7 +12,8 @@ bool process_with_tiling(
     const uint8_t* input_data,
     size_t input_size,
     std::vector<uint8_t>& output_data,
-    const std::string& output_format
+    const std::string& output_format,
+    const CancelToken* cancel
 ) {
     if (!engine) {
         logger::error("Tiling: null engine pointer");
@@ -25,7 +28,43 @@ bool process_with_tiling(
             return false;
         }
 
-        // Step 2: Check if tiling is needed
+        // Step 2: Upscale (tiled or direct, depending on dimensions)
+        image_io::ImagePixels final_output;
+        if (!upscale_pixels(engine, source_image, final_output, cancel)) {
+            return false;
+        }
+
+        // Step 3: Encode final output
+        if (!image_io::encode_image(final_output, output_format, output_data)) {
+            logger::error("Tiling: failed to encode final output");
+            return false;
+        }
+
+        logger::info("Tiling: complete! Output size: " + std::to_string(output_data.size()) + " bytes");
+        return true;
+
+    } catch (const std::exception& e) {
+        logger::error("Tiling: exception in process_with_tiling: " + std::string(e.what()));
+        return false;
+    } catch (...) {
+        logger::error("Tiling: unknown exception in process_with_tiling");
+        return false;
+    }
+}
+
+bool upscale_pixels(
+    BaseEngine* engine,
+    const image_io::ImagePixels& source_image,
+    image_io::ImagePixels& output,
+    const CancelToken* cancel
+) {
+    if (!engine) {
+        logger::error("Tiling: null engine pointer");
+        return false;
+    }
+
+    try {
+        // Step 1: Check if tiling is needed
         const tiling::TilingConfig config = engine->get_tiling_config();
         const bool needs_tiling = tiling::should_enable_tiling(
             source_image.width, source_image.height, config
@@ -50,22 +89,14 @@ bool process_with_tiling(
                 return false;
             }
 
-            // Compress output
-            image_io::ImagePixels output_pixels;
-            output_pixels.width = output_width;
-            output_pixels.height = output_height;
-            output_pixels.channels = 3;
-            output_pixels.pixels = std::move(output_rgb);
-
-            if (!image_io::encode_image(output_pixels, output_format, output_data)) {
-                logger::error("Tiling: failed to encode output");
-                return false;
-            }
-
+            output.width = output_width;
+            output.height = output_height;
+            output.channels = 3;
+            output.pixels = std::move(output_rgb);
             return true;
         }
 
-        // Step 3: Calculate tiles
+        // Step 2: Calculate tiles
         const std::vector<Tile> tiles = tiling::calculate_tiles(
             source_image.width, source_image.height, config
         );
@@ -75,60 +106,54 @@ bool process_with_tiling(
             return false;
         }
 
-        // Step 4: Allocate output RGB buffer at final dimensions
+        // Step 3: Allocate output RGB buffer at final dimensions
         // Each tile's upscaled result will be cropped of its padding before being blended in.
         const int output_width = source_image.width * config.scale_factor;
         const int output_height = source_image.height * config.scale_factor;
         std::vector<uint8_t> output_rgb(output_width * output_height * 3, 0);
 
+        // Tiles write disjoint regions of output_rgb, so they may run on the
+        // engine's tile workers, one per inference context.
+        TileExecutor& executor = engine->tile_executor();
         logger::info("Tiling: processing " + std::to_string(tiles.size()) +
                      " tiles → output " + std::to_string(output_width) + "x" +
-                     std::to_string(output_height));
-
-        // Step 5: Process each tile (with per-tile exception handling)
-        for (size_t i = 0; i < tiles.size(); ++i) {
-            try {
-                const Tile& tile = tiles[i];
-
-                // Extract tile from source
-                std::vector<uint8_t> tile_rgb;
-                if (!tiling::extract_tile(source_image.pixels.data(),
-                                           source_image.width,
-                                           source_image.height,
-                                           tile,
-                                           tile_rgb)) {
-                    logger::error("Tiling: failed to extract tile " + std::to_string(i));
-                    return false;
-                }
-
-                // Process tile — engines return the final upscaled tile at
-                // (tile.width * scale) × (tile.height * scale), padding already cropped.
-                std::vector<uint8_t> upscaled_tile_rgb;
-                int upscaled_width = 0;
-                int upscaled_height = 0;
-                if (!engine->process_rgb(tile_rgb.data(),
-                                         tile.width,
-                                         tile.height,
-                                         upscaled_tile_rgb,
-                                         upscaled_width,
-                                         upscaled_height)) {
-                    logger::error("Tiling: failed to process tile " + std::to_string(i));
-                    return false;
-                }
+                     std::to_string(output_height) +
+                     (executor.workers() > 1 ? " on " + std::to_string(std::min(executor.workers(), tiles.size())) +
+                                                   " workers" : ""));
+
+        std::atomic<size_t> processed{0};
+        const auto process_tile = [&](size_t i) {
+            const Tile& tile = tiles[i];
+
+            // Process the tile in place in the source image — engines return the
+            // final upscaled tile at (tile.width * scale) × (tile.height * scale),
+            // padding already cropped.
+            const size_t source_stride = static_cast<size_t>(source_image.width) * 3;
+            std::vector<uint8_t> upscaled_tile_rgb;
+            int upscaled_width = 0;
+            int upscaled_height = 0;
+            if (!engine->process_rgb_region(source_image.pixels.data() + tile.y * source_stride +
+                                                static_cast<size_t>(tile.x) * 3,
+                                            tile.width,
+                                            tile.height,
+                                            source_stride,
+                                            upscaled_tile_rgb,
+                                            upscaled_width,
+                                            upscaled_height)) {
+                logger::error("Tiling: failed to process tile " + std::to_string(i));
+                return false;
+            }
 
-                // Extract the non-overlapping region of this tile. For non-border tiles,
-                // skip the overlap at the top/left to avoid duplicating pixels already
-                // contributed by previous tiles.
-                const int overlap_scaled = config.overlap * config.scale_factor;
-                const int src_offset_x = (tile.output_x > 0) ? overlap_scaled : 0;
-                const int src_offset_y = (tile.output_y > 0) ? overlap_scaled : 0;
-                const int blend_width = upscaled_width - src_offset_x;
-                const int blend_height = upscaled_height - src_offset_y;
-
-                if (blend_width <= 0 || blend_height <= 0) {
-                    continue;
-                }
+            // Extract the non-overlapping region of this tile. For non-border tiles,
+            // skip the overlap at the top/left to avoid duplicating pixels already
+            // contributed by previous tiles.
+            const int overlap_scaled = config.overlap * config.scale_factor;
+            const int src_offset_x = (tile.output_x > 0) ? overlap_scaled : 0;
+            const int src_offset_y = (tile.output_y > 0) ? overlap_scaled : 0;
+            const int blend_width = upscaled_width - src_offset_x;
+            const int blend_height = upscaled_height - src_offset_y;
 
+            if (blend_width > 0 && blend_height > 0) {
                 std::vector<uint8_t> region_to_blend(blend_width * blend_height * 3);
                 for (int row = 0; row < blend_height; ++row) {
                     const uint8_t* src_row = upscaled_tile_rgb.data() + ((src_offset_y + row) * upscaled_width + src_offset_x) * 3;
@@ -147,45 +172,42 @@ bool process_with_tiling(
                     logger::error("Tiling: failed to blend tile " + std::to_string(i));
                     return false;
                 }
+            }
 
-                // NOTE: Do NOT call cleanup() here - it corrupts the NCNN model.
-                // Cleanup is handled by the caller at the end of the process/batch.
+            // NOTE: Do NOT call cleanup() here - it corrupts the NCNN model.
+            // Cleanup is handled by the caller at the end of the process/batch.
 
-                // Progress logging every 10 tiles
-                if ((i + 1) % 10 == 0 || (i + 1) == tiles.size()) {
-                    logger::info("Tiling: processed " + std::to_string(i + 1) + "/" +
-                                 std::to_string(tiles.size()) + " tiles");
-                }
-                
-            } catch (const std::exception& e) {
-                logger::error("Tiling: exception processing tile " + std::to_string(i) +
-                             ": " + std::string(e.what()));
-                return false;
+            // Progress logging every 10 tiles
+            const size_t done = processed.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (done % 10 == 0 || done == tiles.size()) {
+                logger::info("Tiling: processed " + std::to_string(done) + "/" +
+                             std::to_string(tiles.size()) + " tiles");
             }
-        }
-
-        // Step 6: Encode final output
-        // output_rgb is already sized to original_width * scale × original_height * scale,
-        // per-tile cropping has already removed the padding from each tile's contribution.
-        image_io::ImagePixels final_output;
-        final_output.width = output_width;
-        final_output.height = output_height;
-        final_output.channels = 3;
-        final_output.pixels = std::move(output_rgb);
+            return true;
+        };
 
-        if (!image_io::encode_image(final_output, output_format, output_data)) {
-            logger::error("Tiling: failed to encode final output");
+        const auto stop_requested = [cancel]() { return cancel && cancel->stop_requested(); };
+        if (!executor.run(tiles.size(), process_tile, stop_requested)) {
+            if (stop_requested()) {
+                logger::info("Tiling: stopped after " + std::to_string(processed.load()) + "/" +
+                             std::to_string(tiles.size()) + " tiles");
+            }
             return false;
         }
 
-        logger::info("Tiling: complete! Output size: " + std::to_string(output_data.size()) + " bytes");
+        // output_rgb is already sized to original_width * scale × original_height * scale,
+        // per-tile cropping has already removed the padding from each tile's contribution.
+        output.width = output_width;
+        output.height = output_height;
+        output.channels = 3;
+        output.pixels = std::move(output_rgb);
         return true;
-        
+
     } catch (const std::exception& e) {
-        logger::error("Tiling: exception in process_with_tiling: " + std::string(e.what()));
+        logger::error("Tiling: exception in upscale_pixels: " + std::string(e.what()));
         return false;
     } catch (...) {
-        logger::error("Tiling: unknown exception in process_with_tiling");
+        logger::error("Tiling: unknown exception in upscale_pixels");
         return false;
     }
 }
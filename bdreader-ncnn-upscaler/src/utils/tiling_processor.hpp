@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../engines/base_engine.hpp"
+#include "cancel_token.hpp"
 #include "tiling.hpp"
 #include "image_io.hpp"
 #include "logger.hpp"
@@ -19,7 +20,9 @@ namespace tiling {
  * 5. Compresses final result to output format
  *
  * Memory optimization:
- * - Only 1 tile in memory at a time (~12MB vs 384MB for full image)
+ * - Only 1 tile in memory at a time per worker (~12MB vs 384MB for full image);
+ *   engines with several inference contexts run that many tiles at once
+ *   (see TileExecutor)
  * - Source RGB kept in memory (needed for tile extraction)
  * - Output RGB accumulated progressively
  *
@@ -28,6 +31,7 @@ namespace tiling {
  * @param input_size Size of input_data
  * @param output_data Output compressed image bytes (will be resized)
  * @param output_format Output format ("webp", "png", "jpg")
+ * @param cancel Optional; checked between tiles (see upscale_pixels)
  * @return true on success, false on error
  */
 bool process_with_tiling(
@@ -35,7 +39,30 @@ bool process_with_tiling(
     const uint8_t* input_data,
     size_t input_size,
     std::vector<uint8_t>& output_data,
-    const std::string& output_format
+    const std::string& output_format,
+    const CancelToken* cancel = nullptr
+);
+
+/**
+ * Upscale already-decoded RGB pixels, tiling automatically when the image
+ * exceeds the engine's tiling threshold.
+ *
+ * This is the inference step of process_with_tiling() without the codec work,
+ * so callers that decode/encode on other threads (keep-alive pipeline) can
+ * hand pixels straight to the engine.
+ *
+ * @param engine Engine to use for processing (RealCUGAN, RealESRGAN)
+ * @param source_image Decoded RGB input
+ * @param output Upscaled RGB output (width/height/pixels overwritten)
+ * @param cancel Optional; checked before each tile. Returns false once it
+ *               requests a stop (check the token to tell this from an error).
+ * @return true on success, false on error or stop
+ */
+bool upscale_pixels(
+    BaseEngine* engine,
+    const image_io::ImagePixels& source_image,
+    image_io::ImagePixels& output,
+    const CancelToken* cancel = nullptr
 );
 
 } // namespace tiling
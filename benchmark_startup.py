@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+Benchmark keep-alive worker startup: cold-start time and memory per worker,
+with the model weights loaded through mmap (--model-load mmap) or read into
+private memory (--model-load read).
+
+N workers are started at once for each mode. Cold start is the time from
+spawn to the response to a first 16x16 image. Memory is sampled from /proc
+once every worker has answered: Pss divides shared pages between the
+processes mapping them, so it is the per-worker cost on the host.
+
+With `shader-cache`, one Vulkan worker is started twice against the same
+fresh --shader-cache-dir instead, and the model init time (load_ms of the
+readiness frame) is compared between the first run, with an empty driver
+shader cache, and the second.
+Without a GPU, select Mesa's software driver (lavapipe):
+  VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+      benchmark_startup.py shader-cache
+
+Usage: benchmark_startup.py [workers] [extra upscaler args...]
+       benchmark_startup.py shader-cache [gpu_id] [extra upscaler args...]
+"""
+import json
+import tempfile
+import sys
+import time
+import zlib
+import struct
+import subprocess
+from pathlib import Path
+
+K_MAGIC = 0x42524452
+K_VERSION = 2
+MSG_TYPE_REQUEST = 1
+
+
+def build_request_frame(request_id: int, images: list[bytes]) -> bytes:
+    header = struct.pack("<IIII", K_MAGIC, K_VERSION, MSG_TYPE_REQUEST, request_id)
+    payload = bytearray()
+    payload.append(0)  # engine
+    payload.extend(struct.pack("<I", 1))
+    payload.extend(b"F")
+    payload.extend(struct.pack("<i", 0))
+    payload.extend(struct.pack("<I", len(images)))
+    for image in images:
+        payload.extend(struct.pack("<I", len(image)))
+        payload.extend(image)
+    total_len = len(header) + len(payload)
+    return struct.pack("<I", total_len) + header + payload
+
+
+def tiny_png(size: int = 16) -> bytes:
+    def chunk(kind: bytes, data: bytes) -> bytes:
+        return struct.pack(">I", len(data)) + kind + data + struct.pack(">I", zlib.crc32(kind + data))
+    rows = b"".join(b"\x00" + b"".join(bytes((x * 16 % 256, y * 16 % 256, 128)) for x in range(size))
+                    for y in range(size))
+    ihdr = struct.pack(">IIBBBBB", size, size, 8, 2, 0, 0, 0)
+    return b"\x89PNG\r\n\x1a\n" + chunk(b"IHDR", ihdr) + chunk(b"IDAT", zlib.compress(rows)) + chunk(b"IEND", b"")
+
+
+def read_exact(stream, size: int) -> bytes:
+    data = b""
+    while len(data) < size:
+        chunk = stream.read(size - len(data))
+        if not chunk:
+            raise RuntimeError("worker closed stdout")
+        data += chunk
+    return data
+
+
+def memory_kib(pid: int) -> dict:
+    """VmRSS split into anonymous/file pages, and Pss (shared pages divided)."""
+    values = {}
+    with open(f"/proc/{pid}/status") as f:
+        for line in f:
+            key, _, rest = line.partition(":")
+            if key in ("VmRSS", "RssAnon", "RssFile"):
+                values[key] = int(rest.split()[0])
+    try:
+        with open(f"/proc/{pid}/smaps_rollup") as f:
+            for line in f:
+                if line.startswith("Pss:"):
+                    values["Pss"] = int(line.split()[1])
+    except OSError:
+        values["Pss"] = 0
+    return values
+
+
+def worker_command(gpu_id: str, extra_args: list[str]) -> list[str]:
+    repo_root = Path(__file__).resolve().parent
+    binary = repo_root / "bdreader-ncnn-upscaler" / "build-release" / "bdreader-ncnn-upscaler"
+    model_path = repo_root / "models" / "realcugan" / "models-se"
+    return [
+        str(binary),
+        '--engine', 'realcugan',
+        '--mode', 'stdin',
+        '--keep-alive',
+        '--quality', 'F',
+        '--model', str(model_path),
+        '--gpu-id', gpu_id,
+    ] + extra_args
+
+
+def benchmark_mode(mode: str, workers: int, extra_args: list[str]) -> dict:
+    cmd = worker_command('-1', ['--model-load', mode] + extra_args)
+
+    frame = build_request_frame(1, [tiny_png()])
+    start = time.time()
+    procs = [subprocess.Popen(cmd, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+             for _ in range(workers)]
+    for proc in procs:
+        proc.stdin.write(frame)
+        proc.stdin.flush()
+
+    cold_start = []
+    for proc in procs:
+        length = struct.unpack("<I", read_exact(proc.stdout, 4))[0]
+        read_exact(proc.stdout, length)
+        cold_start.append(time.time() - start)
+
+    samples = [memory_kib(proc.pid) for proc in procs]
+
+    for proc in procs:
+        proc.stdin.write(struct.pack("<I", 0))
+        proc.stdin.close()
+    for proc in procs:
+        proc.wait(timeout=60)
+
+    def average(key):
+        return sum(s.get(key, 0) for s in samples) / len(samples) / 1024
+
+    return {
+        'mode': mode,
+        'cold_start_avg': sum(cold_start) / len(cold_start),
+        'cold_start_max': max(cold_start),
+        'rss_mib': average('VmRSS'),
+        'anon_mib': average('RssAnon'),
+        'file_mib': average('RssFile'),
+        'pss_mib': average('Pss'),
+    }
+
+
+def ready_report(gpu_id: str, cache_dir: str, extra_args: list[str]) -> dict:
+    """Start one worker, return its readiness report, and shut it down."""
+    cmd = worker_command(gpu_id, ['--ready-frame', '--shader-cache-dir', cache_dir] + extra_args)
+    start = time.time()
+    proc = subprocess.Popen(cmd, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    length = struct.unpack("<I", read_exact(proc.stdout, 4))[0]
+    payload = read_exact(proc.stdout, length)
+    elapsed = time.time() - start
+    request_id, kind, report_len = struct.unpack_from("<III", payload, 0)
+    if request_id != 0 or kind != 0x13:
+        raise RuntimeError("first frame is not a readiness frame")
+    report = json.loads(payload[12:12 + report_len])
+    proc.stdin.write(struct.pack("<I", 0))
+    proc.stdin.close()
+    proc.wait(timeout=60)
+    return {'elapsed': elapsed, 'load_ms': report['models'][0]['load_ms'], 'ready_ms': report['ready_ms']}
+
+
+def benchmark_shader_cache(gpu_id: str, extra_args: list[str]):
+    print("=" * 70)
+    print(f"Driver shader cache benchmark (gpu {gpu_id})")
+    print("=" * 70)
+    with tempfile.TemporaryDirectory(prefix="bdreader-shader-cache-") as cache_dir:
+        results = [('cold', ready_report(gpu_id, cache_dir, extra_args)),
+                   ('warm', ready_report(gpu_id, cache_dir, extra_args))]
+    print(f"{'Cache':<6} {'Model init ms':<15} {'Ready ms':<10} {'Spawn to ready s':<16}")
+    print("-" * 70)
+    for name, r in results:
+        print(f"{name:<6} {r['load_ms']:<15.1f} {r['ready_ms']:<10.1f} {r['elapsed']:<16.3f}")
+
+
+def main():
+    if len(sys.argv) > 1 and sys.argv[1] == 'shader-cache':
+        gpu_id = sys.argv[2] if len(sys.argv) > 2 else '0'
+        benchmark_shader_cache(gpu_id, sys.argv[3:])
+        return
+
+    workers = int(sys.argv[1]) if len(sys.argv) > 1 else 4
+    extra_args = sys.argv[2:]
+
+    print("=" * 70)
+    print(f"Keep-alive startup benchmark ({workers} workers)")
+    print("=" * 70)
+    # Drop the page cache beforehand (as root: echo 3 > /proc/sys/vm/drop_caches)
+    # for a cold-disk first run; later runs measure a warm page cache.
+    results = [benchmark_mode(mode, workers, extra_args) for mode in ('read', 'mmap')]
+
+    print(f"{'Load':<6} {'Start avg':<10} {'Start max':<10} {'RSS':<10} {'Anon':<10} {'File':<10} {'PSS':<10}")
+    print("-" * 70)
+    for r in results:
+        print(f"{r['mode']:<6} {r['cold_start_avg']:<10.3f} {r['cold_start_max']:<10.3f} "
+              f"{r['rss_mib']:<10.1f} {r['anon_mib']:<10.1f} {r['file_mib']:<10.1f} {r['pss_mib']:<10.1f}")
+    print("-" * 70)
+    print("Times in seconds, memory in MiB per worker.")
+
+
+if __name__ == '__main__':
+    main()